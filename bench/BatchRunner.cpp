@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#ifndef _WIN32
+	#include <unistd.h>
+	#include <sys/wait.h>
+#endif
+
+#include "Engine.hpp"
+#include "Checkpoint.hpp"
+#include "Scene.hpp"
+
+// runs scenarios headless for a fixed number of frames, several at a time, and prints one line of throughput numbers
+// per scenario in the order they were given: JSON lines by default, CSV with --csv. A scenario is a .scene file or
+// a checkpoint. Each one runs in its own process by default, so that a crash or a leak stays in its run
+// usage: physeng-batch [--frames N] [--warmup N] [--jobs J] [--mode process|thread] [--threads T] [--csv] scenario...
+
+struct RunSettings
+{
+	int frames = 300;
+	int warmupFrames = 30;
+	uint32_t threads = 1;
+	bool csv = false;
+};
+
+struct RunResult
+{
+	bool success = false;
+	std::string error;
+	uint32_t particles = 0; // at the end of the run
+	uint32_t links = 0;
+	uint64_t substeps = 0;
+	uint64_t particleSubsteps = 0;
+	double seconds = 0.0;
+	double p50 = 0.0; // frame step times, seconds
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+static const char* csvHeader = "scenario,status,particles,links,frames,substeps,seconds,particle_substeps_per_second,step_ms_p50,step_ms_p99,step_ms_max";
+
+static bool endsWith(const std::string& text, const char* suffix)
+{
+	const size_t length = std::strlen(suffix);
+	return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+static RunResult runScenario(const std::string& path, const RunSettings& settings)
+{
+	RunResult result;
+	Scene scene;
+	std::unique_ptr<Engine> engine;
+	if(endsWith(path, ".scene"))
+	{
+		if(!scene.load(path, result.error))
+			return result;
+		engine = scene.createEngine(settings.threads);
+	}
+	else if(!(engine = Checkpoint::load(path, settings.threads)))
+	{
+		result.error = "could not load the checkpoint " + path;
+		return result;
+	}
+
+	uint64_t frame = 0;
+	for(int f = 0; f < settings.warmupFrames; f++, frame++)
+	{
+		scene.emit(*engine, frame);
+		engine->update();
+	}
+	std::vector<double> stepTimes;
+	stepTimes.reserve(settings.frames);
+	for(int f = 0; f < settings.frames; f++, frame++)
+	{
+		scene.emit(*engine, frame);
+		// the count the frame runs, adaptive substepping picks the next one at its end
+		const uint64_t substeps = engine->getSubStepCount();
+		result.substeps += substeps;
+		result.particleSubsteps += substeps * engine->getObjectCount();
+		const auto start = std::chrono::steady_clock::now();
+		engine->update();
+		stepTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	for(double time : stepTimes)
+		result.seconds += time;
+	std::sort(stepTimes.begin(), stepTimes.end());
+	// nearest rank percentiles
+	auto percentile = [&](double p)
+	{
+		const size_t rank = static_cast<size_t>(std::ceil(p * stepTimes.size()));
+		return stepTimes[std::min(std::max<size_t>(rank, 1), stepTimes.size()) - 1];
+	};
+	result.p50 = percentile(0.5);
+	result.p99 = percentile(0.99);
+	result.max = stepTimes.back();
+	result.particles = engine->getObjectCount();
+	result.links = engine->getLinks().size();
+	result.success = true;
+	return result;
+}
+
+static std::string escapeJson(const std::string& text)
+{
+	std::string escaped;
+	for(char c : text)
+	{
+		if(c == '"' || c == '\\')
+			escaped += '\\';
+		if(static_cast<unsigned char>(c) < 0x20)
+			escaped += ' ';
+		else
+			escaped += c;
+	}
+	return escaped;
+}
+
+static std::string escapeCsv(const std::string& text)
+{
+	std::string escaped = "\"";
+	for(char c : text)
+	{
+		if(c == '"')
+			escaped += '"';
+		escaped += c == '\n' ? ' ' : c;
+	}
+	return escaped + "\"";
+}
+
+static std::string formatResult(const std::string& path, const RunResult& result, const RunSettings& settings)
+{
+	char line[512];
+	if(!result.success)
+	{
+		if(settings.csv)
+			return escapeCsv(path) + ",failed,,,,,,,,,\n";
+		return "{\"scenario\":\"" + escapeJson(path) + "\",\"status\":\"failed\",\"error\":\"" + escapeJson(result.error) + "\"}\n";
+	}
+	const double throughput = result.seconds > 0.0 ? result.particleSubsteps / result.seconds : 0.0;
+	if(settings.csv)
+	{
+		std::snprintf(line, sizeof(line), ",ok,%u,%u,%d,%llu,%.6f,%.0f,%.4f,%.4f,%.4f\n",
+				result.particles, result.links, settings.frames, static_cast<unsigned long long>(result.substeps), result.seconds,
+				throughput, result.p50 * 1000.0, result.p99 * 1000.0, result.max * 1000.0);
+		return escapeCsv(path) + line;
+	}
+	std::snprintf(line, sizeof(line), "\",\"status\":\"ok\",\"particles\":%u,\"links\":%u,\"frames\":%d,\"substeps\":%llu,\"seconds\":%.6f,"
+			"\"particle_substeps_per_second\":%.0f,\"step_ms_p50\":%.4f,\"step_ms_p99\":%.4f,\"step_ms_max\":%.4f}\n",
+			result.particles, result.links, settings.frames, static_cast<unsigned long long>(result.substeps), result.seconds,
+			throughput, result.p50 * 1000.0, result.p99 * 1000.0, result.max * 1000.0);
+	return "{\"scenario\":\"" + escapeJson(path) + line;
+}
+
+// every job pulls the next scenario until none is left
+static void runThreads(const std::vector<std::string>& paths, const RunSettings& settings, uint32_t jobs, std::vector<std::string>& lines,
+		std::vector<char>& failed)
+{
+	std::atomic<uint32_t> next{0};
+	std::vector<std::thread> workers;
+	for(uint32_t j = 0; j < std::min<uint32_t>(jobs, paths.size()); j++)
+	{
+		workers.emplace_back([&]
+		{
+			for(uint32_t i = next++; i < paths.size(); i = next++)
+			{
+				const RunResult result = runScenario(paths[i], settings);
+				lines[i] = formatResult(paths[i], result, settings);
+				failed[i] = !result.success;
+			}
+		});
+	}
+	for(std::thread& worker : workers)
+		worker.join();
+}
+
+#ifndef _WIN32
+// one child per scenario, at most jobs at a time; a child writes its line to a pipe and exits with 2 when its run failed
+static void runProcesses(const std::vector<std::string>& paths, const RunSettings& settings, uint32_t jobs, std::vector<std::string>& lines,
+		std::vector<char>& failed)
+{
+	std::map<pid_t, std::pair<uint32_t, int>> running; // child -> scenario and read end of its pipe
+	uint32_t next = 0;
+	while(next < paths.size() || !running.empty())
+	{
+		if(next < paths.size() && running.size() < jobs)
+		{
+			const uint32_t i = next++;
+			int pipeEnds[2];
+			std::fflush(nullptr);
+			if(pipe(pipeEnds) != 0)
+			{
+				lines[i] = formatResult(paths[i], RunResult{false, "could not create a pipe"}, settings);
+				failed[i] = true;
+				continue;
+			}
+			const pid_t child = fork();
+			if(child == 0)
+			{
+				close(pipeEnds[0]);
+				const RunResult result = runScenario(paths[i], settings);
+				const std::string line = formatResult(paths[i], result, settings);
+				size_t written = 0;
+				while(written < line.size())
+				{
+					const ssize_t count = write(pipeEnds[1], line.data() + written, line.size() - written);
+					if(count <= 0)
+						_exit(1);
+					written += count;
+				}
+				_exit(result.success ? 0 : 2);
+			}
+			close(pipeEnds[1]);
+			if(child < 0)
+			{
+				close(pipeEnds[0]);
+				lines[i] = formatResult(paths[i], RunResult{false, "could not start a process"}, settings);
+				failed[i] = true;
+				continue;
+			}
+			running[child] = {i, pipeEnds[0]};
+			continue;
+		}
+		int status = 0;
+		const pid_t child = wait(&status);
+		if(child < 0)
+			break;
+		auto found = running.find(child);
+		if(found == running.end())
+			continue;
+		const uint32_t i = found->second.first;
+		const int readEnd = found->second.second;
+		running.erase(found);
+		// the line fits in the pipe buffer, so it is all there once the child has exited
+		char buffer[4096];
+		ssize_t count;
+		while((count = read(readEnd, buffer, sizeof(buffer))) > 0)
+			lines[i].append(buffer, count);
+		close(readEnd);
+		const bool finished = WIFEXITED(status) && (WEXITSTATUS(status) == 0 || WEXITSTATUS(status) == 2);
+		failed[i] = !finished || WEXITSTATUS(status) != 0;
+		if(!finished || lines[i].empty())
+			lines[i] = formatResult(paths[i], RunResult{false, "the process running it died"}, settings);
+	}
+}
+#endif
+
+int main(int argc, char** argv)
+{
+	const char* usage = "usage: physeng-batch [--frames N] [--warmup N] [--jobs J] [--mode process|thread] [--threads T] [--csv] scenario...";
+	RunSettings settings;
+	uint32_t jobs = std::max(std::thread::hardware_concurrency(), 1u);
+	bool processes = true;
+	std::vector<std::string> paths;
+	for(int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if(!std::strcmp(argv[i], "--frames") && hasValue)
+			settings.frames = std::max(1, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--warmup") && hasValue)
+			settings.warmupFrames = std::max(0, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--jobs") && hasValue)
+			jobs = std::max(1, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--mode") && hasValue && (!std::strcmp(argv[i + 1], "process") || !std::strcmp(argv[i + 1], "thread")))
+			processes = !std::strcmp(argv[++i], "process");
+		else if(!std::strcmp(argv[i], "--threads") && hasValue)
+			settings.threads = std::max(1, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--csv"))
+			settings.csv = true;
+		else if(argv[i][0] != '-')
+			paths.push_back(argv[i]);
+		else
+		{
+			std::cerr << usage << std::endl;
+			return 1;
+		}
+	}
+	if(paths.empty())
+	{
+		std::cerr << usage << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> lines(paths.size());
+	std::vector<char> failed(paths.size(), 0);
+#ifndef _WIN32
+	if(processes)
+		runProcesses(paths, settings, jobs, lines, failed);
+	else
+#endif
+		runThreads(paths, settings, jobs, lines, failed);
+	if(settings.csv)
+		std::printf("%s\n", csvHeader);
+	for(const std::string& line : lines)
+		std::fputs(line.c_str(), stdout);
+	return std::count(failed.begin(), failed.end(), 1) == 0 ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "Engine.hpp"
+#include "DomainEngine.hpp"
+
+// strong scaling of the domain decomposition: the same scene on 1, 2, 4 .. processes of this machine, each one
+// owning a vertical slab, against a single Engine running it alone
+// usage: domain-bench [--frames N] [--warmup N] [--particles N] [--processes 1,2,4] [--scene pile|ropes|cloth] [--threads T]
+
+static const float objRadius = 2.0f;
+static const float objRigidness = 1.0f;
+static const float frameRate = 60.0f;
+static const int subSteps = 4;
+
+static std::vector<uint32_t> splitCounts(const std::string& list)
+{
+	std::vector<uint32_t> counts;
+	size_t start = 0;
+	while(start <= list.size())
+	{
+		size_t end = list.find(',', start);
+		if(end == std::string::npos)
+			end = list.size();
+		if(end > start)
+			counts.push_back(std::max(1, std::atoi(list.substr(start, end - start).c_str())));
+		start = end + 1;
+	}
+	return counts;
+}
+
+// square world of EngineBench, the pile falls into its lower half
+static float getWorldSize(uint32_t particles)
+{
+	const float spacing = 2.2f * objRadius;
+	return std::ceil(std::sqrt(2.0f * particles)) * spacing + 4.0f * objRadius;
+}
+
+// works on an Engine and on a DomainEngine, the indices addObject returns are global in both
+template<typename Simulation>
+static void spawnScene(Simulation& simulation, const std::string& scene, uint32_t count, float worldSize)
+{
+	const float spacing = 2.2f * objRadius;
+	if(scene == "cloth")
+	{
+		// hanging sheet whose links cross every slab edge
+		const uint32_t side = std::max(2u, static_cast<uint32_t>(std::sqrt(static_cast<float>(count))));
+		const float left = 0.5f * (worldSize - (side - 1) * spacing);
+		std::vector<uint32_t> ids;
+		for(uint32_t row = 0; row < side; row++)
+			for(uint32_t column = 0; column < side; column++)
+				ids.push_back(simulation.addObject(VerletObject(Vec2(left + column * spacing, 2.0f * objRadius + row * spacing), objRadius, objRigidness, row == 0)));
+		for(uint32_t row = 0; row < side; row++)
+		{
+			for(uint32_t column = 0; column < side; column++)
+			{
+				const uint32_t id = ids[row * side + column];
+				if(column + 1 < side)
+					simulation.addLink(Link(id, ids[row * side + column + 1], spacing, 1.0f, false));
+				if(row + 1 < side)
+					simulation.addLink(Link(id, ids[(row + 1) * side + column], spacing, 1.0f, false));
+			}
+		}
+		return;
+	}
+	uint32_t ropeParticles = 0;
+	if(scene == "ropes")
+	{
+		const uint32_t ropeCount = 8;
+		const uint32_t ropeLength = 16;
+		for(uint32_t r = 0; r < ropeCount; r++)
+		{
+			const float x = worldSize * (r + 1) / (ropeCount + 1);
+			uint32_t previous = 0;
+			for(uint32_t k = 0; k < ropeLength; k++)
+			{
+				const uint32_t id = simulation.addObject(VerletObject(Vec2(x, worldSize * 0.5f + k * spacing), objRadius, objRigidness, k == 0));
+				if(k > 0)
+					simulation.addLink(Link(previous, id, spacing, 1.0f, false));
+				previous = id;
+			}
+		}
+		ropeParticles = ropeCount * ropeLength;
+	}
+	const uint32_t pile = count > ropeParticles ? count - ropeParticles : 0;
+	const uint32_t columns = static_cast<uint32_t>((worldSize - 2.0f * objRadius) / spacing);
+	for(uint32_t i = 0; i < pile; i++)
+	{
+		const float jitter = 0.1f * objRadius * static_cast<float>((i * 2654435761u) % 17) / 17.0f;
+		const Vec2 position(2.0f * objRadius + (i % columns) * spacing + jitter, 2.0f * objRadius + (i / columns) * spacing);
+		simulation.addObject(VerletObject(position, objRadius, objRigidness, false));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int frames = 60;
+	int warmupFrames = 10;
+	uint32_t particles = 20000;
+	uint32_t threads = 1;
+	std::vector<uint32_t> processCounts = {1, 2, 4};
+	std::string scene = "pile";
+	for(int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if(!std::strcmp(argv[i], "--frames") && hasValue)
+			frames = std::max(1, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--warmup") && hasValue)
+			warmupFrames = std::max(0, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--particles") && hasValue)
+			particles = std::strtoul(argv[++i], nullptr, 10);
+		else if(!std::strcmp(argv[i], "--processes") && hasValue)
+			processCounts = splitCounts(argv[++i]);
+		else if(!std::strcmp(argv[i], "--scene") && hasValue)
+			scene = argv[++i];
+		else if(!std::strcmp(argv[i], "--threads") && hasValue)
+			threads = std::max(1, std::atoi(argv[++i]));
+		else
+		{
+			std::cerr << "usage: domain-bench [--frames N] [--warmup N] [--particles N] [--processes 1,2,4] [--scene pile|ropes|cloth] [--threads T]" << std::endl;
+			return 1;
+		}
+	}
+	if(scene != "pile" && scene != "ropes" && scene != "cloth")
+	{
+		std::cerr << "unknown scene " << scene << std::endl;
+		return 1;
+	}
+	const float worldSize = getWorldSize(particles);
+	const Rect bounds(0.0f, 0.0f, worldSize, worldSize);
+
+	// the reference runs before any fork, its worker threads would not survive one
+	std::vector<Vec2> reference;
+	double referenceTime = 0.0;
+	{
+		Engine engine(bounds, 1.0f / frameRate, subSteps, 2.0f * objRadius, threads);
+		engine.setBroadPhase(BroadPhaseType::SpatialHash);
+		spawnScene(engine, scene, particles, worldSize);
+		for(int f = 0; f < warmupFrames; f++)
+			engine.update();
+		const auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < frames; f++)
+			engine.update();
+		referenceTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+		const ParticleStore& store = engine.getParticles();
+		for(uint32_t i = 0; i < store.size(); i++)
+			reference.emplace_back(store.x[i], store.y[i]);
+	}
+
+	std::printf("%s, %zu particles, %d frames, single engine %.3f ms/frame\n", scene.c_str(), reference.size(), frames, referenceTime * 1000.0);
+	std::printf("%9s %10s %8s %10s %10s %12s %10s %10s\n",
+			"processes", "ms/frame", "speedup", "efficiency", "exchange", "ghosts/rank", "rms diff", "max diff");
+	for(uint32_t processes : processCounts)
+	{
+		std::unique_ptr<SocketTransport> transport = SocketTransport::spawn(processes);
+		if(!transport)
+		{
+			std::cerr << "could not start " << processes << " processes" << std::endl;
+			return 1;
+		}
+		DomainEngine domain(bounds, 1.0f / frameRate, subSteps, 2.0f * objRadius, *transport, threads);
+		spawnScene(domain, scene, particles, worldSize);
+		bool success = true;
+		for(int f = 0; f < warmupFrames && success; f++)
+			success = domain.update();
+		// gathering lines the ranks up before the clock starts and after it stops
+		std::vector<DomainParticle> gathered;
+		success = success && domain.gatherParticles(gathered);
+		domain.resetTimings();
+		const auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < frames && success; f++)
+			success = domain.update();
+		success = success && domain.gatherParticles(gathered);
+		const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+		if(transport->getRank() != 0)
+			std::exit(success ? 0 : 1);
+		success = transport->waitForPeers() && success;
+		if(!success || gathered.size() != reference.size())
+		{
+			std::cerr << "the run on " << processes << " processes failed" << std::endl;
+			return 1;
+		}
+
+		double squared = 0.0;
+		double maxDiff = 0.0;
+		for(const DomainParticle& particle : gathered)
+		{
+			const double dx = particle.x - reference[particle.id].x;
+			const double dy = particle.y - reference[particle.id].y;
+			squared += dx * dx + dy * dy;
+			maxDiff = std::max(maxDiff, std::sqrt(dx * dx + dy * dy));
+		}
+		const DomainTimings& t = domain.getTimings();
+		std::printf("%9u %10.3f %8.2f %10.2f %10.3f %12.0f %10.4f %10.4f\n",
+				processes, time * 1000.0, referenceTime / time, referenceTime / time / processes,
+				t.exchange * 1000.0 / frames, static_cast<double>(t.ghosts) / (frames * subSteps),
+				std::sqrt(squared / gathered.size()), maxDiff);
+		std::fflush(stdout);
+	}
+	std::printf("exchange and ghosts are rank 0's, diffs are distances to the single engine's positions\n");
+}
@@ -0,0 +1,265 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "Engine.hpp"
+#include "TrajectoryRecorder.hpp"
+
+// times every phase of Engine::update over standard headless scenes
+// usage: physeng-bench [--frames N] [--threads T] [--sizes 10000,100000,1000000] [--scenes pile,ropes,cloth] [--warmup N] [--sleep] [--adaptive min,max] [--broadphase grid|hash] [--neighbor-list skin] [--no-task-graph] [--trace out.json] [--record prefix]
+
+static const float objRadius = 2.0f;
+static const float objRigidness = 1.0f;
+static const float frameRate = 60.0f;
+static const int subSteps = 4;
+
+struct Scene
+{
+	std::string name;
+	uint32_t particles;
+};
+
+static std::vector<std::string> split(const std::string& list)
+{
+	std::vector<std::string> items;
+	size_t start = 0;
+	while(start <= list.size())
+	{
+		size_t end = list.find(',', start);
+		if(end == std::string::npos)
+			end = list.size();
+		if(end > start)
+			items.push_back(list.substr(start, end - start));
+		start = end + 1;
+	}
+	return items;
+}
+
+// square world twice as large as the lattice holding all particles, the pile falls into its lower half
+static float getWorldSize(uint32_t particles)
+{
+	const float spacing = 2.2f * objRadius;
+	return std::ceil(std::sqrt(2.0f * particles)) * spacing + 4.0f * objRadius;
+}
+
+static void spawnPile(Engine& engine, uint32_t count, float worldSize)
+{
+	const float spacing = 2.2f * objRadius;
+	const uint32_t columns = static_cast<uint32_t>((worldSize - 2.0f * objRadius) / spacing);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		// slight horizontal jitter so the pile does not stay a perfect lattice
+		const float jitter = 0.1f * objRadius * static_cast<float>((i * 2654435761u) % 17) / 17.0f;
+		const Vec2 position(2.0f * objRadius + (i % columns) * spacing + jitter, 2.0f * objRadius + (i / columns) * spacing);
+		engine.addObject(VerletObject(position, objRadius, objRigidness, false));
+	}
+}
+
+// pile plus a few ropes hanging from fixed anchors, so that the link phases have work to do
+static void spawnRopes(Engine& engine, uint32_t count, float worldSize)
+{
+	const uint32_t ropeCount = 8;
+	const uint32_t ropeLength = 16;
+	const float spacing = 2.2f * objRadius;
+	for(uint32_t r = 0; r < ropeCount; r++)
+	{
+		const float x = worldSize * (r + 1) / (ropeCount + 1);
+		int previous = -1;
+		for(uint32_t k = 0; k < ropeLength; k++)
+		{
+			const int id = engine.addObject(VerletObject(Vec2(x, worldSize * 0.5f + k * spacing), objRadius, objRigidness, k == 0));
+			if(previous != -1)
+				engine.addLink(Link(previous, id, spacing, 1.0f, false));
+			previous = id;
+		}
+	}
+	const uint32_t ropeParticles = ropeCount * ropeLength;
+	spawnPile(engine, count > ropeParticles ? count - ropeParticles : 0, worldSize);
+}
+
+// square sheet of particles linked to their right and lower neighbours, hanging from its fixed top row
+static void spawnCloth(Engine& engine, uint32_t count, float worldSize)
+{
+	const float spacing = 2.2f * objRadius;
+	const uint32_t side = std::max(2u, static_cast<uint32_t>(std::sqrt(static_cast<float>(count))));
+	const float left = 0.5f * (worldSize - (side - 1) * spacing);
+	const uint32_t base = engine.getObjectCount();
+	for(uint32_t row = 0; row < side; row++)
+		for(uint32_t column = 0; column < side; column++)
+			engine.addObject(VerletObject(Vec2(left + column * spacing, 2.0f * objRadius + row * spacing), objRadius, objRigidness, row == 0));
+	for(uint32_t row = 0; row < side; row++)
+	{
+		for(uint32_t column = 0; column < side; column++)
+		{
+			const int id = base + row * side + column;
+			if(column + 1 < side)
+				engine.addLink(Link(id, id + 1, spacing, 1.0f, false));
+			if(row + 1 < side)
+				engine.addLink(Link(id, id + side, spacing, 1.0f, false));
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int frames = 10;
+	int warmupFrames = 2;
+	uint32_t threads = 1;
+	std::vector<std::string> sizes = {"10000", "100000", "1000000"};
+	std::vector<std::string> sceneNames = {"pile", "ropes", "cloth"};
+	bool sleep = false;
+	SubstepSettings substepSettings;
+	BroadPhaseType broadPhase = BroadPhaseType::Grid;
+	NeighborListSettings neighborSettings;
+	bool taskGraph = true;
+	std::string tracePath;
+	std::string recordPrefix;
+	for(int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if(!std::strcmp(argv[i], "--frames") && hasValue)
+			frames = std::max(1, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--threads") && hasValue)
+			threads = std::max(1, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--sizes") && hasValue)
+			sizes = split(argv[++i]);
+		else if(!std::strcmp(argv[i], "--scenes") && hasValue)
+			sceneNames = split(argv[++i]);
+		else if(!std::strcmp(argv[i], "--warmup") && hasValue)
+			warmupFrames = std::max(0, std::atoi(argv[++i]));
+		else if(!std::strcmp(argv[i], "--sleep"))
+			sleep = true;
+		else if(!std::strcmp(argv[i], "--adaptive") && hasValue)
+		{
+			const std::vector<std::string> bounds = split(argv[++i]);
+			substepSettings.adaptive = true;
+			substepSettings.minSubSteps = bounds.size() > 0 ? std::atoi(bounds[0].c_str()) : 1;
+			substepSettings.maxSubSteps = bounds.size() > 1 ? std::atoi(bounds[1].c_str()) : subSteps;
+		}
+		else if(!std::strcmp(argv[i], "--broadphase") && hasValue)
+			broadPhase = !std::strcmp(argv[++i], "hash") ? BroadPhaseType::SpatialHash : BroadPhaseType::Grid;
+		else if(!std::strcmp(argv[i], "--neighbor-list") && hasValue)
+		{
+			neighborSettings.enabled = true;
+			neighborSettings.skin = std::atof(argv[++i]);
+		}
+		else if(!std::strcmp(argv[i], "--no-task-graph"))
+			taskGraph = false;
+		else if(!std::strcmp(argv[i], "--trace") && hasValue)
+			tracePath = argv[++i];
+		else if(!std::strcmp(argv[i], "--record") && hasValue)
+			recordPrefix = argv[++i];
+		else
+		{
+			std::cerr << "usage: physeng-bench [--frames N] [--threads T] [--sizes 10000,100000,1000000] [--scenes pile,ropes,cloth] [--warmup N] [--sleep] [--adaptive min,max] [--broadphase grid|hash] [--neighbor-list skin] [--no-task-graph] [--trace out.json] [--record prefix]" << std::endl;
+			return 1;
+		}
+	}
+
+#ifndef PHYSENG_PROFILING
+	if(!tracePath.empty())
+	{
+		std::cerr << "--trace needs a build configured with -DPHYSENG_ENABLE_PROFILING=ON" << std::endl;
+		return 1;
+	}
+#endif
+
+	std::printf("%-6s %9s %10s | %10s %10s %10s %11s %9s %9s   (ms/frame, %d threads)\n",
+			"scene", "particles", "total", "collisions", "obj-links", "link-cons", "integration", "sleep", "sleeping", threads);
+	for(const std::string& sceneName : sceneNames)
+	{
+		for(const std::string& size : sizes)
+		{
+			const uint32_t particles = std::strtoul(size.c_str(), nullptr, 10);
+			const float worldSize = getWorldSize(particles);
+			Engine engine(Rect(0.0f, 0.0f, worldSize, worldSize), 1.0f / frameRate, subSteps, 2.0f * objRadius, threads);
+			if(sceneName == "pile")
+				spawnPile(engine, particles, worldSize);
+			else if(sceneName == "ropes")
+				spawnRopes(engine, particles, worldSize);
+			else if(sceneName == "cloth")
+				spawnCloth(engine, particles, worldSize);
+			else
+			{
+				std::cerr << "unknown scene " << sceneName << std::endl;
+				return 1;
+			}
+
+			engine.setBroadPhase(broadPhase);
+			engine.setNeighborListSettings(neighborSettings);
+			engine.setTaskGraphEnabled(taskGraph);
+			engine.setSleepEnabled(sleep);
+			engine.setSubstepSettings(substepSettings);
+			for(int f = 0; f < warmupFrames; f++)
+				engine.update();
+			engine.setTimingEnabled(true);
+#ifdef PHYSENG_PROFILING
+			Profiler::get().reset();
+#endif
+			// the measured frames are also written to <prefix>-<scene>-<particles>.traj when recording
+			TrajectoryRecorder recorder;
+			if(!recordPrefix.empty() && !recorder.open(recordPrefix + "-" + sceneName + "-" + size + ".traj"))
+			{
+				std::cerr << "could not open the trajectory file" << std::endl;
+				return 1;
+			}
+			const auto start = std::chrono::steady_clock::now();
+			for(int f = 0; f < frames; f++)
+			{
+				engine.update();
+				recorder.record(engine);
+			}
+			const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			const EngineTimings& t = engine.getTimings();
+			const double scale = 1000.0 / frames;
+			std::printf("%-6s %9u %10.3f | %10.3f %10.3f %10.3f %11.3f %9.3f %9u\n",
+					sceneName.c_str(), engine.getObjectCount(), total * scale,
+					t.collisions * scale, t.objectLinkCollisions * scale, t.linkConstraints * scale,
+					t.integration * scale, t.sleep * scale, engine.getSleepingCount());
+			if(t.taskGraph > 0.0)
+				std::printf("       task graph %.3f ms/frame, collisions and integration overlap there\n", t.taskGraph * scale);
+			if(neighborSettings.enabled)
+				std::printf("       %.2f neighbor list builds/frame\n", static_cast<double>(engine.getNeighborListBuildCount()) / (frames + warmupFrames));
+			if(substepSettings.adaptive)
+			{
+				const SubstepStats& stats = engine.getSubstepStats();
+				std::printf("       %.2f substeps/frame, last frame: displacement %.3f penetration %.3f link stretch %.3f -> %d substeps\n",
+						static_cast<double>(t.substeps) / frames, stats.displacement, stats.penetration, stats.linkStretch, stats.subSteps);
+			}
+			if(recorder.isOpen())
+			{
+				const double recording = total - t.collisions - t.objectLinkCollisions - t.linkConstraints
+						- t.integration - t.sleep - t.taskGraph;
+				recorder.close();
+				std::printf("       recorded %llu frames, %.2f MB, %.1fx smaller than raw floats, record() %.3f ms/frame\n",
+						static_cast<unsigned long long>(recorder.getRecordedFrames()), recorder.getBytesWritten() / 1.0e6,
+						static_cast<double>(recorder.getRawBytes()) / recorder.getBytesWritten(), recording * scale);
+			}
+#ifdef PHYSENG_PROFILING
+			const ProfileStats stats = Profiler::get().getStats();
+			std::printf("       pair tests %llu, contacts %llu, link tests %llu, clamped %llu, cells by occupancy 0/1/2/3/4/5-8/9-16/17+:",
+					static_cast<unsigned long long>(stats.counters[static_cast<int>(ProfileCounter::PairTests)] / frames),
+					static_cast<unsigned long long>(stats.counters[static_cast<int>(ProfileCounter::Contacts)] / frames),
+					static_cast<unsigned long long>(stats.counters[static_cast<int>(ProfileCounter::LinkCollisionTests)] / frames),
+					static_cast<unsigned long long>(stats.counters[static_cast<int>(ProfileCounter::ClampedInsertions)] / frames));
+			for(uint64_t bucket : stats.occupancy)
+				std::printf(" %llu", static_cast<unsigned long long>(bucket / t.substeps));
+			std::printf("   (per frame)\n");
+#endif
+			std::fflush(stdout);
+		}
+	}
+#ifdef PHYSENG_PROFILING
+	if(!tracePath.empty() && !Profiler::get().writeChromeTrace(tracePath))
+	{
+		std::cerr << "could not write " << tracePath << std::endl;
+		return 1;
+	}
+#endif
+}
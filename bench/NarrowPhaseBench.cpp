@@ -0,0 +1,61 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <cstdio>
+
+#include "Engine.hpp"
+
+static const float sceneSize = 1000.0f;
+static const float objRadius = 5.0f;
+
+// pile of particles spaced closer than their diameter, the smaller the spacing the denser the contacts
+static void spawnPile(Engine& engine, float spacing)
+{
+	for(float y = objRadius; y < sceneSize - objRadius; y += spacing)
+		for(float x = objRadius; x < sceneSize - objRadius; x += spacing)
+			engine.addObject(VerletObject({x, y}, objRadius, 1.0f, false));
+}
+
+int main(int argc, char** argv)
+{
+	const int frames = argc > 1 ? std::atoi(argv[1]) : 50;
+	const NarrowPhaseKernelType types[] = {NarrowPhaseKernelType::Scalar, NarrowPhaseKernelType::SSE2, NarrowPhaseKernelType::AVX2};
+
+	// accuracy: one frame on a lightly overlapping pile, compared with the scalar path
+	Engine reference(Rect(0, 0, sceneSize, sceneSize), 1.0f / 60.0f, 4, 2.0f * objRadius);
+	spawnPile(reference, 1.9f * objRadius);
+	reference.setNarrowPhaseKernel(NarrowPhaseKernelType::Scalar);
+	reference.update();
+
+	double scalarTime = 0.0;
+	for(NarrowPhaseKernelType type : types)
+	{
+		if(!isNarrowPhaseKernelSupported(type))
+		{
+			std::cout << getNarrowPhaseKernelName(type) << ": not supported" << std::endl;
+			continue;
+		}
+		Engine engine(Rect(0, 0, sceneSize, sceneSize), 1.0f / 60.0f, 4, 2.0f * objRadius);
+		spawnPile(engine, 1.9f * objRadius);
+		engine.setNarrowPhaseKernel(type);
+		engine.update();
+		float maxError = 0.0f;
+		const ParticleStore& a = engine.getParticles();
+		const ParticleStore& b = reference.getParticles();
+		for(uint32_t i = 0; i < a.size(); i++)
+			maxError = std::max(maxError, std::max(std::abs(a.x[i] - b.x[i]), std::abs(a.y[i] - b.y[i])));
+
+		// throughput: dense pile where most candidate pairs overlap
+		Engine dense(Rect(0, 0, sceneSize, sceneSize), 1.0f / 60.0f, 4, 2.0f * objRadius);
+		spawnPile(dense, 1.6f * objRadius);
+		dense.setNarrowPhaseKernel(type);
+		const auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < frames; f++)
+			dense.update();
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+		if(type == NarrowPhaseKernelType::Scalar)
+			scalarTime = ms;
+		std::printf("%-6s %u particles  %8.3f ms/frame  speedup %.2fx  max deviation %.5f\n",
+				getNarrowPhaseKernelName(type), dense.getObjectCount(), ms, scalarTime / ms, maxError);
+	}
+}
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "Engine.hpp"
+
+// cost of the spatial queries against the linear scans they replace, on the same number of particles spread
+// over worlds of growing size and on both broad phases: the grid queries should stay flat while the scans grow
+// with the particle count. Every query must return what its scan found, the exit status is non zero otherwise
+// usage: query-bench [particles] [queries]
+
+static const float objRadius = 2.0f;
+static const float queryRadius = 20.0f;
+
+template<typename Query>
+static double timeQueries(uint32_t queries, Query query)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for(uint32_t q = 0; q < queries; q++)
+		query(q);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e6 / queries;
+}
+
+// normalized as rayCast does, so that the scans compute the same distances
+static Vec2 getRayDirection(uint32_t q)
+{
+	const Vec2 direction(std::cos(static_cast<float>(q)), std::sin(static_cast<float>(q)));
+	return direction / std::sqrt(direction.x * direction.x + direction.y * direction.y);
+}
+
+static float getDistanceSqr(const ParticleStore& store, uint32_t i, Vec2 point)
+{
+	const float dx = store.x[i] - point.x;
+	const float dy = store.y[i] - point.y;
+	return dx * dx + dy * dy;
+}
+
+// distance along the ray to particle i, infinity when the ray misses it
+static float getRayDistance(const ParticleStore& store, uint32_t i, Vec2 origin, Vec2 direction)
+{
+	const float mx = origin.x - store.x[i];
+	const float my = origin.y - store.y[i];
+	const float b = mx * direction.x + my * direction.y;
+	const float c = mx * mx + my * my - store.radius[i] * store.radius[i];
+	const float discriminant = b * b - c;
+	if((c > 0.0f && b > 0.0f) || discriminant < 0.0f)
+		return std::numeric_limits<float>::infinity();
+	return std::max(0.0f, -b - std::sqrt(discriminant));
+}
+
+int main(int argc, char** argv)
+{
+	const uint32_t particles = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+	const uint32_t queries = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+	std::printf("%u particles, %u queries of radius %.0f, microseconds per query\n", particles, queries, queryRadius);
+	std::printf("%10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "broadphase", "world", "density", "radius", "scan", "nearest", "scan", "ray", "scan");
+	uint32_t mismatches = 0;
+	const float densities[] = {0.5f, 0.1f, 0.02f};
+	// every density on the dense grid, then on the spatial hash
+	for(uint32_t run = 0; run < 6; run++)
+	{
+		const float density = densities[run % 3];
+		const BroadPhaseType broadPhase = run < 3 ? BroadPhaseType::Grid : BroadPhaseType::SpatialHash;
+		// square world holding the particles at the given fraction of its area
+		const float worldSize = std::sqrt(particles * 3.14159f * objRadius * objRadius / density);
+		Engine engine(Rect(0.0f, 0.0f, worldSize, worldSize), 1.0f / 60.0f, 1, 2.0f * objRadius);
+		engine.setBroadPhase(broadPhase);
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> coordinate(objRadius, worldSize - objRadius);
+		for(uint32_t i = 0; i < particles; i++)
+			engine.addObject(VerletObject(Vec2(coordinate(random), coordinate(random)), objRadius, 1.0f, false));
+		std::vector<Vec2> points(queries);
+		for(Vec2& point : points)
+			point = Vec2(coordinate(random), coordinate(random));
+		std::vector<uint32_t> found(particles);
+		// the first query builds the grid, it is timed apart by the simulation
+		engine.findNearestObject(points[0]);
+		const ParticleStore& store = engine.getParticles();
+		// results of both sides, compared once everything is timed
+		std::vector<uint32_t> gridFound;
+		std::vector<uint32_t> gridFoundStart(1, 0);
+		std::vector<uint32_t> scanFound;
+		std::vector<uint32_t> scanFoundStart(1, 0);
+		std::vector<uint32_t> gridNearest(queries);
+		std::vector<uint32_t> scanNearest(queries);
+		std::vector<RayHit> gridHits(queries);
+		std::vector<RayHit> scanHits(queries);
+
+		const double radius = timeQueries(queries, [&](uint32_t q)
+		{
+			const uint32_t count = engine.queryRadius(points[q], queryRadius, found.data(), particles);
+			gridFound.insert(gridFound.end(), found.begin(), found.begin() + count);
+			gridFoundStart.push_back(gridFound.size());
+		});
+		const double radiusScan = timeQueries(queries, [&](uint32_t q)
+		{
+			for(uint32_t i = 0; i < store.size(); i++)
+				if(getDistanceSqr(store, i, points[q]) <= queryRadius * queryRadius)
+					scanFound.push_back(i);
+			scanFoundStart.push_back(scanFound.size());
+		});
+		const double nearest = timeQueries(queries, [&](uint32_t q)
+		{
+			gridNearest[q] = engine.findNearestObject(points[q]);
+		});
+		const double nearestScan = timeQueries(queries, [&](uint32_t q)
+		{
+			float best = std::numeric_limits<float>::infinity();
+			uint32_t nearestObject = Engine::noObject;
+			for(uint32_t i = 0; i < store.size(); i++)
+			{
+				const float distanceSqr = getDistanceSqr(store, i, points[q]);
+				if(distanceSqr < best)
+				{
+					best = distanceSqr;
+					nearestObject = i;
+				}
+			}
+			scanNearest[q] = nearestObject;
+		});
+		const double ray = timeQueries(queries, [&](uint32_t q)
+		{
+			engine.rayCast(points[q], getRayDirection(q), worldSize, gridHits[q]);
+		});
+		const double rayScan = timeQueries(queries, [&](uint32_t q)
+		{
+			const Vec2 direction = getRayDirection(q);
+			float best = worldSize;
+			uint32_t hitObject = Engine::noObject;
+			for(uint32_t i = 0; i < store.size(); i++)
+			{
+				const float t = getRayDistance(store, i, points[q], direction);
+				if(t < best)
+				{
+					best = t;
+					hitObject = i;
+				}
+			}
+			scanHits[q].particle = hitObject;
+			scanHits[q].distance = hitObject != Engine::noObject ? best : 0.0f;
+		});
+		std::printf("%10s %10.0f %10.2f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", broadPhase == BroadPhaseType::Grid ? "grid" : "hash",
+				worldSize, density, radius, radiusScan, nearest, nearestScan, ray, rayScan);
+
+		// the scan lists its particles in ascending order, the grid by cell. Particles at the same distance
+		// may come in either order, the nearest or the hit one can be any of them
+		for(uint32_t q = 0; q < queries; q++)
+		{
+			const auto begin = gridFound.begin() + gridFoundStart[q];
+			const auto end = gridFound.begin() + gridFoundStart[q + 1];
+			std::sort(begin, end);
+			if(!std::equal(begin, end, scanFound.begin() + scanFoundStart[q], scanFound.begin() + scanFoundStart[q + 1]))
+			{
+				std::printf("queryRadius mismatch at query %u: %u particles instead of %u\n", q,
+						gridFoundStart[q + 1] - gridFoundStart[q], scanFoundStart[q + 1] - scanFoundStart[q]);
+				mismatches++;
+			}
+			if(gridNearest[q] != scanNearest[q] && (gridNearest[q] == Engine::noObject || scanNearest[q] == Engine::noObject
+					|| getDistanceSqr(store, gridNearest[q], points[q]) != getDistanceSqr(store, scanNearest[q], points[q])))
+			{
+				std::printf("findNearestObject mismatch at query %u: %u instead of %u\n", q, gridNearest[q], scanNearest[q]);
+				mismatches++;
+			}
+			const uint32_t hitObject = gridHits[q].particle;
+			if(gridHits[q].distance != scanHits[q].distance || (hitObject != scanHits[q].particle && (hitObject == Engine::noObject
+					|| scanHits[q].particle == Engine::noObject || getRayDistance(store, hitObject, points[q], getRayDirection(q)) != scanHits[q].distance)))
+			{
+				std::printf("rayCast mismatch at query %u: particle %u at %f instead of %u at %f\n", q,
+						gridHits[q].particle, gridHits[q].distance, scanHits[q].particle, scanHits[q].distance);
+				mismatches++;
+			}
+		}
+	}
+	return mismatches > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+#include "Engine.hpp"
+
+// measures the effect of periodic Morton reordering on a scene whose particles are fully mixed in memory
+// usage: reorder-bench [particles] [frames] [reorder interval]
+
+static const float objRadius = 2.0f;
+
+// hardware cache misses of the calling thread, reports -1 when perf events are unavailable
+class CacheMissCounter
+{
+private:
+	int fd = -1;
+public:
+	CacheMissCounter()
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+	~CacheMissCounter()
+	{
+#ifdef __linux__
+		if(fd != -1)
+			close(fd);
+#endif
+	}
+	void start()
+	{
+#ifdef __linux__
+		if(fd != -1)
+		{
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+	long long stop()
+	{
+		long long count = -1;
+#ifdef __linux__
+		if(fd != -1)
+		{
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if(read(fd, &count, sizeof(count)) != sizeof(count))
+				count = -1;
+		}
+#endif
+		return count;
+	}
+};
+
+// a settled pile whose memory order has nothing to do with space, as after a long run where particles mixed
+static void spawnMixedPile(Engine& engine, uint32_t count, float worldSize)
+{
+	const float spacing = 2.2f * objRadius;
+	const uint32_t columns = static_cast<uint32_t>((worldSize - 2.0f * objRadius) / spacing);
+	std::vector<uint32_t> slots(count);
+	for(uint32_t i = 0; i < count; i++)
+		slots[i] = i;
+	std::shuffle(slots.begin(), slots.end(), std::mt19937(42));
+	for(uint32_t slot : slots)
+	{
+		const Vec2 position(2.0f * objRadius + (slot % columns) * spacing, worldSize - 2.0f * objRadius - (slot / columns) * spacing);
+		engine.addObject(VerletObject(position, objRadius, 1.0f, false));
+	}
+}
+
+static void run(uint32_t particles, int frames, uint32_t interval)
+{
+	const float worldSize = std::ceil(std::sqrt(2.0f * particles)) * 2.2f * objRadius;
+	Engine engine(Rect(0.0f, 0.0f, worldSize, worldSize), 1.0f / 60.0f, 4, 2.0f * objRadius);
+	spawnMixedPile(engine, particles, worldSize);
+	engine.setReorderInterval(interval);
+	CacheMissCounter misses;
+	misses.start();
+	const auto start = std::chrono::steady_clock::now();
+	for(int f = 0; f < frames; f++)
+		engine.update();
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+	const long long missCount = misses.stop();
+	if(missCount >= 0)
+		std::printf("reorder every %4u frames: %9.3f ms/frame  %12.0f cache misses/frame  (%llu reorders)\n",
+				interval, ms, static_cast<double>(missCount) / frames, static_cast<unsigned long long>(engine.getReorderCount()));
+	else
+		std::printf("reorder every %4u frames: %9.3f ms/frame  cache misses n/a  (%llu reorders)\n",
+				interval, ms, static_cast<unsigned long long>(engine.getReorderCount()));
+}
+
+int main(int argc, char** argv)
+{
+	const uint32_t particles = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+	const int frames = argc > 2 ? std::atoi(argv[2]) : 30;
+	const uint32_t interval = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 10;
+	std::printf("%u mixed particles, %d frames\n", particles, frames);
+	run(particles, frames, 0);
+	run(particles, frames, interval);
+}
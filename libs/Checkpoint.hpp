@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Engine.hpp"
+
+struct CheckpointHeader;
+
+// versioned binary snapshot of the whole simulation state: particle arrays, links, grid parameters,
+// gravity, bounds, walls, broad phase and neighbour list settings, time step and substepping, sleep islands and the handle tables. Every array sits in its own 64 byte aligned section
+// so that saving is one gathered write and loading copies each section straight out of a mapping of the file
+
+class Checkpoint
+{
+private:
+	static void apply(Engine& engine, const char* data, const CheckpointHeader& header);
+	static void getLiveIslands(const SleepSystem& sleep, std::vector<uint32_t>& islandOf, std::vector<uint32_t>& islandStart,
+			std::vector<uint32_t>& islandMembers);
+
+public:
+	static constexpr uint32_t version = 5;
+
+	// returns false when the file cannot be written
+	static bool save(const Engine& engine, const std::string& path);
+	// replaces the state of an existing engine, which must have been built with the same stepdt and subSteps as the saved one;
+	// returns false and leaves the engine untouched when the file is missing, corrupt or incompatible. Settings the
+	// engine cannot run count as corrupt: non finite or empty bounds and step, more than 1024 substeps or a
+	// grid of more than CollisionGrid::maxCellCount cells
+	static bool restore(Engine& engine, const std::string& path);
+	// builds a new engine from the file, nullptr on failure
+	static std::unique_ptr<Engine> load(const std::string& path, uint32_t threadCount = 1);
+};
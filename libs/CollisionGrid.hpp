@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// occupancy statistics of the last grid build
+struct CollisionGridStats
+{
+	uint32_t insertedObjects = 0;
+	uint32_t clampedObjects = 0; // objects outside the grid area, inserted into the nearest border cell
+	uint32_t occupiedCells = 0;
+	uint32_t maxCellOccupancy = 0;
+};
+
+// inclusive range of grid cells covered by a bounding box
+struct CellRange
+{
+	uint32_t minX;
+	uint32_t minY;
+	uint32_t maxX;
+	uint32_t maxY;
+};
+
+// cells covered by range, in 64 bits since a range may span most of the plane
+inline uint64_t getRangeCellCount(const CellRange& range)
+{
+	if(range.minX > range.maxX || range.minY > range.maxY)
+		return 0;
+	return static_cast<uint64_t>(range.maxX - range.minX + 1) * (range.maxY - range.minY + 1);
+}
+
+// uniform grid stored in compressed sparse row form: the ids of the objects in cell c are
+// cellObjects[cellStart[c]] .. cellObjects[cellStart[c+1]-1], there is no per-cell capacity.
+// Dense over the world rectangle, objects outside of it go to the nearest border cell.
+// SpatialHashGrid offers the same queries over only the occupied cells of an unbounded plane
+struct CollisionGrid
+{
+	static constexpr uint32_t noCell = 0xffffffff;
+	// largest grid the scene and checkpoint loaders accept, a few hundred megabytes of cells and link cells
+	static constexpr uint64_t maxCellCount = 1ull << 26;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	int cellSize = 1;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> cellObjects;
+	std::vector<uint32_t> objectCell; // cell of each inserted object, computed by the counting pass
+	CollisionGridStats stats;
+
+	void resize(uint32_t width, uint32_t height, int cellSize);
+	// counting sort of all objects into their cells: count, prefix-sum, scatter
+	void build(const float* x, const float* y, uint32_t count);
+	// same for the subset of objects listed in ids (ascending), the grid stores the ids
+	void build(const float* x, const float* y, const uint32_t* ids, uint32_t count);
+	// same counting sort for objects with an extent, each id is inserted in every cell of its range
+	void build(const std::vector<CellRange>& ranges);
+	void clear();
+	uint32_t getCellIndex(float x, float y) const;
+	CellRange getCellRange(float minX, float minY, float maxX, float maxY) const;
+	uint32_t getCellCount() const
+	{
+		return width * height;
+	}
+
+	// queries shared with SpatialHashGrid, written against cell coordinates
+	void getCellCoords(float x, float y, uint32_t& cellX, uint32_t& cellY) const
+	{
+		const uint32_t cellIndex = getCellIndex(x, y);
+		cellX = cellIndex % width;
+		cellY = cellIndex / width;
+	}
+	// index of cell (cellX, cellY), noCell outside of the grid
+	uint32_t findCell(uint32_t cellX, uint32_t cellY) const
+	{
+		return cellX < width && cellY < height ? cellX + cellY * width : noCell;
+	}
+	// cells that may hold objects
+	CellRange getBounds() const
+	{
+		return {0, 0, width - 1, height - 1};
+	}
+	// true once a coarser grid would not split the world any further
+	bool spansSingleCell() const
+	{
+		return width <= 1 && height <= 1;
+	}
+	// calls visit(objects, count) for every non-empty cell of range, columns outer, clipped to the grid
+	template<typename Visitor>
+	void forEachCell(const CellRange& range, Visitor visit) const
+	{
+		const uint32_t maxX = range.maxX < width - 1 ? range.maxX : width - 1;
+		const uint32_t maxY = range.maxY < height - 1 ? range.maxY : height - 1;
+		for(uint32_t x = range.minX; x <= maxX; x++)
+		{
+			for(uint32_t y = range.minY; y <= maxY; y++)
+			{
+				const uint32_t cellIndex = x + y * width;
+				const uint32_t objCount = getObjectCount(cellIndex);
+				if(objCount > 0)
+					visit(getObjects(cellIndex), objCount);
+			}
+		}
+	}
+	// forEachCell over the 3x3 block around cell cellIndex at (cellX, cellY)
+	template<typename Visitor>
+	void forEachCellAround(uint32_t cellX, uint32_t cellY, uint32_t, Visitor visit) const
+	{
+		forEachCell({cellX > 0 ? cellX - 1 : 0, cellY > 0 ? cellY - 1 : 0, cellX + 1, cellY + 1}, visit);
+	}
+	// calls visit(cellX, cellY, cellIndex) for every cell of columns [startX, endX), rows outer
+	template<typename Visitor>
+	void forEachCellInColumns(uint32_t startX, uint32_t endX, Visitor visit) const
+	{
+		endX = endX < width ? endX : width;
+		for(uint32_t y = 0; y < height; y++)
+			for(uint32_t x = startX; x < endX; x++)
+				visit(x, y, x + y * width);
+	}
+	uint32_t getObjectCount(uint32_t cellIndex) const
+	{
+		return cellStart[cellIndex + 1] - cellStart[cellIndex];
+	}
+	const uint32_t* getObjects(uint32_t cellIndex) const
+	{
+		return cellObjects.data() + cellStart[cellIndex];
+	}
+};
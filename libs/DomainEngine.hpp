@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Engine.hpp"
+#include "DomainTransport.hpp"
+
+// state of a particle travelling between ranks, also what gatherParticles returns
+struct DomainParticle
+{
+	uint32_t id; // global index given by DomainEngine::addObject
+	float x;
+	float y;
+	float prevX;
+	float prevY;
+	float radius;
+	float rigidness;
+	uint8_t flags;
+	Color color;
+};
+
+struct DomainTimings
+{
+	double exchange = 0.0; // packing, sending, waiting for and unpacking the substep messages, seconds
+	double simulation = 0.0; // substeps of the local engine, seconds
+	uint64_t migrated = 0; // particles handed to a neighbour
+	uint64_t ghosts = 0; // ghosts simulated, summed over substeps
+};
+
+// one process's share of a simulation split into vertical slabs of bounds: rank r of n owns the particles with
+// left + r * width / n <= x < left + (r + 1) * width / n, the outer slabs reach past the edges of bounds.
+// Every substep starts with one message to each neighbouring rank holding the particles that left the slab,
+// which change owner, and copies of the particles within the halo width of the shared edge or linked to a particle
+// the rank does not own. Copies are simulated as ghosts for that substep and dropped: a contact or link between an
+// owned particle and a ghost only keeps the move of the owned one, the neighbour solves the same pair and keeps the other.
+// Particles and links have global indices and every rank runs the same setup code, keeping what it owns.
+// A link is solved by the ranks holding both its ends, so they must not be more than one slab apart.
+// Sleeping, open boundaries and adaptive substepping would need the ranks to agree and are left off
+class DomainEngine
+{
+private:
+	static constexpr uint32_t noIndex = 0xffffffff;
+
+	DomainTransport& transport;
+	Engine engine; // owned particles first, ghosts after them during a substep
+	int subSteps;
+	float slabLeft;
+	float slabRight;
+	float haloWidth = 0.0f;
+	float maxRadius = 0.0f;
+	float maxRestLength = 0.0f;
+	uint32_t globalCount = 0;
+	uint64_t frameCount = 0;
+	uint32_t reorderInterval = 0;
+	std::vector<uint32_t> globalIds; // of the owned particles
+	std::vector<uint32_t> ghostIds;
+	std::vector<uint32_t> localIndex; // global index -> local one, noIndex when not present
+	// every link of the simulation, between global indices, and the links of each particle as offsets into linkIds
+	std::vector<Link> links;
+	std::vector<uint32_t> linkStart;
+	std::vector<uint32_t> linkIds;
+	bool linksDirty = true;
+	std::vector<uint32_t> localLinks;
+	std::vector<DomainParticle> outgoing[2]; // to the left and right neighbour, migrants first
+	uint32_t outgoingMigrants[2] = {};
+	std::vector<char> sendBuffer[2];
+	std::vector<char> receiveBuffer[2];
+	DomainTimings timings;
+
+	void buildParticleLinks();
+	DomainParticle pack(uint32_t index, uint32_t id) const;
+	// appends particle to the local engine, as the last owned one or as a ghost depending on where it is called
+	void addParticle(const DomainParticle& particle);
+	// sends migrants and halo to the neighbours, adds what they sent and the links between present particles
+	bool exchangeHalo();
+	void dropGhosts();
+	void reorderOwned();
+
+public:
+	DomainEngine(Rect bounds, float stepdt, int subSteps, float cellSize, DomainTransport& transport, uint32_t threadCount = 1);
+	// every rank adds every particle, the one owning its position keeps it; returns the global index
+	uint32_t addObject(const VerletObject& obj);
+	// between global indices, every rank adds every link
+	uint32_t addLink(const Link& link);
+	// one frame, collective like every call that exchanges: false when a neighbour could not be reached
+	bool update();
+	uint64_t getFrameCount() const;
+	uint32_t getRank() const;
+	uint32_t getOwnedCount() const;
+	uint32_t getGlobalObjectCount() const;
+	// global index of owned particle index, between frames the owned particles are those of the local engine
+	uint32_t getGlobalId(uint32_t index) const;
+	// 0, the default, picks twice the largest radius plus the longest rest length, which covers every contact
+	// with a particle or a link across the edge
+	void setHaloWidth(float width);
+	float getHaloWidth() const;
+	void setGravity(Vec2 gravity);
+	// Morton reorder of the owned particles every frames frames, 0 disables it
+	void setReorderInterval(uint32_t frames);
+	// for settings such as the broad phase, threads or narrow phase kernel; its particles and links are rebuilt every
+	// substep and must not be added or removed directly
+	Engine& getEngine();
+	const Engine& getEngine() const;
+	// collective: rank 0 receives the owned particles of every rank sorted by global index, the others nothing
+	bool gatherParticles(std::vector<DomainParticle>& particles);
+	const DomainTimings& getTimings() const;
+	void resetTimings();
+};
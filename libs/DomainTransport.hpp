@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// message passing between the processes of a decomposed simulation, ranks 0 .. getSize()-1.
+// Both sides of a pair call exchange with each other, each call sends one message and receives the one the
+// peer sent, so that neither side depends on the other reading first
+class DomainTransport
+{
+public:
+	virtual ~DomainTransport() = default;
+	virtual uint32_t getRank() const = 0;
+	virtual uint32_t getSize() const = 0;
+	// sends out to peer and replaces in with the message peer sent, false when the peer is gone
+	virtual bool exchange(uint32_t peer, const std::vector<char>& out, std::vector<char>& in) = 0;
+};
+
+// processes of one machine forked from a common parent, every pair connected by a Unix stream socket.
+// Messages are a 64 bit length followed by the payload, sent and received at the same time with poll
+class SocketTransport : public DomainTransport
+{
+private:
+	uint32_t rank;
+	std::vector<int> sockets; // socket to every rank, -1 for this one
+	std::vector<int> children; // process ids of ranks 1.. in rank 0, empty elsewhere
+
+	SocketTransport(uint32_t rank, std::vector<int> sockets, std::vector<int> children);
+
+public:
+	~SocketTransport() override;
+	SocketTransport(const SocketTransport&) = delete;
+	SocketTransport& operator=(const SocketTransport&) = delete;
+	// forks processes - 1 children and returns the transport of the calling process: rank 0 in the parent,
+	// 1 .. processes-1 in the children, which run on from the same point. Call it before starting any thread,
+	// the children only get the calling one. nullptr when the sockets or processes could not be created
+	// or the platform has no fork
+	static std::unique_ptr<SocketTransport> spawn(uint32_t processes);
+	// rank 0 closes its sockets and waits for the other ranks to exit, true when all of them exited with status 0
+	bool waitForPeers();
+	uint32_t getRank() const override;
+	uint32_t getSize() const override;
+	bool exchange(uint32_t peer, const std::vector<char>& out, std::vector<char>& in) override;
+};
@@ -1,286 +1,1200 @@
 #pragma once
 
-#include <SFML/Graphics.hpp>
 #include <cmath>
-#include <unordered_map>
+#include <algorithm>
 #include <iostream>
+#include <chrono>
+#include <limits>
 
+#include "Types.hpp"
 #include "VerletObject.hpp"
+#include "ParticleStore.hpp"
+#include "CollisionGrid.hpp"
+#include "HierarchicalGrid.hpp"
+#include "SpatialHashGrid.hpp"
 #include "Link.hpp"
+#include "LinkBatches.hpp"
+#include "LinkAdjacency.hpp"
+#include "ThreadPool.hpp"
+#include "TaskGraph.hpp"
+#include "NarrowPhase.hpp"
+#include "Integration.hpp"
+#include "SpatialOrder.hpp"
+#include "SleepSystem.hpp"
+#include "Profiler.hpp"
+#include "HandleTable.hpp"
+#include "NeighborList.hpp"
 
-struct CollisionCell
+// accumulated wall-clock seconds spent in each phase of Engine::update, collected only while timing is enabled
+struct EngineTimings
 {
-	static constexpr int capacity = 4;
-	uint32_t objects[capacity] = {};
-	int objCount = 0;
-	void add(uint32_t id)
-	{
-		if(objCount < capacity)
-			objects[objCount++] = id;
-	}
+	double collisions = 0.0;
+	double objectLinkCollisions = 0.0;
+	double linkConstraints = 0.0;
+	double integration = 0.0; // gravity, walls and the Verlet step
+	double sleep = 0.0;
+	double taskGraph = 0.0; // substeps run as a task graph, its phases overlap and are not timed one by one
+	uint64_t substeps = 0;
 };
 
-struct CollisionGrid
+// adaptive substepping: every frame runs as few substeps as keep the metrics of the previous frame under
+// their targets, within [minSubSteps, maxSubSteps]. Disabled, every frame runs the count given to the constructor
+struct SubstepSettings
 {
-	uint32_t width;
-	uint32_t height;
-	int cellSize;
-	std::vector<CollisionCell> cells;
-	void clear()
-	{
-		for(auto& cell : cells)
-			cell.objCount = 0;
-	}
+	bool adaptive = false;
+	int minSubSteps = 1;
+	int maxSubSteps = 8;
+	// targets below where the solver breaks down: particles skipping past each other (displacement of a
+	// radius or more) or piles collapsing into themselves (penetration above about 0.6)
+	float maxDisplacement = 0.5f; // per substep, relative to the particle radius
+	float maxPenetration = 0.5f; // relative to the sum of the radii of the pair
+	float maxLinkStretch = 0.25f; // relative to the rest length, springs are not measured
+	uint32_t framesToRelax = 30; // frames every metric must stay well under its target before dropping a substep
+};
+
+// neighbour (Verlet) lists: contact candidates gathered with a skin margin are replayed by the following
+// substeps and frames until some particle has moved half the skin, instead of rebuilding the grid every substep
+struct NeighborListSettings
+{
+	bool enabled = false;
+	float skin = 1.0f; // world units added to the contact distance, more skin means rarer but larger builds
+};
+
+// what made adaptive substepping pick more than minSubSteps
+enum SubstepReason : uint8_t
+{
+	SUBSTEP_DISPLACEMENT = 1 << 0,
+	SUBSTEP_PENETRATION = 1 << 1,
+	SUBSTEP_LINK_STRETCH = 1 << 2,
+	SUBSTEP_CLAMPED = 1 << 3 // the metrics asked for more than maxSubSteps
+};
+
+// metrics of the last adaptive frame and the substep count they chose for the next one
+struct SubstepStats
+{
+	int subSteps = 0;
+	uint8_t reasons = 0; // SubstepReason flags
+	float displacement = 0.0f;
+	float penetration = 0.0f;
+	float linkStretch = 0.0f;
+};
+
+// sides of the bounds, open sides let particles through and remove them once they have left
+enum BoundarySide : uint8_t
+{
+	BOUNDARY_LEFT = 1 << 0,
+	BOUNDARY_RIGHT = 1 << 1,
+	BOUNDARY_TOP = 1 << 2,
+	BOUNDARY_BOTTOM = 1 << 3,
+	BOUNDARY_ALL = BOUNDARY_LEFT | BOUNDARY_RIGHT | BOUNDARY_TOP | BOUNDARY_BOTTOM
+};
+
+// Grid covers the bounds with dense cells, particles outside of them share the border cells.
+// SpatialHash only stores occupied cells of an unbounded plane, for worlds without walls or far larger than the bounds
+enum class BroadPhaseType : uint8_t
+{
+	Grid,
+	SpatialHash
+};
+
+// closest thing a ray met: a particle, or a link when particle is Engine::noObject
+struct RayHit
+{
+	float distance = 0.0f; // along the normalized direction
+	Vec2 point;
+	Vec2 normal; // unit, facing back along the ray
+	uint32_t particle = 0xffffffff;
+	uint32_t link = 0xffffffff;
 };
 
 class Engine
 {
+	friend class Checkpoint;
 private:
-	std::vector<VerletObject> objects;
+	// split of the grid in column stripes at least 2 cells wide: stripes of the same parity never touch
+	// the same cells, so all even stripes are solved in parallel first and then all odd stripes.
+	// Contacts across levels reach one cell of the coarser level away, so the stripes are cut on the
+	// coarsest level in use and each covers the matching columns of every finer level. Contacts reaching
+	// further need wider stripes, at least twice their reach
+	struct StripeLayout
+	{
+		uint32_t originX = 0;
+		uint32_t width = 0; // columns of the coarsest level per stripe, 0 for a single stripe over all of every level
+		uint32_t count = 1;
+		uint32_t topLevel = 0;
+	};
+
+	ParticleStore particles;
+	HandleTable<ParticleTag> particleHandles;
 	std::vector<Link> links;
-	sf::Vector2f gravity = {0.0f, 980.f};
-	sf::FloatRect bounds; // window boundaries
+	HandleTable<LinkTag> linkHandles;
+	LinkAdjacency linkAdjacency;
+	LinkBatches linkBatches;
+	bool linkBatchesDirty = true;
+	static constexpr uint32_t linkChunkSize = 2048;
+	Vec2 gravity = {0.0f, 980.f};
+	Rect bounds; // window boundaries
+	uint8_t walls = BOUNDARY_ALL; // BoundarySide flags of the sides that push particles back
+	uint8_t openBoundaries = 0; // BoundarySide flags
+	uint64_t removalCount = 0;
 	const float stepdt;
-	const int subSteps;
-	CollisionGrid grid;
+	const int baseSubSteps; // count given to the constructor, used while substepping is not adaptive
+	int subSteps;
+	SubstepSettings substepSettings;
+	SubstepStats substepStats;
+	float framePenetration = 0.0f; // deepest relative overlap the narrow phase met this frame
+	uint32_t relaxedFrames = 0;
+	std::vector<float> stripePenetration;
+	NeighborListSettings neighborSettings;
+	NeighborList neighborList;
+	StripeLayout neighborLayout; // stripes the neighbour list was built for
+	TaskGraph taskGraph;
+	bool taskGraphEnabled = true;
+	uint32_t taskGraphStripes = 0; // shape the task graph was built for
+	bool taskGraphFinish = false;
+	bool gridCurrent = false; // the grid of the broad phase in use was built this frame
+	bool queryGridCurrent = false; // the grids hold the current particles and links, for the spatial queries
+	Vec2 queryMin; // box around every particle, radius included, as of the last query build
+	Vec2 queryMax;
+	BroadPhaseType broadPhase = BroadPhaseType::Grid;
+	HierarchicalGrid grid; // one level per power-of-two particle size, the finest has the cell size given by the user
+	SparseHierarchicalGrid sparseGrid; // same levels over the occupied cells only, used by BroadPhaseType::SpatialHash
+	CollisionGrid linkGrid; // links rasterized over the cells they can touch
+	SpatialHashGrid linkHash;
+	std::vector<CellRange> linkRanges;
+	// links whose box covers more than maxLinkCells cells, or that would take the link grid past
+	// maxLinkInsertions cells in total, stay out of the link grids and are tested against every particle
+	// instead: the sparse plane has no edge to clip a long link to
+	static constexpr uint64_t maxLinkCells = 1024;
+	static constexpr uint64_t maxLinkInsertions = 1u << 30;
+	std::vector<uint32_t> longLinks;
+	ThreadPool threadPool;
+	NarrowPhaseKernelType narrowPhaseType;
+	NarrowPhaseKernel narrowPhaseKernel; // instantiation of narrowPhaseType for the features of the current frame
+	uint64_t frameCount = 0;
+	uint32_t reorderInterval = 0; // frames between two Morton reorders, 0 disables reordering
+	uint64_t reorderCount = 0;
+	MortonSorter mortonSorter;
+	std::vector<uint32_t> reorderOrder;
+	std::vector<uint32_t> reorderMap;
+	bool sleepEnabled = false;
+	SleepSystem sleepSystem;
+	bool timingEnabled = false;
+	EngineTimings timings;
 
-	void applyGravity()
+	template<typename Phase>
+	void runPhase(const char* name, double& time, Phase phase)
 	{
-		for (auto& obj : objects)
-			if(!obj.isFixed())
-				obj.accelerate(gravity);
+		PHYSENG_PROFILE_SCOPE(name);
+		if(!timingEnabled)
+		{
+			phase();
+			return;
+		}
+		const auto start = std::chrono::steady_clock::now();
+		phase();
+		time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 	}
 
-	void updatePositions(float dt)
+	// the solver loops below are instantiated for the features the scene uses: Immovable when fixed or sleeping
+	// particles exist, Sleeping when some are asleep. update() picks the instantiation once per frame
+	template<bool Immovable, bool Sleeping>
+	void solveSubstep(float dt)
 	{
-		for (auto& obj : objects)
-			obj.updatePosition(dt);
+		PHYSENG_PROFILE_SCOPE("substep");
+		if(broadPhase == BroadPhaseType::SpatialHash)
+			solveSubstep<Immovable, Sleeping>(dt, sparseGrid, linkHash);
+		else
+			solveSubstep<Immovable, Sleeping>(dt, grid, linkGrid);
 	}
 
-	void solveBoundaryConstraints()
+	template<bool Immovable, bool Sleeping, typename Grid, typename LinkGrid>
+	void solveSubstep(float dt, Grid& levels, LinkGrid& linkLevels)
 	{
-		for (auto& obj : objects)
-			obj.checkBoundaries(bounds);
+		// with several threads the collisions run as one task graph, and the integration too when there are no links
+		const bool tasks = taskGraphEnabled && threadPool.getThreadCount() > 1 && !neighborSettings.enabled;
+		if(tasks)
+			runPhase("task graph", timings.taskGraph, [&]{ solveTaskGraph<Immovable, Sleeping>(levels, dt, links.empty()); });
+		else
+			runPhase("collisions", timings.collisions, [&]{ solveCollisions<Sleeping>(levels); });
+		if(tasks && links.empty())
+			return;
+		runPhase("object-link collisions", timings.objectLinkCollisions, [&]{ solveObjectLinkCollisions(linkLevels); });
+		runPhase("link constraints", timings.linkConstraints, [&]{ solveLinkConstraints<Immovable>(); });
+		runPhase("integration", timings.integration, [&]{ integrateParticles<Immovable, Sleeping>(particles, 0, particles.size(), getBoundaryLimits(), gravity, dt * dt); });
+	}
+
+	// collisions and, with finish set, integration of one substep as a task graph:
+	// an odd stripe only waits for the even stripes on both sides of it, and the particles of a stripe are
+	// integrated as soon as the collisions of that stripe and of its neighbours are done, instead of every
+	// phase waiting for the slowest stripe of the one before. The stripes and their order are those of the
+	// phases, and so is the result
+	template<bool Immovable, bool Sleeping, typename Grid>
+	void solveTaskGraph(Grid& levels, float dt, bool finish)
+	{
+		populateGrid(levels);
+		const StripeLayout layout = getStripeLayout(levels);
+		const uint32_t stripes = layout.count;
+		// tasks: the collisions of every stripe, then the integration of every stripe
+		const uint32_t collisionTask = 0;
+		const uint32_t finishTask = stripes;
+		if(taskGraphStripes != stripes || taskGraphFinish != finish || taskGraph.getTaskCount() != finishTask + (finish ? stripes : 0))
+		{
+			taskGraph.reset(finishTask + (finish ? stripes : 0));
+			for(uint32_t s = 1; s < stripes; s += 2)
+			{
+				taskGraph.addDependency(collisionTask + s - 1, collisionTask + s);
+				if(s + 1 < stripes)
+					taskGraph.addDependency(collisionTask + s + 1, collisionTask + s);
+			}
+			for(uint32_t s = 0; finish && s < stripes; s++)
+			{
+				for(uint32_t n = s > 0 ? s - 1 : 0; n <= s + 1 && n < stripes; n++)
+					taskGraph.addDependency(collisionTask + n, finishTask + s);
+			}
+			taskGraphStripes = stripes;
+			taskGraphFinish = finish;
+		}
+
+		const BoundaryLimits limits = getBoundaryLimits();
+		const float dtSqr = dt * dt;
+		stripePenetration.assign(stripes, 0.0f);
+		taskGraph.run(threadPool, [&](uint32_t task)
+		{
+			if(task < finishTask)
+				stripePenetration[task - collisionTask] = solveStripeCollisions<Sleeping>(levels, layout, task - collisionTask);
+			else
+				finishStripe<Immovable, Sleeping>(levels, layout, task - finishTask, limits, dtSqr);
+		});
+		for(float penetration : stripePenetration)
+			framePenetration = std::max(framePenetration, penetration);
+	}
+
+	// integration of the particles in the cells of stripe, every level
+	template<bool Immovable, bool Sleeping, typename Grid>
+	void finishStripe(const Grid& levels, const StripeLayout& layout, uint32_t stripe, const BoundaryLimits& limits, float dtSqr)
+	{
+		PHYSENG_PROFILE_SCOPE("finish stripe");
+		for(uint32_t level = 0; level <= layout.topLevel; level++)
+		{
+			if(levels.isLevelEmpty(level))
+				continue;
+			const auto& levelGrid = levels.levels[level];
+			uint32_t startX, endX;
+			getStripeColumns(levels, layout, stripe, level, startX, endX);
+			levelGrid.forEachCellInColumns(startX, endX, [&](uint32_t, uint32_t, uint32_t cellIndex)
+			{
+				const uint32_t* cellObjects = levelGrid.getObjects(cellIndex);
+				const uint32_t cellObjCount = levelGrid.getObjectCount(cellIndex);
+				integrateParticleList<Immovable, Sleeping>(particles, cellObjects, cellObjCount, limits, gravity, dtSqr);
+			});
+		}
+	}
+
+	BoundaryLimits getBoundaryLimits() const
+	{
+		// open sides and sides without a wall never push back
+		const uint8_t closed = walls & ~openBoundaries;
+		const float infinity = std::numeric_limits<float>::infinity();
+		BoundaryLimits limits;
+		limits.left = (closed & BOUNDARY_LEFT) ? bounds.left : -infinity;
+		limits.top = (closed & BOUNDARY_TOP) ? bounds.top : -infinity;
+		limits.right = (closed & BOUNDARY_RIGHT) ? bounds.left + bounds.width : infinity;
+		limits.bottom = (closed & BOUNDARY_BOTTOM) ? bounds.top + bounds.height : infinity;
+		return limits;
 	}
 
 	void solveCollisionsNaive()
 	{
 		const float responseCoef = 1.0f; // to adjust collision elasticity
+		const uint32_t count = particles.size();
 		// iterate on all objects
-		for(int i = 0; i < objects.size(); i++)
+		for(uint32_t i = 0; i < count; i++)
 		{
-			VerletObject& obj1 = objects[i];
 			// iterate on object involved in new collision pairs
-			for(int j = i+1; j < objects.size(); j++)
+			for(uint32_t j = i+1; j < count; j++)
 			{
-				VerletObject& obj2 = objects[j];
-				const sf::Vector2f distVec = obj1.getPosition() - obj2.getPosition();
-				const float distSqr = distVec.x * distVec.x + distVec.y * distVec.y;
-				const float min_dist = obj1.getRadius() + obj2.getRadius();
+				const float distX = particles.x[i] - particles.x[j];
+				const float distY = particles.y[i] - particles.y[j];
+				const float distSqr = distX * distX + distY * distY;
+				const float min_dist = particles.radius[i] + particles.radius[j];
 				// check overlap
 				if(distSqr < min_dist * min_dist)
 				{
 					const float dist = sqrt(distSqr);
-					const sf::Vector2f distVecNor = distVec / dist;
-					const float massRatio1 = obj1.getRadius() / (obj1.getRadius() + obj2.getRadius());
-					const float massRatio2 = obj2.getRadius() / (obj1.getRadius() + obj2.getRadius());
+					const float norX = distX / dist;
+					const float norY = distY / dist;
+					const float massRatio1 = particles.radius[i] / min_dist;
+					const float massRatio2 = particles.radius[j] / min_dist;
 					const float delta = 0.5f * responseCoef * (dist - min_dist);
 					// update positions, moving each obj by half of the overlapping segment in opposite directions
-					obj1.setPosition(obj1.getPosition() - distVecNor * (massRatio2 * delta));
-					obj2.setPosition(obj2.getPosition() + distVecNor * (massRatio1 * delta));
+					particles.x[i] -= norX * (massRatio2 * delta);
+					particles.y[i] -= norY * (massRatio2 * delta);
+					particles.x[j] += norX * (massRatio1 * delta);
+					particles.y[j] += norY * (massRatio1 * delta);
 				}
 			}
 		}
 	}
 
 
-	void solveCollisions()
+	// reach: cells of the coarsest level between two particles a contact may join
+	template<typename Grid>
+	StripeLayout getStripeLayout(const Grid& levels, uint32_t reach = 1) const
+	{
+		StripeLayout layout;
+		layout.topLevel = levels.levelCount - 1;
+		const uint32_t threadCount = threadPool.getThreadCount();
+		if(threadCount == 1)
+			return layout;
+		// columns of the coarsest level over the occupied cells of every level, a sparse coarsest level
+		// may only cover a few of them
+		uint32_t minX = 0xffffffff;
+		uint32_t maxX = 0;
+		for(uint32_t level = 0; level <= layout.topLevel; level++)
+		{
+			if(levels.isLevelEmpty(level))
+				continue;
+			const CellRange levelBounds = levels.levels[level].getBounds();
+			minX = std::min(minX, levelBounds.minX >> (layout.topLevel - level));
+			maxX = std::max(maxX, levelBounds.maxX >> (layout.topLevel - level));
+		}
+		if(minX > maxX)
+			return layout;
+		const uint32_t topWidth = maxX + 1 - minX;
+		layout.originX = minX;
+		layout.width = std::max(2 * reach, (topWidth + 2 * threadCount - 1) / (2 * threadCount));
+		layout.count = (topWidth + layout.width - 1) / layout.width;
+		return layout;
+	}
+
+	// columns [startX, endX) of level covered by stripe
+	template<typename Grid>
+	void getStripeColumns(const Grid& levels, const StripeLayout& layout, uint32_t stripe, uint32_t level, uint32_t& startX, uint32_t& endX) const
 	{
-		populateGrid();
-		for(uint32_t cellIndex = 0; cellIndex < grid.width*grid.height; cellIndex++)
+		if(layout.width == 0)
 		{
-			if(grid.cells[cellIndex].objCount > 0)
+			const CellRange levelBounds = levels.levels[level].getBounds();
+			startX = levelBounds.minX;
+			endX = levelBounds.maxX + 1;
+			return;
+		}
+		const uint32_t shift = layout.topLevel - level;
+		startX = (layout.originX + stripe * layout.width) << shift;
+		endX = (layout.originX + (stripe + 1) * layout.width) << shift;
+	}
+
+	// runs solveStripe(stripe) for every stripe of layout in the two parity phases, solveStripe returns
+	// the deepest relative overlap it met
+	template<typename StripeSolver>
+	void solveStripes(const StripeLayout& layout, StripeSolver solveStripe)
+	{
+		if(layout.width == 0)
+		{
+			framePenetration = std::max(framePenetration, solveStripe(0u));
+			return;
+		}
+		// every stripe keeps its own deepest overlap, merged once both phases are done
+		stripePenetration.assign(layout.count, 0.0f);
+		for(uint32_t phase = 0; phase < 2; phase++)
+		{
+			threadPool.dispatch((layout.count + 1 - phase) / 2, [this, phase, &solveStripe](uint32_t task)
+			{
+				const uint32_t stripe = 2 * task + phase;
+				stripePenetration[stripe] = solveStripe(stripe);
+			});
+		}
+		for(float penetration : stripePenetration)
+			framePenetration = std::max(framePenetration, penetration);
+	}
+
+	// Grid is the HierarchicalGrid or the SparseHierarchicalGrid, both expose their cells by coordinates
+	template<bool Sleeping, typename Grid>
+	void solveCollisions(Grid& levels)
+	{
+		if(neighborSettings.enabled)
+		{
+			solveNeighborCollisions<Sleeping>(levels);
+			return;
+		}
+		populateGrid(levels);
+		const StripeLayout layout = getStripeLayout(levels);
+		solveStripes(layout, [this, &levels, &layout](uint32_t stripe)
+		{
+			return solveStripeCollisions<Sleeping>(levels, layout, stripe);
+		});
+	}
+
+	// every level of stripe, returns the deepest relative overlap met
+	template<bool Sleeping, typename Grid>
+	float solveStripeCollisions(const Grid& levels, const StripeLayout& layout, uint32_t stripe)
+	{
+		float penetration = 0.0f;
+		for(uint32_t level = 0; level <= layout.topLevel; level++)
+		{
+			if(levels.isLevelEmpty(level))
+				continue;
+			uint32_t startX, endX;
+			getStripeColumns(levels, layout, stripe, level, startX, endX);
+			penetration = std::max(penetration, solveCollisionStripe<Sleeping>(levels, level, startX, endX));
+		}
+		return penetration;
+	}
+
+	// same contacts as solveCollisions, replayed from the neighbour list while it is exact
+	template<bool Sleeping, typename Grid>
+	void solveNeighborCollisions(Grid& levels)
+	{
+		if(neighborList.needsRebuild(particles, neighborSettings.skin))
+			buildNeighborList(levels);
+		solveStripes(neighborLayout, [this](uint32_t stripe)
+		{
+			PHYSENG_PROFILE_SCOPE("neighbor stripe");
+			float penetration = 0.0f;
+			const uint32_t end = neighborList.stripeStart[stripe + 1];
+			for(uint32_t e = neighborList.stripeStart[stripe]; e < end; e++)
+			{
+				const uint32_t i = neighborList.entryParticle[e];
+				const uint32_t* candidates = neighborList.neighbors.data() + neighborList.entryStart[e];
+				const uint32_t candidateCount = neighborList.entryStart[e + 1] - neighborList.entryStart[e];
+				if(neighborList.entryFiner[e])
+				{
+					penetration = std::max(penetration, narrowPhaseKernel(particles, i, candidates, candidateCount));
+					narrowPhaseKernel(particles, i, candidates, candidateCount);
+					PHYSENG_PROFILE_COUNT(PairTests, 2 * candidateCount);
+				}
+				else if(!Sleeping || !particles.isSleeping(i))
+				{
+					penetration = std::max(penetration, narrowPhaseKernel(particles, i, candidates, candidateCount));
+					PHYSENG_PROFILE_COUNT(PairTests, candidateCount);
+				}
+			}
+			return penetration;
+		});
+	}
+
+	// gathers the candidates of every particle the way solveCollisions does and keeps the close ones.
+	// Pairs up to the skin apart may be further than the 3x3 block, so each particle gathers the cells
+	// within its own reach: its radius plus the skin plus the largest radius of its level. The last level of
+	// the hierarchy also holds every particle too large for it
+	template<typename Grid>
+	void buildNeighborList(Grid& levels)
+	{
+		PHYSENG_PROFILE_SCOPE("neighbor list");
+		populateGrid(levels);
+		const float skin = neighborSettings.skin;
+		const float topCellSize = static_cast<float>(levels.levels[levels.levelCount - 1].cellSize);
+		neighborLayout = getStripeLayout(levels, 1 + static_cast<uint32_t>(std::ceil(skin / topCellSize)));
+		neighborList.begin(particles, skin);
+		float maxRadius = 0.0f;
+		for(float radius : particles.radius)
+			maxRadius = std::max(maxRadius, radius);
+		for(uint32_t stripe = 0; stripe < neighborLayout.count; stripe++)
+		{
+			for(uint32_t level = 0; level <= neighborLayout.topLevel; level++)
 			{
-				CollisionCell& cell = grid.cells[cellIndex];
-				// check collisions with neighboring cells and current cell itself
-				std::vector<uint32_t> neighbors = getNeighboringCells(cellIndex);
-				for(uint32_t neighborIndex : neighbors)
+				if(levels.isLevelEmpty(level))
+					continue;
+				const auto& levelGrid = levels.levels[level];
+				const bool lastLevel = level + 1 == levels.levels.size();
+				const float levelRadius = lastLevel ? std::max(maxRadius, 0.5f * levelGrid.cellSize) : 0.5f * levelGrid.cellSize;
+				uint32_t startX, endX;
+				getStripeColumns(levels, neighborLayout, stripe, level, startX, endX);
+				levelGrid.forEachCellInColumns(startX, endX, [&](uint32_t, uint32_t, uint32_t cellIndex)
 				{
-					if(grid.cells[neighborIndex].objCount > 0)
+					const uint32_t cellObjCount = levelGrid.getObjectCount(cellIndex);
+					const uint32_t* cellObjects = levelGrid.getObjects(cellIndex);
+					for(uint32_t k = 0; k < cellObjCount; k++)
 					{
-						CollisionCell& neighborCell = grid.cells[neighborIndex];
-						for(int i = 0; i < cell.objCount; i++)
+						const uint32_t i = cellObjects[k];
+						const float x = particles.x[i];
+						const float y = particles.y[i];
+						if(level > 0)
 						{
-							VerletObject& obj1 = objects[cell.objects[i]];
-							for (int j = 0; j < neighborCell.objCount; j++)
+							levels.forEachFinerCell(level, x, y, particles.radius[i] + skin, [&](const uint32_t* objects, uint32_t objCount)
 							{
-								VerletObject& obj2 = objects[neighborCell.objects[j]];
-								solveCollision(obj1, obj2);
-							}
+								neighborList.addCandidates(particles, i, objects, objCount);
+							});
+							neighborList.endEntry(i, true);
 						}
+						const float reach = particles.radius[i] + skin + levelRadius;
+						levelGrid.forEachCell(levelGrid.getCellRange(x - reach, y - reach, x + reach, y + reach),
+								[&](const uint32_t* objects, uint32_t objCount)
+						{
+							neighborList.addCandidates(particles, i, objects, objCount);
+						});
+						neighborList.endEntry(i, false);
 					}
-				}
+				});
 			}
+			neighborList.endStripe();
 		}
+		neighborList.end();
 	}
 
-	void solveCollision(VerletObject& obj1, VerletObject& obj2)
+	// solves the cells of columns [startX, endX) of level, returns the deepest relative overlap met in the stripe
+	template<bool Sleeping, typename Grid>
+	float solveCollisionStripe(const Grid& levels, uint32_t level, uint32_t startX, uint32_t endX)
 	{
-		const float responseCoef = (obj1.getRigidness()+obj2.getRigidness()) / 2;
-		const float eps = 0.0001f;
-	    const sf::Vector2f distVec = obj1.getPosition() - obj2.getPosition();
-	    const float distSqr = distVec.x * distVec.x + distVec.y * distVec.y;
-	    const float minDist = obj1.getRadius() + obj2.getRadius();
-	    if(distSqr < minDist * minDist && distSqr > eps)
-	    {
-	        const float dist = sqrt(distSqr);
-	        const sf::Vector2f distVecNor = distVec / dist;
-	        const float massRatio1 = obj1.getRadius() / (obj1.getRadius() + obj2.getRadius());
-	        const float massRatio2 = obj2.getRadius() / (obj1.getRadius() + obj2.getRadius());
-	        const float delta = 0.5f * responseCoef * (dist - minDist);
-	        if (obj1.isFixed() && !obj2.isFixed())
-			{
-				obj2.setPosition(obj2.getPosition() + distVecNor * delta);
-			}
-			else if (!obj1.isFixed() && obj2.isFixed())
-			{
-				obj1.setPosition(obj1.getPosition() - distVecNor * delta);
-			}
-			else if (!obj1.isFixed() && !obj2.isFixed())
-			{
-				obj1.setPosition(obj1.getPosition() - distVecNor * (massRatio2 * delta));
-				obj2.setPosition(obj2.getPosition() + distVecNor * (massRatio1 * delta));
-			}
-	    }
+		PHYSENG_PROFILE_SCOPE("collision stripe");
+		// candidate buffer reused by every cell solved on this thread
+		thread_local std::vector<uint32_t> candidates;
+		float penetration = 0.0f;
+		levels.levels[level].forEachCellInColumns(startX, endX, [&](uint32_t x, uint32_t y, uint32_t cellIndex)
+		{
+			solveCell<Sleeping>(levels, level, x, y, cellIndex, candidates, penetration);
+		});
+		return penetration;
 	}
 
-	void populateGrid()
+	template<bool Sleeping, typename Grid>
+	void solveCell(const Grid& levels, uint32_t level, uint32_t cellX, uint32_t cellY, uint32_t cellIndex,
+			std::vector<uint32_t>& candidates, float& penetration)
 	{
-		grid.clear();
-		uint32_t i = 0;
-		for(VerletObject& obj : objects)
+		const auto& levelGrid = levels.levels[level];
+		const uint32_t cellObjCount = levelGrid.getObjectCount(cellIndex);
+		const uint32_t* cellObjects = levelGrid.getObjects(cellIndex);
+		if(level > 0)
+			solveFinerContacts(levels, level, cellObjects, cellObjCount, candidates, penetration);
+		// pairs between sleeping particles are skipped, pairs with an awake one are solved from the awake side
+		uint32_t awakeCount = cellObjCount;
+		if(Sleeping)
 		{
-			int cellIndex = getCellIndex(obj.getPosition());
-			grid.cells[cellIndex].add(i);
-			i++;
+			awakeCount = 0;
+			for(uint32_t i = 0; i < cellObjCount; i++)
+				awakeCount += !particles.isSleeping(cellObjects[i]);
 		}
+		if(awakeCount == 0)
+			return;
+		// gather the objects of the neighboring cells and of the current cell itself
+		candidates.clear();
+		levelGrid.forEachCellAround(cellX, cellY, cellIndex, [&](const uint32_t* objects, uint32_t objCount)
+		{
+			candidates.insert(candidates.end(), objects, objects + objCount);
+		});
+		// test every object of the cell against all candidates at once
+		for(uint32_t i = 0; i < cellObjCount; i++)
+			if(!Sleeping || !particles.isSleeping(cellObjects[i]))
+				penetration = std::max(penetration, narrowPhaseKernel(particles, cellObjects[i], candidates.data(), candidates.size()));
+		PHYSENG_PROFILE_COUNT(PairTests, awakeCount * candidates.size());
 	}
 
-	int getCellIndex(const sf::Vector2f& position)
+	// contacts with the particles of finer levels are only gathered from the coarser side, over the actual reach
+	// of each particle. Same-level pairs are met from both of their cells, so the kernel runs twice here to solve
+	// these as often. A sleeping particle runs it as well: the kernel keeps it in place and pushes awake candidates
+	template<typename Grid>
+	void solveFinerContacts(const Grid& levels, uint32_t level, const uint32_t* cellObjects, uint32_t cellObjCount,
+			std::vector<uint32_t>& candidates, float& penetration)
 	{
-		int x = static_cast<int>(position.x) / grid.cellSize;
-		int y = static_cast<int>(position.y) / grid.cellSize;
-		return x + y * grid.width;
+		for(uint32_t k = 0; k < cellObjCount; k++)
+		{
+			const uint32_t i = cellObjects[k];
+			candidates.clear();
+			levels.forEachFinerCell(level, particles.x[i], particles.y[i], particles.radius[i], [&](const uint32_t* objects, uint32_t objCount)
+			{
+				candidates.insert(candidates.end(), objects, objects + objCount);
+			});
+			if(candidates.empty())
+				continue;
+			penetration = std::max(penetration, narrowPhaseKernel(particles, i, candidates.data(), candidates.size()));
+			narrowPhaseKernel(particles, i, candidates.data(), candidates.size());
+			PHYSENG_PROFILE_COUNT(PairTests, 2 * candidates.size());
+		}
 	}
 
-	std::vector<uint32_t> getNeighboringCells(uint32_t cellIndex)
+	template<typename Grid>
+	void populateGrid(Grid& levels)
 	{
-	    std::vector<uint32_t> neighbors;
-	    uint32_t x = cellIndex % grid.width;
-	    uint32_t y = cellIndex / grid.width;
-	    for(int dx = -1; dx <= 1; ++dx)
-	    {
-	        for(int dy = -1; dy <= 1; ++dy)
-	        {
-				if(x + dx >= 0 && x + dx < grid.width && y + dy >= 0 && y + dy < grid.height)
-					neighbors.push_back((x + dx) + (y + dy) * grid.width);
-	        }
-	    }
-	    return neighbors;
+		gridCurrent = true;
+		levels.build(particles.x.data(), particles.y.data(), particles.radius.data(), particles.size());
+		for(uint32_t level = 0; level < levels.levelCount; level++)
+			if(!levels.isLevelEmpty(level))
+				PHYSENG_PROFILE_GRID(levels.levels[level]);
 	}
 
+	template<bool Immovable>
 	void solveLinkConstraints()
 	{
-	    for(Link& link : links)
-	    {
-	        VerletObject& obj1 = objects[link.getFirst()];
-	        VerletObject& obj2 = objects[link.getSecond()];
+		if(links.empty())
+			return;
+		// the coloring only depends on the link set, so it is rebuilt just when links are added
+		if(linkBatchesDirty)
+		{
+			linkBatches.build(links, particles.size());
+			linkBatchesDirty = false;
+		}
+		const uint32_t batchCount = linkBatches.getBatchCount();
+		for(uint32_t b = 0; b < batchCount; b++)
+		{
+			const uint32_t begin = linkBatches.batchStart[b];
+			const uint32_t end = linkBatches.batchStart[b + 1];
+			const bool independent = !(linkBatches.serialBatch && b == batchCount - 1);
+			const uint32_t chunkCount = (end - begin + linkChunkSize - 1) / linkChunkSize;
+			if(!independent || chunkCount <= 1 || threadPool.getThreadCount() == 1)
+			{
+				solveLinkRange<Immovable>(begin, end);
+				continue;
+			}
+			// links of one batch share no particle, so its chunks can be solved concurrently
+			threadPool.dispatch(chunkCount, [this, begin, end](uint32_t chunk)
+			{
+				PHYSENG_PROFILE_SCOPE("link chunk");
+				const uint32_t chunkBegin = begin + chunk * linkChunkSize;
+				solveLinkRange<Immovable>(chunkBegin, std::min(end, chunkBegin + linkChunkSize));
+			});
+		}
+	}
 
-	        sf::Vector2f distVec = obj2.getPosition() - obj1.getPosition();
-	        float dist = sqrt(distVec.x * distVec.x + distVec.y * distVec.y);
-	        const sf::Vector2f distVecNor = distVec / dist;
-	        const float delta = 0.5f * (dist - link.getRestLength());
+	template<bool Immovable>
+	void solveLinkRange(uint32_t begin, uint32_t end)
+	{
+		float* x = particles.x.data();
+		float* y = particles.y.data();
+		const uint8_t* flags = particles.flags.data();
+		const uint32_t* first = linkBatches.first.data();
+		const uint32_t* second = linkBatches.second.data();
+		const float* restLength = linkBatches.restLength.data();
+		const float* stiffness = linkBatches.stiffness.data();
+		for(uint32_t k = begin; k < end; k++)
+		{
+			const uint32_t a = first[k];
+			const uint32_t b = second[k];
+			const float distX = x[b] - x[a];
+			const float distY = y[b] - y[a];
+			const float dist = sqrt(distX * distX + distY * distY);
+			// each end moves by half of the stretch, scaled by the spring stiffness
+			const float delta = 0.5f * (dist - restLength[k]) / dist * stiffness[k];
+			const float deltaA = (Immovable && (flags[a] & PARTICLE_IMMOVABLE)) ? 0.0f : delta;
+			const float deltaB = (Immovable && (flags[b] & PARTICLE_IMMOVABLE)) ? 0.0f : delta;
+			x[a] += distX * deltaA;
+			y[a] += distY * deltaA;
+			x[b] -= distX * deltaB;
+			y[b] -= distY * deltaB;
+		}
+	}
 
-	        sf::Vector2f correction = distVecNor * delta;
+	// largest displacement over the last substep relative to the radius, and largest stretch of a rigid link
+	void measureSubstepMetrics(float& displacement, float& linkStretch) const
+	{
+		const uint32_t count = particles.size();
+		float displacementSqr = 0.0f;
+		for(uint32_t i = 0; i < count; i++)
+		{
+			const float dispX = particles.x[i] - particles.prevX[i];
+			const float dispY = particles.y[i] - particles.prevY[i];
+			const float radius = particles.radius[i];
+			displacementSqr = std::max(displacementSqr, (dispX * dispX + dispY * dispY) / (radius * radius));
+		}
+		displacement = std::sqrt(displacementSqr);
+		linkStretch = 0.0f;
+		for(const Link& link : links)
+		{
+			if(link.isSpring() || link.getRestLength() <= 0.0f)
+				continue;
+			const float distX = particles.x[link.getSecond()] - particles.x[link.getFirst()];
+			const float distY = particles.y[link.getSecond()] - particles.y[link.getFirst()];
+			const float dist = std::sqrt(distX * distX + distY * distY);
+			linkStretch = std::max(linkStretch, std::fabs(dist - link.getRestLength()) / link.getRestLength());
+		}
+	}
 
-	        if(link.isSpring())
-	        {
-	            correction *= link.getStiffness(); // The spring force is scaled by stiffness
-	        }
+	// velocities live in the positions as the displacement over one substep, so changing the substep
+	// length rescales them to keep every particle at the same speed
+	void setSubStepCount(int count)
+	{
+		if(count == subSteps)
+			return;
+		const float scale = static_cast<float>(subSteps) / count;
+		const uint32_t particleCount = particles.size();
+		for(uint32_t i = 0; i < particleCount; i++)
+		{
+			particles.prevX[i] = particles.x[i] - (particles.x[i] - particles.prevX[i]) * scale;
+			particles.prevY[i] = particles.y[i] - (particles.y[i] - particles.prevY[i]) * scale;
+		}
+		subSteps = count;
+	}
 
-//	        if (link.isSpring())
-//			{
-//				float springForce = link.getStiffness() * (dist - link.getRestLength());
-//				sf::Vector2f springCorrection = distVecNor * springForce;
-//
-//				// Adding damping to simulate realistic spring behavior
-//				float dampingFactor = 0.1f; // Adjust this value for more/less damping
-//				sf::Vector2f relativeVelocity = (obj2.getPosition() - obj2.getPrevPosition()) - (obj1.getPosition() - obj1.getPrevPosition());
-//				sf::Vector2f dampingForce = relativeVelocity * dampingFactor;
-//
-//				springCorrection -= dampingForce;
-//				correction = springCorrection;
-//			}
-
-	        if(!obj1.isFixed())
-	        	obj1.setPosition(obj1.getPosition() + correction);
-	        if(!obj2.isFixed())
-	        	obj2.setPosition(obj2.getPosition() - correction);
-	    }
+	static constexpr float relaxMargin = 0.9f; // share of its target a metric must stay under to drop a substep
+	void chooseSubSteps();
+
+	void removeEscapedObjects()
+	{
+		// a particle is gone once it lies entirely beyond an open side. Going backwards, the particle
+		// swapped into a removed index has already been tested
+		const float infinity = std::numeric_limits<float>::infinity();
+		const float left = (openBoundaries & BOUNDARY_LEFT) ? bounds.left : -infinity;
+		const float top = (openBoundaries & BOUNDARY_TOP) ? bounds.top : -infinity;
+		const float right = (openBoundaries & BOUNDARY_RIGHT) ? bounds.left + bounds.width : infinity;
+		const float bottom = (openBoundaries & BOUNDARY_BOTTOM) ? bounds.top + bounds.height : infinity;
+		for(uint32_t i = particles.size(); i-- > 0;)
+		{
+			const float x = particles.x[i];
+			const float y = particles.y[i];
+			const float radius = particles.radius[i];
+			if(x + radius < left || x - radius > right || y + radius < top || y - radius > bottom)
+				removeObject(i);
+		}
 	}
 
-	void solveObjectLinkCollisions()
+	template<typename LinkGrid>
+	void populateLinkGrid(LinkGrid& linkGrid)
 	{
-	    for(VerletObject& obj : objects)
+		// a particle can only touch a link if its center lies within maxRadius of the segment,
+		// so each link goes into every cell overlapped by its bounding box grown by maxRadius
+		const float margin = particles.maxRadius;
+		linkRanges.resize(links.size());
+		longLinks.clear();
+		uint64_t insertions = 0;
+		for(uint32_t k = 0; k < links.size(); k++)
+		{
+			const uint32_t first = links[k].getFirst();
+			const uint32_t second = links[k].getSecond();
+			linkRanges[k] = linkGrid.getCellRange(
+					std::min(particles.x[first], particles.x[second]) - margin,
+					std::min(particles.y[first], particles.y[second]) - margin,
+					std::max(particles.x[first], particles.x[second]) + margin,
+					std::max(particles.y[first], particles.y[second]) + margin);
+			const uint64_t cells = getRangeCellCount(linkRanges[k]);
+			if(cells <= maxLinkCells && insertions + cells <= maxLinkInsertions)
+				insertions += cells;
+			else
+			{
+				longLinks.push_back(k);
+				linkRanges[k] = {1, 1, 0, 0};
+			}
+		}
+		linkGrid.build(linkRanges);
+	}
+
+	template<typename LinkGrid>
+	void solveObjectLinkCollisions(LinkGrid& linkGrid)
+	{
+	    if(links.empty())
+	        return;
+	    populateLinkGrid(linkGrid);
+	    const uint32_t count = particles.size();
+	    for(uint32_t i = 0; i < count; i++)
 	    {
-	        for(Link& link : links)
+	        // only the links rasterized in the particle's own cell can reach it
+	        const uint32_t cellIndex = linkGrid.getCellIndex(particles.x[i], particles.y[i]);
+	        if(cellIndex == LinkGrid::noCell)
+	        	continue;
+	        const uint32_t linkCount = linkGrid.getObjectCount(cellIndex);
+	        const uint32_t* cellLinks = linkGrid.getObjects(cellIndex);
+	        PHYSENG_PROFILE_COUNT(LinkCollisionTests, linkCount);
+	        for(uint32_t k = 0; k < linkCount; k++)
 	        {
-	        	if(&obj != &objects[link.getFirst()] && &obj != &objects[link.getSecond()])
-	        		solveObjectLinkCollision(obj, link, objects);
+	        	const Link& link = links[cellLinks[k]];
+	        	if(i != static_cast<uint32_t>(link.getFirst()) && i != static_cast<uint32_t>(link.getSecond()))
+	        		solveObjectLinkCollision(i, link);
 	        }
 	    }
+	    for(uint32_t l : longLinks)
+	    {
+	        const Link& link = links[l];
+	        PHYSENG_PROFILE_COUNT(LinkCollisionTests, count);
+	        for(uint32_t i = 0; i < count; i++)
+	        	if(i != static_cast<uint32_t>(link.getFirst()) && i != static_cast<uint32_t>(link.getSecond()))
+	        		solveObjectLinkCollision(i, link);
+	    }
 	}
 
-	void solveObjectLinkCollision(VerletObject& obj, const Link& link, std::vector<VerletObject>& objects)
+	void solveObjectLinkCollision(uint32_t i, const Link& link)
 	{
-	    const sf::Vector2f& pos1 = objects[link.getFirst()].getPosition();
-	    const sf::Vector2f& pos2 = objects[link.getSecond()].getPosition();
+	    const uint32_t first = link.getFirst();
+	    const uint32_t second = link.getSecond();
+	    const float x1 = particles.x[first];
+	    const float y1 = particles.y[first];
 	    // find the closest point on the segment pos1-pos2 to objPos
-	    sf::Vector2f segment = pos2 - pos1;
-	    float segmentLengthSquared = segment.x * segment.x + segment.y * segment.y;
+	    const float segX = particles.x[second] - x1;
+	    const float segY = particles.y[second] - y1;
+	    const float segmentLengthSquared = segX * segX + segY * segY;
 
-	    float t = std::max(0.f, std::min(1.f, ((obj.getPosition() - pos1).x * segment.x + (obj.getPosition() - pos1).y * segment.y) / segmentLengthSquared));
-	    sf::Vector2f closestPoint = pos1 + t * segment;
+	    const float t = std::max(0.f, std::min(1.f, ((particles.x[i] - x1) * segX + (particles.y[i] - y1) * segY) / segmentLengthSquared));
 	    // move the object away from the closest point on the segment
-	    sf::Vector2f distVec = obj.getPosition() - closestPoint;
-	    float dist = sqrt(distVec.x * distVec.x + distVec.y * distVec.y);
-	    if(dist < obj.getRadius())
+	    const float distX = particles.x[i] - (x1 + t * segX);
+	    const float distY = particles.y[i] - (y1 + t * segY);
+	    const float dist = sqrt(distX * distX + distY * distY);
+	    const float radius = particles.radius[i];
+	    if(dist < radius)
 	    {
-	        sf::Vector2f distVecNor = distVec / dist;
-	        float overlap = obj.getRadius() - dist;
-	        if(!obj.isFixed())
-	        	obj.setPosition(obj.getPosition() + distVecNor * overlap);
+	        // a link sweeping through a sleeping island, or a particle hitting a sleeping link, wakes it
+	        if(particles.isSleeping(i))
+	        	sleepSystem.wake(particles, i);
+	        if(particles.isSleeping(first))
+	        	sleepSystem.wake(particles, first);
+	        if(particles.isSleeping(second))
+	        	sleepSystem.wake(particles, second);
+	        const float norX = distX / dist;
+	        const float norY = distY / dist;
+	        const float overlap = radius - dist;
+	        if(!particles.isImmovable(i))
+	        {
+	        	particles.x[i] += norX * overlap;
+	        	particles.y[i] += norY * overlap;
+	        }
 	        // adjust the link's end objects
-	        if(!objects[link.getFirst()].isFixed())
+	        if(!particles.isImmovable(first))
 	        {
-	            objects[link.getFirst()].setPosition(objects[link.getFirst()].getPosition() - distVecNor * overlap * 0.5f);
+	            particles.x[first] -= norX * overlap * 0.5f;
+	            particles.y[first] -= norY * overlap * 0.5f;
 	        }
-	        if(!objects[link.getSecond()].isFixed())
+	        if(!particles.isImmovable(second))
 	        {
-	            objects[link.getSecond()].setPosition(objects[link.getSecond()].getPosition() - distVecNor * overlap * 0.5f);
+	            particles.x[second] -= norX * overlap * 0.5f;
+	            particles.y[second] -= norY * overlap * 0.5f;
 	        }
 	    }
 	}
 
+	// the grids are only rebuilt for the first query after the particles or links changed
+	template<typename Grid, typename LinkGrid>
+	void prepareQueries(Grid& levels, LinkGrid& linkLevels)
+	{
+		if(queryGridCurrent)
+			return;
+		populateGrid(levels);
+		if(!links.empty())
+			populateLinkGrid(linkLevels);
+		queryMin = {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+		queryMax = {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+		for(uint32_t i = 0; i < particles.size(); i++)
+		{
+			const float radius = particles.radius[i];
+			queryMin.x = std::min(queryMin.x, particles.x[i] - radius);
+			queryMin.y = std::min(queryMin.y, particles.y[i] - radius);
+			queryMax.x = std::max(queryMax.x, particles.x[i] + radius);
+			queryMax.y = std::max(queryMax.y, particles.y[i] + radius);
+		}
+		queryGridCurrent = true;
+	}
+
+	// calls visit(objects, count) for the occupied cells of level overlapping the box, clipped to the cells
+	// the level uses: a sparse level probes every cell of the range, most of a huge box is empty plane.
+	// False when the range already covers every cell that may hold objects
+	template<typename Level, typename Visitor>
+	static bool forEachQueryCell(const Level& level, float minX, float minY, float maxX, float maxY, Visitor visit)
+	{
+		// far enough for any world, close enough for the integer cell coordinates
+		const float limit = 1e9f;
+		CellRange range = level.getCellRange(std::max(minX, -limit), std::max(minY, -limit), std::min(maxX, limit), std::min(maxY, limit));
+		const CellRange bounds = level.getBounds();
+		const bool coversAll = range.minX <= bounds.minX && range.minY <= bounds.minY && range.maxX >= bounds.maxX && range.maxY >= bounds.maxY;
+		range = {std::max(range.minX, bounds.minX), std::max(range.minY, bounds.minY), std::min(range.maxX, bounds.maxX), std::min(range.maxY, bounds.maxY)};
+		if(range.minX <= range.maxX && range.minY <= range.maxY)
+			level.forEachCell(range, visit);
+		return !coversAll;
+	}
+
+	// same over every level in use, the box grown on each level by the largest radius it holds when grow is set.
+	// False when no level has cells left outside of the box
+	template<typename Grid, typename Visitor>
+	bool forEachQueryCell(const Grid& levels, float minX, float minY, float maxX, float maxY, bool grow, Visitor visit) const
+	{
+		bool partial = false;
+		for(uint32_t level = 0; level < levels.levelCount; level++)
+		{
+			if(levels.isLevelEmpty(level))
+				continue;
+			const auto& levelGrid = levels.levels[level];
+			const bool lastLevel = level + 1 == levels.levels.size();
+			const float reach = !grow ? 0.0f : (lastLevel ? std::max(particles.maxRadius, 0.5f * levelGrid.cellSize) : 0.5f * levelGrid.cellSize);
+			partial = forEachQueryCell(levelGrid, minX - reach, minY - reach, maxX + reach, maxY + reach, visit) || partial;
+		}
+		return partial;
+	}
+
+	template<typename Grid>
+	uint32_t gatherInRadius(const Grid& levels, Vec2 center, float radius, uint32_t* out, uint32_t capacity) const
+	{
+		uint32_t found = 0;
+		const float radiusSqr = radius * radius;
+		forEachQueryCell(levels, center.x - radius, center.y - radius, center.x + radius, center.y + radius, false, [&](const uint32_t* objects, uint32_t count)
+		{
+			for(uint32_t k = 0; k < count; k++)
+			{
+				const uint32_t i = objects[k];
+				const float dx = particles.x[i] - center.x;
+				const float dy = particles.y[i] - center.y;
+				if(dx * dx + dy * dy <= radiusSqr)
+				{
+					if(found < capacity)
+						out[found] = i;
+					found++;
+				}
+			}
+		});
+		return found;
+	}
+
+	template<typename Grid>
+	uint32_t gatherInRect(const Grid& levels, const Rect& area, uint32_t* out, uint32_t capacity) const
+	{
+		uint32_t found = 0;
+		const float right = area.left + area.width;
+		const float bottom = area.top + area.height;
+		forEachQueryCell(levels, area.left, area.top, right, bottom, false, [&](const uint32_t* objects, uint32_t count)
+		{
+			for(uint32_t k = 0; k < count; k++)
+			{
+				const uint32_t i = objects[k];
+				const float x = particles.x[i];
+				const float y = particles.y[i];
+				if(x >= area.left && x < right && y >= area.top && y < bottom)
+				{
+					if(found < capacity)
+						out[found] = i;
+					found++;
+				}
+			}
+		});
+		return found;
+	}
+
+	// searches a box around the point that doubles until it holds a particle closer than its half size,
+	// so the cost follows the distance to the nearest particle rather than the size of the world
+	template<typename Grid>
+	uint32_t findNearest(const Grid& levels, Vec2 point, float maxDistance) const
+	{
+		uint32_t nearest = noObject;
+		float nearestSqr = maxDistance * maxDistance;
+		for(float half = static_cast<float>(levels.getBase().cellSize);; half *= 2.0f)
+		{
+			const float reach = std::min(half, maxDistance);
+			const bool partial = forEachQueryCell(levels, point.x - reach, point.y - reach, point.x + reach, point.y + reach, false,
+					[&](const uint32_t* objects, uint32_t count)
+			{
+				for(uint32_t k = 0; k < count; k++)
+				{
+					const uint32_t i = objects[k];
+					const float dx = particles.x[i] - point.x;
+					const float dy = particles.y[i] - point.y;
+					const float distanceSqr = dx * dx + dy * dy;
+					if(distanceSqr < nearestSqr || (distanceSqr == nearestSqr && nearest == noObject))
+					{
+						nearest = i;
+						nearestSqr = distanceSqr;
+					}
+				}
+			});
+			if(!partial || reach >= maxDistance || (nearest != noObject && nearestSqr <= reach * reach))
+				return nearest;
+		}
+	}
+
+	void hitParticle(uint32_t i, Vec2 origin, Vec2 direction, RayHit& hit, bool& found) const
+	{
+		const float mx = origin.x - particles.x[i];
+		const float my = origin.y - particles.y[i];
+		const float radius = particles.radius[i];
+		const float b = mx * direction.x + my * direction.y;
+		const float c = mx * mx + my * my - radius * radius;
+		// starting outside and heading away
+		if(c > 0.0f && b > 0.0f)
+			return;
+		const float discriminant = b * b - c;
+		if(discriminant < 0.0f)
+			return;
+		// a ray starting inside hits at once
+		const float t = std::max(0.0f, -b - std::sqrt(discriminant));
+		if(t > hit.distance || (found && t == hit.distance))
+			return;
+		found = true;
+		hit.distance = t;
+		hit.point = origin + direction * t;
+		hit.particle = i;
+		hit.link = noObject;
+		const float nx = hit.point.x - particles.x[i];
+		const float ny = hit.point.y - particles.y[i];
+		const float length = std::sqrt(nx * nx + ny * ny);
+		hit.normal = length > 0.0f ? Vec2(nx / length, ny / length) : Vec2(-direction.x, -direction.y);
+	}
+
+	void hitLink(uint32_t l, Vec2 origin, Vec2 direction, RayHit& hit, bool& found) const
+	{
+		const uint32_t first = links[l].getFirst();
+		const uint32_t second = links[l].getSecond();
+		const float ex = particles.x[second] - particles.x[first];
+		const float ey = particles.y[second] - particles.y[first];
+		const float denominator = direction.x * ey - direction.y * ex;
+		// parallel links are grazed at most, their end particles are hit instead
+		if(denominator == 0.0f)
+			return;
+		const float wx = particles.x[first] - origin.x;
+		const float wy = particles.y[first] - origin.y;
+		const float t = (wx * ey - wy * ex) / denominator;
+		const float s = (wx * direction.y - wy * direction.x) / denominator;
+		if(t < 0.0f || s < 0.0f || s > 1.0f || t > hit.distance || (found && t == hit.distance))
+			return;
+		found = true;
+		hit.distance = t;
+		hit.point = origin + direction * t;
+		hit.particle = noObject;
+		hit.link = l;
+		const float length = std::sqrt(ex * ex + ey * ey);
+		hit.normal = Vec2(-ey / length, ex / length);
+		if(hit.normal.x * direction.x + hit.normal.y * direction.y > 0.0f)
+			hit.normal = Vec2(ey / length, -ex / length);
+	}
+
+	// walks the ray in pieces of two base cells, testing what the cells around each piece hold. A hit at
+	// distance t lies in the cells of the piece holding t, so the walk ends with the first piece past the closest hit
+	template<typename Grid, typename LinkGrid>
+	bool castRay(const Grid& levels, const LinkGrid& linkLevels, Vec2 origin, Vec2 direction, float maxDistance, RayHit& hit) const
+	{
+		hit = RayHit();
+		const float length = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+		if(!(length > 0.0f) || !(maxDistance >= 0.0f) || particles.size() == 0)
+			return false;
+		direction = direction / length;
+		// only the part of the ray inside the box around every particle can hit anything
+		float enter = 0.0f;
+		float exit = maxDistance;
+		const float start[2] = {origin.x, origin.y};
+		const float step[2] = {direction.x, direction.y};
+		const float low[2] = {queryMin.x, queryMin.y};
+		const float high[2] = {queryMax.x, queryMax.y};
+		for(int axis = 0; axis < 2; axis++)
+		{
+			if(step[axis] == 0.0f)
+			{
+				if(start[axis] < low[axis] || start[axis] > high[axis])
+					return false;
+				continue;
+			}
+			const float t0 = (low[axis] - start[axis]) / step[axis];
+			const float t1 = (high[axis] - start[axis]) / step[axis];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		if(!(enter <= exit))
+			return false;
+
+		bool found = false;
+		hit.distance = exit;
+		for(uint32_t l : longLinks)
+			hitLink(l, origin, direction, hit, found);
+		const float piece = 2.0f * levels.getBase().cellSize;
+		for(uint32_t k = 0;; k++)
+		{
+			const float from = enter + k * piece;
+			const float to = std::min(from + piece, exit);
+			const Vec2 a = origin + direction * from;
+			const Vec2 b = origin + direction * to;
+			const float minX = std::min(a.x, b.x);
+			const float minY = std::min(a.y, b.y);
+			const float maxX = std::max(a.x, b.x);
+			const float maxY = std::max(a.y, b.y);
+			forEachQueryCell(levels, minX, minY, maxX, maxY, true, [&](const uint32_t* objects, uint32_t count)
+			{
+				for(uint32_t k = 0; k < count; k++)
+					hitParticle(objects[k], origin, direction, hit, found);
+			});
+			// links are rasterized over every cell they cross, the cells of the piece itself are enough
+			if(!links.empty())
+				forEachQueryCell(linkLevels, minX, minY, maxX, maxY, [&](const uint32_t* objects, uint32_t count)
+				{
+					for(uint32_t k = 0; k < count; k++)
+						hitLink(objects[k], origin, direction, hit, found);
+				});
+			if((found && hit.distance <= to) || to >= exit)
+				break;
+		}
+		if(!found)
+			hit = RayHit();
+		return found;
+	}
+
 public:
-	Engine(sf::FloatRect bounds, float stepdt, int subSteps, float cellSize);
+	static constexpr uint32_t noObject = 0xffffffff;
+	Engine(Rect bounds, float stepdt, int subSteps, float cellSize, uint32_t threadCount = 1);
 	void update();
-//	void addObject(VerletObject o);
-	std::vector<VerletObject>& getObjects();
-	std::vector<Link>& getLinks();
+	uint64_t getFrameCount() const;
+	uint32_t addObject(const VerletObject& obj);
+	ParticleView getObject(uint32_t index);
+	uint32_t getObjectCount() const;
+	const ParticleStore& getParticles() const;
+	uint32_t addLink(const Link& link);
+	const std::vector<Link>& getLinks() const;
+	// handles stay valid across removals and reorders until their particle or link is removed,
+	// plain indices only until the next removal or reorder
+	ParticleHandle getObjectHandle(uint32_t index) const;
+	const std::vector<ParticleHandle>& getObjectHandles() const;
+	bool isValid(ParticleHandle handle) const;
+	uint32_t getObjectIndex(ParticleHandle handle) const;
+	LinkHandle getLinkHandle(uint32_t index) const;
+	bool isValid(LinkHandle handle) const;
+	uint32_t getLinkIndex(LinkHandle handle) const;
+	// swap-and-pop: the last particle takes the index of the removed one, the removed particle's links go with it.
+	// Costs the links of the two particles involved, not the total number of links
+	void removeObject(uint32_t index);
+	void removeObject(ParticleHandle handle);
+	// swap-and-pop as well, the last link takes the index of the removed one
+	void removeLink(uint32_t index);
+	void removeLink(LinkHandle handle);
+	// incremented by every removal, indices held outside are stale once it changed
+	uint64_t getRemovalCount() const;
+	// BoundarySide flags of the sides that let particles out, particles that left are removed after each step
+	void setOpenBoundaries(uint8_t sides);
+	uint8_t getOpenBoundaries() const;
+	// BoundarySide flags of the sides that keep particles in, BOUNDARY_ALL by default.
+	// Particles pass the other sides and are only removed by open ones
+	void setWalls(uint8_t sides);
+	uint8_t getWalls() const;
 	float getTimeStep();
 	float getTimeSubstep();
-	void setObjectVelocity(VerletObject& object, sf::Vector2f v);
-	const CollisionGrid& getGrid() const;
+	// substeps the next frame runs, changes every frame while substepping is adaptive
+	int getSubStepCount() const;
+	void setSubstepSettings(const SubstepSettings& settings);
+	const SubstepSettings& getSubstepSettings() const;
+	const SubstepStats& getSubstepStats() const;
+	void setNeighborListSettings(const NeighborListSettings& settings);
+	const NeighborListSettings& getNeighborListSettings() const;
+	// neighbour list builds so far, each one also rebuilt the grid
+	uint64_t getNeighborListBuildCount() const;
+	void setObjectVelocity(VerletObject& object, Vec2 v);
+	void setObjectVelocity(uint32_t index, Vec2 v);
+	Vec2 getGravity() const;
+	void setGravity(Vec2 gravity);
+	// switching carries nothing over, the grids are rebuilt every substep
+	void setBroadPhase(BroadPhaseType type);
+	BroadPhaseType getBroadPhase() const;
+	const HierarchicalGrid& getGrid() const;
+	const SparseHierarchicalGrid& getSparseGrid() const;
+	// stats of the grid of the current broad phase
+	const CollisionGridStats& getGridStats() const;
 	void setGridCellSize(float cellSize);
+	uint32_t getThreadCount() const;
+	// with several threads, runs the collisions and integration of each substep as one task graph without
+	// barriers between the phases; same results as the phases, timed as EngineTimings::taskGraph
+	void setTaskGraphEnabled(bool enabled);
+	bool isTaskGraphEnabled() const;
+	void setNarrowPhaseKernel(NarrowPhaseKernelType type);
+	NarrowPhaseKernelType getNarrowPhaseKernel() const;
+	// sorts particles along a Morton curve so that grid neighbours are also neighbours in memory,
+	// links are remapped and getReorderMap() gives old index -> new index for any index held outside
+	void reorderParticles();
+	void setReorderInterval(uint32_t frames);
+	const std::vector<uint32_t>& getReorderMap() const;
+	uint64_t getReorderCount() const;
+	// particles resting for long enough fall asleep island by island and cost nothing until woken
+	void setSleepEnabled(bool enabled);
+	void setSleepSettings(const SleepSettings& settings);
+	uint32_t getSleepingCount() const;
+	void wakeObject(uint32_t index);
+	void wakeAll();
+	void setTimingEnabled(bool enabled);
+	const EngineTimings& getTimings() const;
+	void resetTimings();
+	// spatial queries between steps, answered from the collision grid of the current broad phase and exact
+	// against the current positions. The first query after the particles or links changed rebuilds the grids.
+	// The gathering ones fill out with up to capacity particle indices, in no particular order, and return
+	// how many matched, which may be more than capacity
+	uint32_t queryRadius(Vec2 center, float radius, uint32_t* out, uint32_t capacity);
+	// particle centers inside area, its left and top edges included
+	uint32_t queryRect(const Rect& area, uint32_t* out, uint32_t capacity);
+	// particle whose center is closest to point, noObject when none is within maxDistance
+	uint32_t findNearestObject(Vec2 point, float maxDistance = std::numeric_limits<float>::infinity());
+	// first particle or link along the ray within maxDistance, direction need not be normalized
+	bool rayCast(Vec2 origin, Vec2 direction, float maxDistance, RayHit& hit);
 };
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// stable reference to an element of a HandleTable. It keeps pointing to the same element when others are
+// removed or reordered, and stops resolving once its element is removed, even if the slot is reused
+template<typename Tag>
+struct Handle
+{
+	static constexpr uint32_t nullSlot = 0xffffffff;
+	uint32_t slot = nullSlot;
+	uint32_t generation = 0;
+
+	bool isNull() const
+	{
+		return slot == nullSlot;
+	}
+	bool operator==(const Handle& other) const
+	{
+		return slot == other.slot && generation == other.generation;
+	}
+	bool operator!=(const Handle& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+struct ParticleTag;
+struct LinkTag;
+typedef Handle<ParticleTag> ParticleHandle;
+typedef Handle<LinkTag> LinkHandle;
+
+// maps handles to the dense index of their element and back. The owner keeps its elements packed and
+// mirrors every add, swap-and-pop removal and permutation here; freed slots go to a free list and
+// are reused with a bumped generation, so the slot arrays never grow past the peak element count
+template<typename Tag>
+class HandleTable
+{
+	friend class Checkpoint;
+private:
+	static constexpr uint32_t noSlot = Handle<Tag>::nullSlot;
+	std::vector<Handle<Tag>> handles; // handle of each element, in element order
+	std::vector<uint32_t> slotIndex; // element index of a live slot, next free slot of a free one
+	std::vector<uint32_t> slotGeneration; // generation of the current or next element of each slot
+	uint32_t freeHead = noSlot;
+
+	// rebuilds slotIndex and the free list from handles and slotGeneration
+	void rebuildSlots()
+	{
+		slotIndex.assign(slotGeneration.size(), noSlot);
+		for(uint32_t i = 0; i < handles.size(); i++)
+			slotIndex[handles[i].slot] = i;
+		freeHead = noSlot;
+		for(uint32_t slot = slotIndex.size(); slot-- > 0;)
+		{
+			if(slotIndex[slot] != noSlot)
+				continue;
+			slotIndex[slot] = freeHead;
+			freeHead = slot;
+		}
+	}
+
+public:
+	// registers a new element appended after the last one
+	Handle<Tag> add()
+	{
+		uint32_t slot = freeHead;
+		if(slot != noSlot)
+			freeHead = slotIndex[slot];
+		else
+		{
+			slot = slotIndex.size();
+			slotIndex.push_back(0);
+			slotGeneration.push_back(0);
+		}
+		slotIndex[slot] = handles.size();
+		handles.push_back({slot, slotGeneration[slot]});
+		return handles.back();
+	}
+	// element index was removed and the last element moved into its place
+	void removeSwap(uint32_t index)
+	{
+		const uint32_t slot = handles[index].slot;
+		handles[index] = handles.back();
+		slotIndex[handles[index].slot] = index;
+		handles.pop_back();
+		slotGeneration[slot]++;
+		slotIndex[slot] = freeHead;
+		freeHead = slot;
+	}
+	// elements were permuted so that element order[i] is now at index i
+	void permute(const std::vector<uint32_t>& order)
+	{
+		std::vector<Handle<Tag>> permuted(handles.size());
+		for(uint32_t i = 0; i < order.size(); i++)
+		{
+			permuted[i] = handles[order[i]];
+			slotIndex[permuted[i].slot] = i;
+		}
+		handles.swap(permuted);
+	}
+	// forgets every element and slot, handles given out before no longer mean anything
+	void clear()
+	{
+		handles.clear();
+		slotIndex.clear();
+		slotGeneration.clear();
+		freeHead = noSlot;
+	}
+	bool isValid(Handle<Tag> handle) const
+	{
+		return handle.slot < slotGeneration.size() && slotGeneration[handle.slot] == handle.generation;
+	}
+	// index of the element of a valid handle
+	uint32_t getIndex(Handle<Tag> handle) const
+	{
+		return slotIndex[handle.slot];
+	}
+	Handle<Tag> getHandle(uint32_t index) const
+	{
+		return handles[index];
+	}
+	const std::vector<Handle<Tag>>& getHandles() const
+	{
+		return handles;
+	}
+	uint32_t getSlotCount() const
+	{
+		return slotGeneration.size();
+	}
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "CollisionGrid.hpp"
+#include "SpatialHashGrid.hpp"
+
+// stack of collision grids whose cell size doubles from one level to the next. Every particle is inserted
+// only at the finest level whose cells are at least its diameter, so small particles keep small cells
+// whatever the largest radius in the scene. Cells nest: cell (x, y) of level l covers cells
+// (x << k .. ((x + 1) << k) - 1, same for y) of level l - k.
+// Two particles touching are at most one cell apart on the coarser of their two levels, which is what
+// the queries below rely on. With a single level it is exactly the plain Level grid.
+// Level is CollisionGrid over the world rectangle or SpatialHashGrid over an unbounded plane
+template<typename Level>
+struct BasicHierarchicalGrid
+{
+	static constexpr uint32_t maxLevels = 16;
+	std::vector<Level> levels; // every level the world size allows, the first levelCount are in use
+	uint32_t levelCount = 1;
+	std::vector<uint8_t> objectLevel; // level of each object of the last build
+	std::vector<uint32_t> levelStart; // objects of level l are levelObjects[levelStart[l]] .. levelObjects[levelStart[l+1]-1]
+	std::vector<uint32_t> levelObjects;
+	CollisionGridStats stats; // summed over the levels, maxCellOccupancy is the largest of any level
+
+	void resize(uint32_t width, uint32_t height, int cellSize);
+	// sorts the objects into their levels, then builds every level in use
+	void build(const float* x, const float* y, const float* radius, uint32_t count);
+	uint32_t getLevel(float radius) const;
+	uint32_t getObjectCount() const
+	{
+		return objectLevel.size();
+	}
+	// levels holding no object are not built, their cells must not be read
+	bool isLevelEmpty(uint32_t level) const
+	{
+		return levelStart[level + 1] == levelStart[level];
+	}
+	// the finest level, its geometry is the one given to resize
+	const Level& getBase() const
+	{
+		return levels[0];
+	}
+
+	// calls visit(objects, count) for every cell, of any level in use, holding objects that may touch an
+	// object of cell (cellX, cellY) of level: the 3x3 block around it, the 3x3 block around the cell
+	// containing it on every coarser level and every cell covered by that block on the finer levels
+	template<typename Visitor>
+	void forEachNeighborCell(uint32_t level, uint32_t cellX, uint32_t cellY, Visitor visit) const
+	{
+		for(uint32_t l = 0; l < levelCount; l++)
+		{
+			if(isLevelEmpty(l))
+				continue;
+			CellRange range;
+			if(l >= level)
+			{
+				const uint32_t x = cellX >> (l - level);
+				const uint32_t y = cellY >> (l - level);
+				range = {x > 0 ? x - 1 : 0, y > 0 ? y - 1 : 0, x + 1, y + 1};
+			}
+			else
+			{
+				const uint32_t shift = level - l;
+				range = {cellX > 0 ? (cellX - 1) << shift : 0, cellY > 0 ? (cellY - 1) << shift : 0,
+						((cellX + 2) << shift) - 1, ((cellY + 2) << shift) - 1};
+			}
+			levels[l].forEachCell(range, visit);
+		}
+	}
+
+	// calls visit(objects, count) for every cell of the levels finer than level that may hold a particle
+	// touching the one of the given radius at (x, y), particles of a level being at most half its cell size
+	template<typename Visitor>
+	void forEachFinerCell(uint32_t level, float x, float y, float radius, Visitor visit) const
+	{
+		for(uint32_t l = 0; l < level; l++)
+		{
+			if(isLevelEmpty(l))
+				continue;
+			const Level& grid = levels[l];
+			const float reach = radius + 0.5f * grid.cellSize;
+			grid.forEachCell(grid.getCellRange(x - reach, y - reach, x + reach, y + reach), visit);
+		}
+	}
+};
+
+typedef BasicHierarchicalGrid<CollisionGrid> HierarchicalGrid;
+typedef BasicHierarchicalGrid<SpatialHashGrid> SparseHierarchicalGrid;
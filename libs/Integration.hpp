@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Types.hpp"
+#include "ParticleStore.hpp"
+
+// sides the walls push particles back from, infinitely far on open sides and sides without a wall
+struct BoundaryLimits
+{
+	float left = 0.0f;
+	float top = 0.0f;
+	float right = 0.0f;
+	float bottom = 0.0f;
+};
+
+// end of a substep for particles [begin, end) in one sweep over the particle arrays: the walls push back by
+// half the overlap times rigidness, then the Verlet step adds gravity (not to immovable particles) and the
+// accumulated acceleration, which is reset. Sleeping particles keep their state.
+// Branch free and 4 wide where SSE2 is available, with the same results as one particle at a time
+template<bool Immovable, bool Sleeping>
+void integrateParticles(ParticleStore& particles, uint32_t begin, uint32_t end, const BoundaryLimits& limits, Vec2 gravity, float dtSqr);
+// same for the count particles listed in ids
+template<bool Immovable, bool Sleeping>
+void integrateParticleList(ParticleStore& particles, const uint32_t* ids, uint32_t count, const BoundaryLimits& limits, Vec2 gravity, float dtSqr);
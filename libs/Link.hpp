@@ -1,7 +1,5 @@
 #pragma once
 
-#include <SFML/Graphics.hpp>
-
 class Link
 {
 private:
@@ -13,7 +11,9 @@ private:
 public:
 	Link(int first, int second, float restLength, float stiffness, bool spring);
 	int getFirst() const;
+	void setFirst(int first);
 	int getSecond() const;
+	void setSecond(int second);
 	bool isSpring() const;
 	void setSpring(bool isSpring);
 	float getRestLength() const;
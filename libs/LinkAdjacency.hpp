@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Link.hpp"
+
+// the links attached to every particle, as doubly linked lists threaded through the link ends: end 2l is
+// the first particle of link l and end 2l + 1 its second. Adding or removing a link costs O(1) and
+// renaming or removing a particle O(links it has), whatever the total number of links
+struct LinkAdjacency
+{
+	static constexpr uint32_t noEnd = 0xffffffff;
+	std::vector<uint32_t> head; // first end attached to each particle, noEnd when it has no link
+	std::vector<uint32_t> next; // per end, the following end of the same particle
+	std::vector<uint32_t> prev;
+
+	void build(const std::vector<Link>& links, uint32_t particleCount);
+	void addParticle();
+	// link must be the last of links, already added
+	void addLink(const Link& link);
+	// unlinks link index and gives the last link its ends, call before links itself is swap-and-popped
+	void removeLinkSwap(const std::vector<Link>& links, uint32_t index);
+	// particle i must have no link left, the last particle's links move to it; they still name the last particle
+	void removeParticleSwap(uint32_t i);
+	// moves the links of particle order[i] to i for every i
+	void permute(const std::vector<uint32_t>& order);
+	// calls visit(link, end) for every link attached to particle i, end 0 or 1 telling which of its particles i is.
+	// The visitor may not add or remove links
+	template<typename Visitor>
+	void forEachLink(uint32_t i, Visitor visit) const
+	{
+		for(uint32_t end = head[i]; end != noEnd; end = next[end])
+			visit(end / 2, end % 2);
+	}
+
+private:
+	void insert(uint32_t end, uint32_t particle);
+	void unlink(uint32_t end, uint32_t particle);
+	void move(uint32_t from, uint32_t to, uint32_t particle);
+};
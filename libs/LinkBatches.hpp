@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Link.hpp"
+
+// links regrouped by greedy graph coloring so that no two links of the same batch share a particle,
+// every batch can then be solved in any order and on any number of threads
+struct LinkBatches
+{
+	static constexpr uint32_t maxColors = 64;
+	// structure-of-arrays copy of the links, stored batch after batch
+	std::vector<uint32_t> first;
+	std::vector<uint32_t> second;
+	std::vector<float> restLength;
+	std::vector<float> stiffness; // correction scale, 1 for rigid links
+	// batch b holds links [batchStart[b], batchStart[b+1]), the last batch is not independent
+	// when serialBatch is set: it collects the links of particles with more than maxColors links
+	std::vector<uint32_t> batchStart;
+	bool serialBatch = false;
+
+	void build(const std::vector<Link>& links, uint32_t particleCount);
+	uint32_t getBatchCount() const
+	{
+		return batchStart.empty() ? 0 : batchStart.size() - 1;
+	}
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ParticleStore.hpp"
+
+enum class NarrowPhaseKernelType
+{
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+// resolves the collisions of particle index against candidateCount candidate neighbours,
+// candidates must be distinct, index itself may appear among them and is skipped.
+// Returns the deepest overlap met relative to the sum of the radii of the pair, 0 without contact
+typedef float (*NarrowPhaseKernel)(ParticleStore& particles, uint32_t index, const uint32_t* candidates, uint32_t candidateCount);
+
+// scene features a kernel may assume absent, every combination has its own branch-free instantiation.
+// The defaults handle any scene
+struct NarrowPhasePolicy
+{
+	bool immovable = true; // fixed or sleeping particles exist
+	bool variableRadius = true;
+	bool variableRigidness = true;
+};
+
+// best kernel supported by the running CPU
+NarrowPhaseKernelType detectNarrowPhaseKernel();
+bool isNarrowPhaseKernelSupported(NarrowPhaseKernelType type);
+NarrowPhaseKernel getNarrowPhaseKernel(NarrowPhaseKernelType type, NarrowPhasePolicy policy = NarrowPhasePolicy());
+const char* getNarrowPhaseKernelName(NarrowPhaseKernelType type);
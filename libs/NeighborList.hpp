@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ParticleStore.hpp"
+
+// Verlet list: the candidates of every grid cell, kept only when closer than contact distance plus a skin,
+// gathered once and replayed by the following substeps and frames. It stays exact until some particle has
+// moved half the skin since the build, no pair outside the list can touch before that.
+// Entries keep the order the grid solver visits particles in, grouped by stripe so that the two parity
+// phases of the threaded solver still apply
+struct NeighborList
+{
+	// entry e solves particle entryParticle[e] against neighbors[entryStart[e]] .. neighbors[entryStart[e+1]-1]
+	std::vector<uint32_t> entryParticle;
+	std::vector<uint32_t> entryStart;
+	std::vector<uint8_t> entryFiner; // contacts with finer levels, solved twice and from sleeping particles too
+	std::vector<uint32_t> neighbors; // only the first pairCount are used, the rest is room for the next entries
+	uint32_t pairCount = 0;
+	std::vector<uint32_t> stripeStart; // entries of stripe s are [stripeStart[s], stripeStart[s+1])
+	// positions at the last build
+	std::vector<float> builtX;
+	std::vector<float> builtY;
+	float skin = 0.0f;
+	bool valid = false;
+	uint64_t buildCount = 0;
+
+	// starts a build with the current positions, then entries are added stripe after stripe
+	void begin(const ParticleStore& particles, float skin);
+	// keeps the candidates of particle within contact distance plus skin, called once per visited cell
+	void addCandidates(const ParticleStore& particles, uint32_t particle, const uint32_t* candidates, uint32_t count);
+	// closes the entry of particle opened by the addCandidates calls since the last entry, drops it when empty
+	void endEntry(uint32_t particle, bool finer);
+	void endStripe();
+	void end();
+	// particles were added, removed or permuted, the next substep must rebuild
+	void invalidate()
+	{
+		valid = false;
+	}
+	// true once the list may miss a contact
+	bool needsRebuild(const ParticleStore& particles, float skin) const;
+	uint32_t getStripeCount() const
+	{
+		return stripeStart.size() - 1;
+	}
+	uint32_t getEntryCount() const
+	{
+		return entryParticle.size();
+	}
+	uint32_t getPairCount() const
+	{
+		return pairCount;
+	}
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Types.hpp"
+#include "VerletObject.hpp"
+
+enum ParticleFlags : uint8_t
+{
+	PARTICLE_FIXED = 1 << 0,
+	PARTICLE_SLEEPING = 1 << 1,
+	// solvers never move these, sleeping particles respond to contacts like fixed ones
+	PARTICLE_IMMOVABLE = PARTICLE_FIXED | PARTICLE_SLEEPING
+};
+
+// structure-of-arrays storage of all simulated particles:
+// every hot component lives in its own contiguous array so that each solver pass only streams the data it needs
+struct ParticleStore
+{
+	// hot simulation data
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> prevX;
+	std::vector<float> prevY;
+	std::vector<float> accX;
+	std::vector<float> accY;
+	std::vector<float> radius;
+	std::vector<float> rigidness;
+	std::vector<uint8_t> flags;
+	std::vector<uint16_t> stillFrames; // consecutive frames spent below the sleep motion threshold
+	// cold data
+	std::vector<Color> colors;
+	// scene summary kept up to date by add/clear/setFixed, the solvers specialize their loops on it.
+	// Removals leave the radius and rigidness ranges as they were, loose bounds only select a more general loop
+	float maxRadius = 0.0f;
+	float minRadius = 0.0f;
+	float minRigidness = 0.0f;
+	float maxRigidness = 0.0f;
+	uint32_t fixedCount = 0;
+
+	uint32_t add(const VerletObject& obj);
+	uint32_t size() const;
+	void reserve(uint32_t count);
+	void clear();
+	// moves particle order[i] to index i for every i
+	void permute(const std::vector<uint32_t>& order);
+	// removes particle i by moving the last particle into its place
+	void removeSwap(uint32_t i);
+	// recomputes the summary after the arrays were written directly
+	void refreshSummary();
+	bool hasUniformRadius() const
+	{
+		return minRadius == maxRadius;
+	}
+	bool hasUniformRigidness() const
+	{
+		return minRigidness == maxRigidness;
+	}
+	bool isFixed(uint32_t i) const
+	{
+		return flags[i] & PARTICLE_FIXED;
+	}
+	bool isSleeping(uint32_t i) const
+	{
+		return flags[i] & PARTICLE_SLEEPING;
+	}
+	bool isImmovable(uint32_t i) const
+	{
+		return flags[i] & PARTICLE_IMMOVABLE;
+	}
+};
+
+// lightweight handle to a single particle inside a ParticleStore, mirroring the VerletObject accessors
+class ParticleView
+{
+private:
+	ParticleStore* store;
+	uint32_t index;
+public:
+	ParticleView(ParticleStore& store, uint32_t index);
+	uint32_t getIndex() const;
+	Vec2 getPosition() const;
+	void setPosition(Vec2 position);
+	Vec2 getPrevPosition() const;
+	void setPrevPosition(Vec2 prevPosition);
+	void setVelocity(Vec2 v, float dt);
+	float getRadius() const;
+	float getRigidness() const;
+	bool isFixed() const;
+	void setFixed();
+	Color getColor() const;
+	void setColor(Color color = Color(255, 255, 255));
+};
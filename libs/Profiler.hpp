@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+
+// scoped timers and counters for the simulation, only compiled in when PHYSENG_PROFILING is defined;
+// without it every PHYSENG_PROFILE_* macro expands to nothing and this header declares no code
+#ifdef PHYSENG_PROFILING
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+
+#include "CollisionGrid.hpp"
+#include "SpatialHashGrid.hpp"
+
+enum class ProfileCounter
+{
+	PairTests, // particle pairs handed to the narrow phase
+	Contacts, // pairs that actually overlapped
+	ClampedInsertions, // particles outside the grid area, stored in the nearest border cell
+	LinkCollisionTests, // particle-link pairs tested
+	Count
+};
+
+// grid cells bucketed by how many particles they held: 0, 1, 2, 3, 4, 5-8, 9-16, 17+
+static constexpr uint32_t profileOccupancyBuckets = 8;
+
+struct ProfileEvent
+{
+	const char* name; // string literal, compared by pointer
+	uint64_t start; // nanoseconds since the profiler was created
+	uint64_t duration;
+};
+
+struct ProfileScopeStats
+{
+	std::string name;
+	uint64_t calls = 0;
+	double totalMs = 0.0;
+	double maxMs = 0.0;
+};
+
+struct ProfileStats
+{
+	uint64_t counters[static_cast<int>(ProfileCounter::Count)] = {};
+	uint64_t occupancy[profileOccupancyBuckets] = {};
+	std::vector<ProfileScopeStats> scopes;
+};
+
+// events and counters of one thread, written only by that thread; the ring head is published with
+// release ordering so a reader that runs between frames sees complete events without locking
+struct ProfileThreadBuffer
+{
+	static constexpr uint32_t capacity = 1 << 16;
+	static constexpr uint32_t maxScopes = 32;
+
+	uint32_t id = 0;
+	std::vector<ProfileEvent> ring;
+	std::atomic<uint64_t> head{0};
+	std::atomic<uint64_t> counters[static_cast<int>(ProfileCounter::Count)] = {};
+	std::atomic<uint64_t> occupancy[profileOccupancyBuckets] = {};
+	// running totals per scope name, lets the live stats survive the ring wrapping around
+	const char* scopeNames[maxScopes] = {};
+	std::atomic<uint64_t> scopeCalls[maxScopes] = {};
+	std::atomic<uint64_t> scopeTotal[maxScopes] = {};
+	std::atomic<uint64_t> scopeMax[maxScopes] = {};
+	std::atomic<uint32_t> scopeCount{0};
+
+	void record(const char* name, uint64_t start, uint64_t duration);
+};
+
+class Profiler
+{
+private:
+	std::mutex mutex; // guards thread registration only
+	std::vector<std::unique_ptr<ProfileThreadBuffer>> threads;
+	const std::chrono::steady_clock::time_point origin;
+
+	Profiler();
+
+public:
+	static Profiler& get();
+	// buffer of the calling thread, registered on first use
+	ProfileThreadBuffer& getThreadBuffer();
+	uint64_t now() const;
+
+	void addCount(ProfileCounter counter, uint64_t amount);
+	// a SpatialHashGrid only has occupied cells, it never adds to the empty bucket
+	template<typename Grid>
+	void recordOccupancy(const Grid& grid);
+
+	// totals since the last reset summed over every thread
+	ProfileStats getStats();
+	void reset();
+	// writes the events still held in the ring buffers as Chrome trace JSON (open with Perfetto or chrome://tracing);
+	// call it between frames, e.g. through SimulationThread::post, so no thread is writing meanwhile
+	bool writeChromeTrace(const std::string& path);
+};
+
+class ProfileScope
+{
+private:
+	const char* name;
+	const uint64_t start;
+
+public:
+	explicit ProfileScope(const char* name) : name(name), start(Profiler::get().now()) {}
+	~ProfileScope()
+	{
+		Profiler& profiler = Profiler::get();
+		profiler.getThreadBuffer().record(name, start, profiler.now() - start);
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#define PHYSENG_PROFILE_CONCAT_INNER(a, b) a##b
+#define PHYSENG_PROFILE_CONCAT(a, b) PHYSENG_PROFILE_CONCAT_INNER(a, b)
+#define PHYSENG_PROFILE_SCOPE(name) ProfileScope PHYSENG_PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PHYSENG_PROFILE_COUNT(counter, amount) Profiler::get().addCount(ProfileCounter::counter, amount)
+#define PHYSENG_PROFILE_GRID(grid) Profiler::get().recordOccupancy(grid)
+
+#else
+
+// sizeof keeps the arguments "used" without evaluating them
+#define PHYSENG_PROFILE_SCOPE(name) do { (void)sizeof(name); } while(0)
+#define PHYSENG_PROFILE_COUNT(counter, amount) do { (void)sizeof(amount); } while(0)
+#define PHYSENG_PROFILE_GRID(grid) do {} while(0)
+
+#endif
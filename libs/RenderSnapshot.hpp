@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Types.hpp"
+#include "HandleTable.hpp"
+
+class Engine;
+
+// immutable copy of everything needed to draw one simulation frame
+struct RenderSnapshot
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> radius;
+	std::vector<uint8_t> flags;
+	std::vector<Color> colors;
+	std::vector<Vec2> linkPoints; // two points per link
+	std::vector<ParticleHandle> handles; // lets edits posted back find the particles they picked, empty on replay
+	uint64_t frame = 0;
+
+	// reuses the current capacity, so steady scenes do not allocate
+	void capture(const Engine& engine, uint64_t frame);
+	uint32_t size() const
+	{
+		return x.size();
+	}
+};
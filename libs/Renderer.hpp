@@ -4,14 +4,23 @@
 
 #include "VerletObject.hpp"
 #include "Engine.hpp"
+#include "RenderSnapshot.hpp"
 
 class Renderer
 {
 private:
 	sf::RenderTarget& window;
-//	std::vector<VerletObject>& objects;
+	// atlas with a filled disc on the left half and the outline ring of fixed objects on the right half
+	sf::Texture circleTexture;
+	// persistent buffers, resized in place every frame so that steady scenes never reallocate
+	sf::VertexArray particleVertices;
+	sf::VertexArray linkVertices;
+	RenderSnapshot engineSnapshot; // used when rendering straight from an engine
+
+	void createCircleTexture();
 
 public:
 	Renderer(sf::RenderTarget& window);
-	void render(Engine& engine);
+	void render(const Engine& engine);
+	void render(const RenderSnapshot& snapshot);
 };
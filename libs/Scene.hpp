@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Engine.hpp"
+
+struct SceneParticle
+{
+	Vec2 position;
+	Vec2 velocity;
+	float radius = 1.0f;
+	float rigidness = 1.0f;
+	bool fixed = false;
+	Color color;
+};
+
+struct SceneLink
+{
+	uint32_t first = 0; // particle indices in the order the scene declares them
+	uint32_t second = 0;
+	float restLength = 0.0f;
+	float stiffness = 1.0f;
+	bool spring = false;
+};
+
+// releases count particles, one every interval frames from frame start on
+struct SceneEmitter
+{
+	Vec2 position;
+	Vec2 velocity;
+	float radius = 1.0f;
+	float rigidness = 1.0f;
+	uint32_t interval = 1;
+	uint32_t count = 0;
+	uint32_t start = 0;
+};
+
+// everything needed to rebuild a run: the engine parameters, the initial particles and links, and the emitters
+// that add particles while it runs. The text format has one statement per line, # starts a comment:
+//   bounds 0 0 <width> <height>                the dense grid starts at the origin
+//   timestep <stepdt> <substeps>
+//   cellsize <size>                            at least 1, default twice the smallest radius, larger ones go to coarser levels
+//   gravity <x> <y>
+//   walls <none|all|left,right,top,bottom>
+//   open <none|all|left,right,top,bottom>
+//   broadphase <grid|hash>
+//   sleep <on|off>
+//   particle <x> <y> <radius> <rigidness> [fixed] [velocity <vx> <vy>] [color <r> <g> <b>]
+//   lattice <x> <y> <columns> <rows> <spacing> <radius> <rigidness> [pinned] [linked <stiffness>] [jitter <amount>]
+//   link <first> <second> <rest length|auto> <stiffness> [spring]
+//   emitter <x> <y> <vx> <vy> <radius> <rigidness> <interval> <count> [start]
+// A lattice declares columns * rows particles row by row: pinned fixes its first row, linked ties every particle
+// to its right and lower neighbour and jitter shifts particles right by up to amount. Links name particles by the
+// order they were declared in, auto takes the distance between the two at the start
+struct Scene
+{
+	Rect bounds = Rect(0.0f, 0.0f, 1000.0f, 1000.0f);
+	float stepdt = 1.0f / 60.0f;
+	int subSteps = 8;
+	float cellSize = 0.0f;
+	Vec2 gravity = {0.0f, 980.0f};
+	uint8_t walls = BOUNDARY_ALL;
+	uint8_t openBoundaries = 0;
+	BroadPhaseType broadPhase = BroadPhaseType::Grid;
+	bool sleep = false;
+	std::vector<SceneParticle> particles;
+	std::vector<SceneLink> links;
+	std::vector<SceneEmitter> emitters;
+
+	// replaces the scene with the one in the file; false with a message naming the line when it cannot be read
+	bool load(const std::string& path, std::string& error);
+	bool parse(const char* text, size_t size, std::string& error);
+	// the cellsize statement, or twice the smallest radius of the particles and emitters
+	float getGridCellSize() const;
+	std::unique_ptr<Engine> createEngine(uint32_t threadCount = 1) const;
+	// adds the particles the emitters release before update number frame, counted from 0
+	void emit(Engine& engine, uint64_t frame) const;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include "Types.hpp"
+
+// conversions between the physics core value types and their SFML counterparts, for the GUI side only
+
+inline sf::Vector2f toSf(Vec2 v)
+{
+	return {v.x, v.y};
+}
+
+inline Vec2 fromSf(sf::Vector2f v)
+{
+	return {v.x, v.y};
+}
+
+inline sf::Color toSf(Color c)
+{
+	return sf::Color(c.r, c.g, c.b, c.a);
+}
+
+inline Rect fromSf(const sf::FloatRect& r)
+{
+	return {r.left, r.top, r.width, r.height};
+}
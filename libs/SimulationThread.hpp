@@ -0,0 +1,48 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "Engine.hpp"
+#include "RenderSnapshot.hpp"
+#include "TripleBuffer.hpp"
+
+// runs Engine::update on its own thread at a fixed timestep and publishes a RenderSnapshot after every step;
+// the engine must only be touched through post() while the thread is alive
+class SimulationThread
+{
+private:
+	Engine& engine;
+	std::thread thread;
+	TripleBuffer<RenderSnapshot> snapshots;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::vector<std::function<void(Engine&)>> commands;
+	std::vector<std::function<void(Engine&)>> pendingCommands; // drained copy, owned by the simulation thread
+	std::atomic<bool> running{false};
+	std::atomic<bool> stopping{false};
+	std::atomic<float> stepRate{0.0f};
+	uint64_t frame = 0;
+
+	void loop();
+	bool applyCommands();
+	void publish();
+
+public:
+	SimulationThread(Engine& engine);
+	~SimulationThread();
+	void start();
+	void stop();
+	// queues a change to the engine, applied by the simulation thread before its next step
+	void post(std::function<void(Engine&)> command);
+	void setRunning(bool running);
+	bool isRunning() const;
+	// latest published snapshot, never blocks, must only be called from one consumer thread
+	const RenderSnapshot& acquireSnapshot();
+	// simulation steps per second measured over the last second
+	float getStepRate() const;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "ParticleStore.hpp"
+#include "HierarchicalGrid.hpp"
+#include "Link.hpp"
+
+struct SleepSettings
+{
+	float motionThreshold = 0.05f; // per substep displacement under which a particle counts as still
+	uint16_t framesToSleep = 30; // consecutive still frames before a particle may sleep
+	float contactMargin = 0.5f; // extra distance under which two particles still count as touching
+};
+
+// puts whole contact islands of resting particles to sleep and wakes them when something moving touches them;
+// sleeping particles are skipped by integration and act as fixed ones in every solver
+class SleepSystem
+{
+	friend class Checkpoint;
+private:
+	SleepSettings settings;
+	// islands of the last build in compressed sparse row form, island k holds
+	// islandMembers[islandStart[k]] .. islandMembers[islandStart[k+1]-1]
+	std::vector<uint32_t> islandOf; // island of every particle present at the last build, noIsland otherwise
+	std::vector<uint32_t> islandStart;
+	std::vector<uint32_t> islandMembers;
+	std::vector<uint32_t> parent; // union-find scratch
+	uint32_t sleepingCount = 0;
+
+	uint32_t findRoot(uint32_t i);
+	void unite(uint32_t a, uint32_t b);
+	bool touching(const ParticleStore& particles, uint32_t a, uint32_t b) const;
+	template<typename Grid, typename Visitor>
+	void forEachNeighbor(const ParticleStore& particles, const Grid& grid, uint32_t i, Visitor visit) const;
+	template<typename Grid>
+	void buildIslands(const ParticleStore& particles, const Grid& grid, const std::vector<Link>& links);
+	void sleepStillIslands(ParticleStore& particles);
+
+public:
+	static constexpr uint32_t noIsland = 0xffffffff;
+
+	void setSettings(const SleepSettings& settings);
+	const SleepSettings& getSettings() const;
+	// called once per frame, after the last substep, with the grid built during that substep,
+	// a HierarchicalGrid or a SparseHierarchicalGrid
+	template<typename Grid>
+	void update(ParticleStore& particles, const Grid& grid, const std::vector<Link>& links);
+	// wakes the island of particle i, or just the particle when it is in no island
+	void wake(ParticleStore& particles, uint32_t i);
+	void wakeAll(ParticleStore& particles);
+	// keeps the islands valid after the particles were permuted with order[newIndex] = oldIndex
+	void remap(const std::vector<uint32_t>& order, const std::vector<uint32_t>& oldToNew);
+	// call before particle i is removed by swap-and-pop: wakes its island, which lost a member,
+	// and moves the island entry of the last particle to index i
+	void remove(ParticleStore& particles, uint32_t i);
+	void clear();
+	uint32_t getSleepingCount() const;
+	uint32_t getIslandCount() const;
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "CollisionGrid.hpp"
+
+// uniform grid over the whole plane that only stores its occupied cells: an open addressing hash table
+// maps cell coordinates to a compact cell index, and the objects of compact cell c are
+// cellObjects[cellStart[c]] .. cellObjects[cellStart[c+1]-1] as in CollisionGrid.
+// Memory follows the number of objects instead of the area of the world. Cell coordinates are offset by
+// coordinateBias so that cells left of or above the origin stay unsigned; a grid with twice the cell size
+// and half the bias nests by shifts like the levels of a CollisionGrid hierarchy. Cell coordinates are
+// clamped to half the bias away from the origin. Compact cells are sorted by column, then row
+struct SpatialHashGrid
+{
+	static constexpr uint32_t noCell = 0xffffffff;
+	static constexpr uint64_t emptySlot = ~0ull;
+	uint32_t coordinateBias = 0x80000000;
+	int cellSize = 1;
+	std::vector<uint64_t> slotKeys; // cell key of each table slot, emptySlot when free
+	std::vector<uint32_t> slotCells; // compact index of the cell in each used slot
+	uint32_t slotMask = 0;
+	std::vector<uint64_t> cellKeys; // key of each compact cell, ascending
+	// first compact cell at or after row cellY - 1 in the column left (right) of each compact cell,
+	// past the end of that column when it has no such row
+	std::vector<uint32_t> leftStart;
+	std::vector<uint32_t> rightStart;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> cellObjects;
+	std::vector<uint32_t> objectCell; // compact cell of each inserted object
+	CellRange bounds = {1, 1, 0, 0}; // occupied cells of the last build, empty when minX > maxX
+	CollisionGridStats stats;
+
+	// width and height are ignored, the plane has no edge
+	void resize(uint32_t width, uint32_t height, int cellSize);
+	void build(const float* x, const float* y, uint32_t count);
+	// the subset of objects listed in ids (ascending), the grid stores the ids
+	void build(const float* x, const float* y, const uint32_t* ids, uint32_t count);
+	// objects with an extent, each id is inserted in every cell of its range. The plane has no edge to clip
+	// the ranges to, the caller keeps the total number of cells they cover under 2^32
+	void build(const std::vector<CellRange>& ranges);
+	void clear();
+	// compact index of the cell holding (x, y), noCell when that cell is empty
+	uint32_t getCellIndex(float x, float y) const;
+	CellRange getCellRange(float minX, float minY, float maxX, float maxY) const;
+	uint32_t getCellCount() const
+	{
+		return cellKeys.size();
+	}
+	uint32_t getObjectCount(uint32_t cellIndex) const
+	{
+		return cellStart[cellIndex + 1] - cellStart[cellIndex];
+	}
+	const uint32_t* getObjects(uint32_t cellIndex) const
+	{
+		return cellObjects.data() + cellStart[cellIndex];
+	}
+
+	void getCellCoords(float x, float y, uint32_t& cellX, uint32_t& cellY) const;
+	static uint64_t getKey(uint32_t cellX, uint32_t cellY)
+	{
+		return (static_cast<uint64_t>(cellX) << 32) | cellY;
+	}
+	uint32_t findCell(uint32_t cellX, uint32_t cellY) const
+	{
+		const uint64_t key = getKey(cellX, cellY);
+		for(uint32_t slot = hashKey(key) & slotMask;; slot = (slot + 1) & slotMask)
+		{
+			const uint64_t slotKey = slotKeys[slot];
+			if(slotKey == key)
+				return slotCells[slot];
+			if(slotKey == emptySlot)
+				return noCell;
+		}
+	}
+	CellRange getBounds() const
+	{
+		return bounds;
+	}
+	bool spansSingleCell() const
+	{
+		return false;
+	}
+	// calls visit(objects, count) for every non-empty cell of range, columns outer
+	template<typename Visitor>
+	void forEachCell(const CellRange& range, Visitor visit) const
+	{
+		if(cellKeys.empty())
+			return;
+		for(uint32_t x = range.minX; x <= range.maxX; x++)
+		{
+			for(uint32_t y = range.minY; y <= range.maxY; y++)
+			{
+				const uint32_t cellIndex = findCell(x, y);
+				if(cellIndex != noCell)
+					visit(getObjects(cellIndex), getObjectCount(cellIndex));
+			}
+		}
+	}
+	// same as forEachCell over the 3x3 block around occupied cell cellIndex at (cellX, cellY), without probing:
+	// rows of a column are contiguous in the compact order and the build records where each cell's rows start
+	// in the columns on both sides
+	template<typename Visitor>
+	void forEachCellAround(uint32_t cellX, uint32_t cellY, uint32_t cellIndex, Visitor visit) const
+	{
+		const bool above = cellIndex > 0 && cellKeys[cellIndex - 1] == getKey(cellX, cellY - 1);
+		const uint32_t first[3] = {leftStart[cellIndex], above ? cellIndex - 1 : cellIndex, rightStart[cellIndex]};
+		for(uint32_t column = 0; column < 3; column++)
+		{
+			const uint64_t lastKey = getKey(cellX + column - 1, cellY + 1);
+			for(uint32_t c = first[column]; c < cellKeys.size() && cellKeys[c] <= lastKey; c++)
+				visit(getObjects(c), getObjectCount(c));
+		}
+	}
+	// calls visit(cellX, cellY, cellIndex) for every occupied cell of columns [startX, endX), columns outer
+	template<typename Visitor>
+	void forEachCellInColumns(uint32_t startX, uint32_t endX, Visitor visit) const
+	{
+		for(uint32_t c = findColumn(startX); c < cellKeys.size() && (cellKeys[c] >> 32) < endX; c++)
+			visit(static_cast<uint32_t>(cellKeys[c] >> 32), static_cast<uint32_t>(cellKeys[c]), c);
+	}
+
+private:
+	std::vector<uint64_t> relativeKeys;
+	std::vector<uint64_t> relativeScratch;
+	std::vector<uint32_t> cellCount;
+	std::vector<uint32_t> cellRank;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> orderScratch;
+
+	// biased cell coordinate of position, returns false when it had to be clamped
+	bool getCellCoord(float position, uint32_t& cell) const;
+	static uint32_t hashKey(uint64_t key)
+	{
+		return static_cast<uint32_t>((key * 0x9e3779b97f4a7c15ull) >> 32);
+	}
+	// first compact cell of column cellX or of the next occupied one
+	uint32_t findColumn(uint32_t cellX) const;
+	void resetTable(uint32_t insertions);
+	// doubles the table and reinserts the cells found so far
+	void growTable();
+	// finds or adds the cell of key, returns its index in insertion order
+	uint32_t insert(uint64_t key);
+	// renumbers the cells inserted so far in key order and turns their counts into cellStart
+	void sortCells();
+	// fills leftStart and rightStart with one merge walk over every pair of adjacent columns
+	void linkColumns();
+};
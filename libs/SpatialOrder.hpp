@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "CollisionGrid.hpp"
+#include "SpatialHashGrid.hpp"
+
+// interleaves the bits of two 16 bit cell coordinates into a Z-order (Morton) key
+inline uint32_t getMortonKey(uint32_t x, uint32_t y)
+{
+	auto spread = [](uint32_t v)
+	{
+		v &= 0x0000ffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	};
+	return spread(x) | (spread(y) << 1);
+}
+
+// computes the order that sorts particles along a Morton curve over the collision grid cells,
+// keeping its buffers between calls
+class MortonSorter
+{
+private:
+	std::vector<uint32_t> keys;
+	std::vector<uint32_t> keysScratch;
+	std::vector<uint32_t> orderScratch;
+
+public:
+	// order[newIndex] = oldIndex, stable for particles sharing a cell. Grid is a CollisionGrid or a
+	// SpatialHashGrid, cells are numbered from the corner of its bounds
+	template<typename Grid>
+	void sort(const Grid& grid, const float* x, const float* y, uint32_t count, std::vector<uint32_t>& order);
+};
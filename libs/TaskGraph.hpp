@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include "ThreadPool.hpp"
+
+// tasks 0 .. taskCount-1 with dependencies between them, run on a ThreadPool: a task starts as soon as every
+// task it depends on has finished, there is no barrier between groups of tasks.
+// Every thread owns a deque of ready tasks. The tasks a thread unblocks go on the back of its own deque and
+// run next, while the data they share with the finished one is still in its cache; a thread whose deque is
+// empty steals from the front of the others
+class TaskGraph
+{
+private:
+	struct ReadyQueue
+	{
+		std::mutex mutex;
+		std::vector<uint32_t> tasks; // room for every task, each one is pushed once per run
+		uint32_t head = 0;
+		uint32_t tail = 0;
+	};
+
+	uint32_t taskCount = 0;
+	std::vector<uint32_t> dependencyCount;
+	// edges in the order they were added, turned into successor lists by the first run after a change
+	std::vector<uint32_t> edgeBefore;
+	std::vector<uint32_t> edgeAfter;
+	std::vector<uint32_t> successorStart;
+	std::vector<uint32_t> successors;
+	bool successorsDirty = true;
+	std::unique_ptr<std::atomic<uint32_t>[]> pending; // dependencies of each task still running
+	uint32_t pendingCapacity = 0;
+	std::vector<std::unique_ptr<ReadyQueue>> queues;
+	std::atomic<uint32_t> remaining{0};
+
+	void buildSuccessors();
+	void work(uint32_t thread, const std::function<void(uint32_t)>& task);
+	void push(uint32_t thread, uint32_t task);
+	bool popBack(uint32_t thread, uint32_t& task);
+	bool popFront(uint32_t thread, uint32_t& task);
+
+public:
+	// drops every task and dependency and starts a graph of taskCount independent tasks
+	void reset(uint32_t taskCount);
+	// task after does not start before task before has finished, the graph must stay acyclic
+	void addDependency(uint32_t before, uint32_t after);
+	uint32_t getTaskCount() const
+	{
+		return taskCount;
+	}
+	// runs task(t) once for every task t and returns once all have finished, the graph can be run again
+	void run(ThreadPool& pool, const std::function<void(uint32_t)>& task);
+};
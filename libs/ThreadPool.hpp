@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// persistent pool of worker threads, the calling thread takes part in every dispatch
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+	const std::function<void(uint32_t)>* job = nullptr; // called once by every thread with its index
+	std::atomic<uint32_t> nextTask{0};
+	uint32_t busyWorkers = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+
+	void workerLoop(uint32_t thread);
+
+public:
+	explicit ThreadPool(uint32_t threadCount);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	uint32_t getThreadCount() const;
+	// runs task(0) .. task(taskCount-1) across all threads and returns once every task has finished
+	void dispatch(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+	// calls work(thread) once on every thread, thread 0 being the caller, and returns once every call has returned
+	void run(const std::function<void(uint32_t)>& work);
+};
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// on-disk layout shared by TrajectoryRecorder and TrajectoryReader.
+// A file is a TrajectoryFileHeader followed by one record per recorded frame. Positions are quantized
+// to integers, predicted from earlier frames and only the residuals are stored, Rice coded in blocks of 32.
+// Every record payload holds, in this order:
+//   radius (float), color (4 bytes) and flags (1 byte) arrays of particles [staticStart, particleCount)
+//   first/second (int32 pairs) of links [linkStart, linkCount)
+//   coded x residuals, coded y residuals of all particleCount particles
+// Keyframes restart the prediction and resend all particle and link data, so a reader can seek to them
+
+static constexpr char trajectoryMagic[8] = {'P', 'H', 'Y', 'S', 'T', 'R', 'A', 'J'};
+static constexpr uint32_t trajectoryVersion = 1;
+static constexpr uint32_t trajectoryBlockSize = 32;
+
+struct TrajectoryFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	float quantization; // world units per quantization step
+	uint32_t keyframeInterval;
+	uint32_t reserved;
+};
+
+enum TrajectoryRecordType : uint8_t
+{
+	TRAJECTORY_KEYFRAME = 0,
+	TRAJECTORY_DELTA = 1
+};
+
+struct TrajectoryRecordHeader
+{
+	uint32_t payloadSize;
+	uint8_t type;
+	uint8_t padding[3];
+	uint64_t frame;
+	uint32_t particleCount;
+	uint32_t linkCount;
+	uint32_t staticStart;
+	uint32_t linkStart;
+};
+
+// quantized positions of the last three frames of a stream, recorder and reader advance it identically
+struct TrajectoryHistory
+{
+	std::vector<int32_t> x[3]; // [0] current frame, [1] previous, [2] the one before
+	std::vector<int32_t> y[3];
+	uint32_t framesSinceKeyframe = 0;
+
+	void advance()
+	{
+		x[2].swap(x[1]);
+		x[1].swap(x[0]);
+		y[2].swap(y[1]);
+		y[1].swap(y[0]);
+	}
+
+	// prediction of value i of the current frame from what the reader already knows: particles present in
+	// the previous frame continue their motion (constantVelocity) or stay where they were, new particles and
+	// keyframes are predicted from the particle before them in the same frame
+	static uint32_t predict(const std::vector<int32_t>* values, uint32_t i, bool keyframe, bool constantVelocity)
+	{
+		if(!keyframe && i < values[1].size())
+		{
+			if(constantVelocity && i < values[2].size())
+				return 2u * static_cast<uint32_t>(values[1][i]) - static_cast<uint32_t>(values[2][i]);
+			return values[1][i];
+		}
+		return i > 0 ? values[0][i - 1] : 0;
+	}
+};
+
+// residuals are computed with wrapping unsigned arithmetic so decoding is exact whatever the values
+inline uint32_t zigzagEncode(uint32_t value)
+{
+	return (value << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(value) >> 31);
+}
+
+inline uint32_t zigzagDecode(uint32_t value)
+{
+	return (value >> 1) ^ (0u - (value & 1));
+}
+
+// residuals are Rice coded: value >> k in unary (at most riceEscape ones, which escape to 32 raw bits), then
+// the low k bits. The block header byte holds k in its low 5 bits and the top bit selects the constant position
+// predictor instead of constant velocity for that block
+static constexpr uint8_t trajectoryPositionPredictor = 0x80;
+static constexpr uint32_t riceEscape = 16;
+
+class TrajectoryBitWriter
+{
+private:
+	std::vector<uint8_t>& out;
+	uint64_t bits = 0;
+	uint32_t bitCount = 0;
+
+public:
+	explicit TrajectoryBitWriter(std::vector<uint8_t>& out) : out(out) {}
+	// width up to 32
+	void write(uint32_t value, uint32_t width)
+	{
+		bits |= static_cast<uint64_t>(value) << bitCount;
+		bitCount += width;
+		while(bitCount >= 8)
+		{
+			out.push_back(bits & 0xff);
+			bits >>= 8;
+			bitCount -= 8;
+		}
+	}
+	void writeRice(uint32_t value, uint32_t k)
+	{
+		const uint32_t quotient = value >> k;
+		if(quotient >= riceEscape)
+		{
+			write((1u << riceEscape) - 1, riceEscape);
+			write(value, 32);
+			return;
+		}
+		write((1u << quotient) - 1, quotient + 1);
+		write(value & ((1u << k) - 1), k);
+	}
+	// pads to a whole byte
+	void flush()
+	{
+		if(bitCount > 0)
+			out.push_back(bits & 0xff);
+		bits = 0;
+		bitCount = 0;
+	}
+};
+
+class TrajectoryBitReader
+{
+private:
+	const uint8_t*& data;
+	const uint8_t* end;
+	uint64_t bits = 0;
+	uint32_t bitCount = 0;
+
+public:
+	TrajectoryBitReader(const uint8_t*& data, const uint8_t* end) : data(data), end(end) {}
+	bool read(uint32_t width, uint32_t& value)
+	{
+		while(bitCount < width)
+		{
+			if(data >= end)
+				return false;
+			bits |= static_cast<uint64_t>(*data++) << bitCount;
+			bitCount += 8;
+		}
+		value = width == 32 ? static_cast<uint32_t>(bits) : static_cast<uint32_t>(bits & ((1ull << width) - 1));
+		bits >>= width;
+		bitCount -= width;
+		return true;
+	}
+	bool readRice(uint32_t k, uint32_t& value)
+	{
+		uint32_t quotient = 0;
+		uint32_t bit = 1;
+		while(quotient < riceEscape)
+		{
+			if(!read(1, bit))
+				return false;
+			if(!bit)
+				break;
+			quotient++;
+		}
+		if(quotient == riceEscape)
+			return read(32, value);
+		uint32_t remainder = 0;
+		if(!read(k, remainder))
+			return false;
+		value = (quotient << k) | remainder;
+		return true;
+	}
+	// drops the padding of the current byte
+	void align()
+	{
+		bits = 0;
+		bitCount = 0;
+	}
+};
+
+// Rice parameter with the smallest encoded size for a block, searched around the mean
+inline uint32_t chooseRiceParameter(const uint32_t* values, uint32_t count, uint64_t& size)
+{
+	uint64_t sum = 0;
+	for(uint32_t k = 0; k < count; k++)
+		sum += values[k];
+	uint32_t guess = 0;
+	while(guess < 31 && (sum >> (guess + 1)) >= count)
+		guess++;
+	uint32_t best = guess;
+	size = ~0ull;
+	for(uint32_t k = guess > 0 ? guess - 1 : 0; k <= guess + 1 && k < 32; k++)
+	{
+		uint64_t bits = 0;
+		for(uint32_t n = 0; n < count; n++)
+		{
+			const uint32_t quotient = values[n] >> k;
+			bits += quotient >= riceEscape ? riceEscape + 32 : quotient + 1 + k;
+		}
+		if(bits < size)
+		{
+			size = bits;
+			best = k;
+		}
+	}
+	return best;
+}
+
+// appends the residuals of one axis of the current frame (values[0]) in blocks of 32; settled particles
+// jitter around a position while moving ones keep their velocity, so every block takes whichever predictor
+// gives it the smaller encoding
+inline void packTrajectoryAxis(const std::vector<int32_t>* values, bool keyframe, uint32_t framesSinceKeyframe, std::vector<uint8_t>& out)
+{
+	const uint32_t count = values[0].size();
+	const bool velocityKnown = !keyframe && framesSinceKeyframe >= 2;
+	uint32_t velocityResiduals[trajectoryBlockSize];
+	uint32_t positionResiduals[trajectoryBlockSize];
+	TrajectoryBitWriter writer(out);
+	for(uint32_t start = 0; start < count; start += trajectoryBlockSize)
+	{
+		const uint32_t blockCount = count - start < trajectoryBlockSize ? count - start : trajectoryBlockSize;
+		for(uint32_t k = 0; k < blockCount; k++)
+		{
+			const uint32_t i = start + k;
+			const uint32_t value = values[0][i];
+			velocityResiduals[k] = zigzagEncode(value - TrajectoryHistory::predict(values, i, keyframe, velocityKnown));
+			if(velocityKnown)
+				positionResiduals[k] = zigzagEncode(value - TrajectoryHistory::predict(values, i, keyframe, false));
+		}
+		uint64_t velocitySize;
+		uint64_t positionSize = ~0ull;
+		const uint32_t velocityK = chooseRiceParameter(velocityResiduals, blockCount, velocitySize);
+		const uint32_t positionK = velocityKnown ? chooseRiceParameter(positionResiduals, blockCount, positionSize) : 0;
+		const bool usePosition = positionSize < velocitySize;
+		const uint32_t* residuals = usePosition ? positionResiduals : velocityResiduals;
+		const uint32_t k = usePosition ? positionK : velocityK;
+		out.push_back(k | (usePosition ? trajectoryPositionPredictor : 0));
+		for(uint32_t n = 0; n < blockCount; n++)
+			writer.writeRice(residuals[n], k);
+		writer.flush();
+	}
+}
+
+// smallest packed size of count values: every block has its header byte and every value at least one bit,
+// each block padded to a whole byte
+inline uint64_t getMinimumAxisSize(uint32_t count)
+{
+	return (static_cast<uint64_t>(count) + trajectoryBlockSize - 1) / trajectoryBlockSize + (static_cast<uint64_t>(count) + 7) / 8;
+}
+
+// reverse of packTrajectoryAxis, fills values[0] and advances data; false when it would read past end
+inline bool unpackTrajectoryAxis(const uint8_t*& data, const uint8_t* end, std::vector<int32_t>* values, uint32_t count,
+		bool keyframe, uint32_t framesSinceKeyframe)
+{
+	const bool velocityKnown = !keyframe && framesSinceKeyframe >= 2;
+	// a corrupt count must not get as far as the resize
+	if(static_cast<uint64_t>(end - data) < getMinimumAxisSize(count))
+		return false;
+	values[0].resize(count);
+	TrajectoryBitReader reader(data, end);
+	for(uint32_t start = 0; start < count; start += trajectoryBlockSize)
+	{
+		const uint32_t blockCount = count - start < trajectoryBlockSize ? count - start : trajectoryBlockSize;
+		if(data >= end)
+			return false;
+		const uint32_t k = *data & 0x1f;
+		const bool constantVelocity = velocityKnown && !(*data & trajectoryPositionPredictor);
+		data++;
+		for(uint32_t n = 0; n < blockCount; n++)
+		{
+			uint32_t residual;
+			if(!reader.readRice(k, residual))
+				return false;
+			const uint32_t i = start + n;
+			values[0][i] = static_cast<int32_t>(TrajectoryHistory::predict(values, i, keyframe, constantVelocity) + zigzagDecode(residual));
+		}
+		reader.align();
+	}
+	return true;
+}
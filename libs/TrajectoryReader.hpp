@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+#include "Types.hpp"
+#include "TrajectoryFormat.hpp"
+#include "RenderSnapshot.hpp"
+
+// plays back a file written by TrajectoryRecorder. Opening indexes every record, reading the frames in
+// order decodes each one once and any other access restarts from the closest keyframe before it
+class TrajectoryReader
+{
+private:
+	struct RecordInfo
+	{
+		uint64_t offset; // of the record header
+		uint64_t frame;
+		bool keyframe;
+	};
+
+	FILE* file = nullptr;
+	TrajectoryFileHeader fileHeader = {};
+	std::vector<RecordInfo> records;
+
+	// decoder state after the last decoded record
+	int64_t decodedRecord = -1;
+	TrajectoryHistory history;
+	std::vector<float> radius;
+	std::vector<Color> colors;
+	std::vector<uint8_t> flags;
+	std::vector<int32_t> links;
+	std::vector<uint8_t> payload;
+
+	bool decodeRecord(uint32_t index);
+
+public:
+	TrajectoryReader() = default;
+	~TrajectoryReader();
+	TrajectoryReader(const TrajectoryReader&) = delete;
+	TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+	// a file cut short by a crash opens fine, the incomplete last record is ignored
+	bool open(const std::string& path);
+	void close();
+	uint32_t getRecordCount() const;
+	// engine frame number of a record
+	uint64_t getFrame(uint32_t index) const;
+	uint32_t getKeyframeInterval() const;
+	float getQuantization() const;
+	// decodes record index into a snapshot the Renderer can draw, false on a corrupt record
+	bool read(uint32_t index, RenderSnapshot& snapshot);
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdio>
+#include <cstdint>
+
+#include "Types.hpp"
+#include "TrajectoryFormat.hpp"
+
+class Engine;
+
+struct TrajectorySettings
+{
+	float quantization = 1.0f / 8.0f; // world units per step, positions are stored to this precision
+	uint32_t keyframeInterval = 120; // recorded frames between two keyframes, bounds the cost of a seek
+};
+
+// streams the particle positions of every recorded frame to a compressed trajectory file.
+// record() only quantizes the positions into one of two frame buffers and returns; a background
+// thread encodes and writes the other buffer meanwhile, record() waits only when the writer falls behind
+class TrajectoryRecorder
+{
+private:
+	// everything the writer needs from one engine frame, filled on the simulation thread
+	struct Frame
+	{
+		uint64_t frame = 0;
+		bool resync = false; // indices changed (reorder, removal), all static data and links are resent
+		std::vector<int32_t> x;
+		std::vector<int32_t> y;
+		uint32_t staticStart = 0; // static data below covers particles [staticStart, x.size())
+		std::vector<float> radius;
+		std::vector<Color> colors;
+		std::vector<uint8_t> flags;
+		uint32_t linkStart = 0; // link pairs below are links [linkStart, ...)
+		std::vector<int32_t> links;
+	};
+	enum FrameState
+	{
+		FRAME_FREE,
+		FRAME_QUEUED,
+		FRAME_ENCODING
+	};
+
+	TrajectorySettings settings;
+	FILE* file = nullptr;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable condition;
+	Frame frames[2];
+	FrameState frameStates[2] = {FRAME_FREE, FRAME_FREE};
+	std::deque<int> queuedFrames; // oldest first
+	bool stopping = false;
+	bool writeFailed = false;
+
+	// simulation side, what earlier frames already handed over
+	uint32_t sentParticles = 0;
+	uint32_t sentLinks = 0;
+	uint64_t sentReorderCount = 0;
+	uint64_t sentRemovalCount = 0;
+	bool firstFrame = true;
+
+	// writer side, accumulated copies of the static data needed to emit keyframes
+	std::vector<float> radius;
+	std::vector<Color> colors;
+	std::vector<uint8_t> flags;
+	std::vector<int32_t> links;
+	TrajectoryHistory history;
+	std::vector<uint8_t> payload;
+	uint64_t recordedFrames = 0;
+	uint64_t bytesWritten = 0;
+	uint64_t rawBytes = 0;
+
+	void writerLoop();
+	bool encode(Frame& frame);
+
+public:
+	TrajectoryRecorder() = default;
+	~TrajectoryRecorder();
+	TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+	TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+	bool open(const std::string& path, const TrajectorySettings& settings = TrajectorySettings());
+	// captures the current state of the engine, call it after Engine::update
+	void record(const Engine& engine);
+	// flushes the queued frames and closes the file, returns false if any write failed
+	bool close();
+	bool isOpen() const;
+	// writer statistics, stable once close() returned
+	uint64_t getRecordedFrames() const;
+	uint64_t getBytesWritten() const;
+	// size the same frames would take as raw float x/y pairs
+	uint64_t getRawBytes() const;
+};
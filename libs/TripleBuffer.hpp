@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// lock-free single producer / single consumer triple buffer: the producer always has a buffer to write,
+// the consumer always reads the most recently published one and neither ever waits for the other
+template<typename T>
+class TripleBuffer
+{
+private:
+	static constexpr uint8_t indexMask = 3;
+	static constexpr uint8_t freshBit = 4; // set while the shared buffer holds data the consumer has not read yet
+	T buffers[3];
+	std::atomic<uint8_t> shared{1};
+	uint8_t back = 0; // owned by the producer
+	uint8_t front = 2; // owned by the consumer
+
+public:
+	T& getWriteBuffer()
+	{
+		return buffers[back];
+	}
+
+	void publish()
+	{
+		back = shared.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+	}
+
+	bool hasFresh() const
+	{
+		return shared.load(std::memory_order_acquire) & freshBit;
+	}
+
+	const T& acquire()
+	{
+		if(hasFresh())
+			front = shared.exchange(front, std::memory_order_acq_rel) & indexMask;
+		return buffers[front];
+	}
+};
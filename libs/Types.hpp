@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+// small value types used by the physics core, so that it does not depend on any windowing library
+
+struct Vec2
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	Vec2() = default;
+	Vec2(float x, float y) : x(x), y(y) {}
+	Vec2& operator+=(Vec2 v) { x += v.x; y += v.y; return *this; }
+	Vec2& operator-=(Vec2 v) { x -= v.x; y -= v.y; return *this; }
+	Vec2& operator*=(float s) { x *= s; y *= s; return *this; }
+};
+
+inline Vec2 operator+(Vec2 a, Vec2 b) { return {a.x + b.x, a.y + b.y}; }
+inline Vec2 operator-(Vec2 a, Vec2 b) { return {a.x - b.x, a.y - b.y}; }
+inline Vec2 operator-(Vec2 v) { return {-v.x, -v.y}; }
+inline Vec2 operator*(Vec2 v, float s) { return {v.x * s, v.y * s}; }
+inline Vec2 operator*(float s, Vec2 v) { return {v.x * s, v.y * s}; }
+inline Vec2 operator/(Vec2 v, float s) { return {v.x / s, v.y / s}; }
+inline bool operator==(Vec2 a, Vec2 b) { return a.x == b.x && a.y == b.y; }
+inline bool operator!=(Vec2 a, Vec2 b) { return !(a == b); }
+
+struct Rect
+{
+	float left = 0.0f;
+	float top = 0.0f;
+	float width = 0.0f;
+	float height = 0.0f;
+	Rect() = default;
+	Rect(float left, float top, float width, float height) : left(left), top(top), width(width), height(height) {}
+	bool contains(Vec2 p) const
+	{
+		return p.x >= left && p.x < left + width && p.y >= top && p.y < top + height;
+	}
+};
+
+struct Color
+{
+	uint8_t r = 255;
+	uint8_t g = 255;
+	uint8_t b = 255;
+	uint8_t a = 255;
+	Color() = default;
+	Color(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) : r(r), g(g), b(b), a(a) {}
+};
@@ -1,33 +1,30 @@
 #pragma once
 
-#include <SFML/Graphics.hpp>
+#include "Types.hpp"
 
+// standalone description of a single particle, used to spawn objects into the Engine particle store
 class VerletObject
 {
 private:
-	sf::Vector2f position;
-	sf::Vector2f prevPosition;
-	sf::Vector2f acceleration;
+	Vec2 position;
+	Vec2 prevPosition;
 	float radius;
 	float rigidness;
-	sf::Color color = sf::Color::White;
+	Color color = Color(255, 255, 255);
 	bool fixed;
 
 public:
-	VerletObject(sf::Vector2f position, float radius, float rigidness, bool fixed);
-	void updatePosition(float dt);
-	void accelerate(sf::Vector2f a);
-	void checkBoundaries(sf::FloatRect bounds);
-	sf::Color getColor() const;
-	void setColor(sf::Color color = sf::Color::White);
-	sf::Vector2f getPosition() const;
-	void setPosition(sf::Vector2f position);
+	VerletObject(Vec2 position, float radius, float rigidness, bool fixed);
+	Color getColor() const;
+	void setColor(Color color = Color(255, 255, 255));
+	Vec2 getPosition() const;
+	void setPosition(Vec2 position);
 	float getRadius() const;
 	void setRadius(float radius = 10.0f);
-	void setVelocity(sf::Vector2f v, float dt);
+	void setVelocity(Vec2 v, float dt);
 	bool isFixed() const;
 	void setFixed();
 	float getRigidness() const;
-	sf::Vector2f getPrevPosition() const;
-	void setPrevPosition(sf::Vector2f prevPosition);
+	Vec2 getPrevPosition() const;
+	void setPrevPosition(Vec2 prevPosition);
 };
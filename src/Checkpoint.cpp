@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+
+#ifdef _WIN32
+	#include <fstream>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/uio.h>
+	#include <climits>
+#endif
+
+#include "Checkpoint.hpp"
+
+static const char checkpointMagic[8] = {'P', 'H', 'Y', 'S', 'C', 'K', 'P', 'T'};
+static constexpr uint32_t byteOrderMark = 0x01020304;
+static constexpr uint64_t sectionAlignment = 64;
+// same cap on substeps as the scene format
+static constexpr int32_t maxSubStepCount = 1024;
+
+enum CheckpointSection
+{
+	SECTION_X, SECTION_Y, SECTION_PREV_X, SECTION_PREV_Y, SECTION_ACC_X, SECTION_ACC_Y,
+	SECTION_RADIUS, SECTION_RIGIDNESS, SECTION_FLAGS, SECTION_STILL_FRAMES, SECTION_COLORS,
+	SECTION_LINK_FIRST, SECTION_LINK_SECOND, SECTION_LINK_REST_LENGTH, SECTION_LINK_STIFFNESS, SECTION_LINK_SPRING,
+	SECTION_ISLAND_OF, SECTION_ISLAND_START, SECTION_ISLAND_MEMBERS,
+	SECTION_PARTICLE_GENERATIONS, SECTION_PARTICLE_HANDLES, SECTION_LINK_GENERATIONS, SECTION_LINK_HANDLES,
+	SECTION_COUNT
+};
+
+// fixed size header at the start of the file, followed by the sections at the offsets it lists
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t particleCount;
+	uint32_t linkCount;
+	Rect bounds;
+	float stepdt;
+	int32_t subSteps; // count the engine was built with
+	int32_t currentSubSteps; // count velocities are scaled for, differs while substepping is adaptive
+	uint32_t substepAdaptive;
+	int32_t minSubSteps;
+	int32_t maxSubSteps;
+	float maxDisplacement;
+	float maxPenetration;
+	float maxLinkStretch;
+	uint32_t framesToRelax;
+	uint32_t relaxedFrames;
+	int32_t cellSize;
+	Vec2 gravity;
+	float maxRadius;
+	uint64_t frameCount;
+	uint32_t reorderInterval;
+	uint32_t sleepEnabled;
+	float sleepMotionThreshold;
+	uint32_t sleepFramesToSleep;
+	float sleepContactMargin;
+	uint32_t islandOfCount;
+	uint32_t islandStartCount;
+	uint32_t islandMemberCount;
+	uint32_t particleSlotCount;
+	uint32_t linkSlotCount;
+	uint32_t openBoundaries;
+	uint32_t walls;
+	uint32_t broadPhase;
+	uint32_t neighborListEnabled;
+	float neighborSkin;
+	uint64_t removalCount;
+	uint64_t sectionOffset[SECTION_COUNT];
+	uint64_t sectionSize[SECTION_COUNT];
+};
+
+static_assert(std::is_trivially_copyable<Color>::value, "colors are stored as raw bytes");
+static_assert(sizeof(ParticleHandle) == 8 && sizeof(LinkHandle) == 8, "handles are stored as raw slot and generation pairs");
+
+struct SectionData
+{
+	const void* data;
+	uint64_t size;
+};
+
+static uint64_t alignSection(uint64_t offset)
+{
+	return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+template<typename T>
+static SectionData getSection(const std::vector<T>& values)
+{
+	return {values.data(), values.size() * sizeof(T)};
+}
+
+// writes the header and every section with as few system calls as the platform allows
+static bool writeSections(const std::string& path, const CheckpointHeader& header, const SectionData* sections)
+{
+	static const char padding[sectionAlignment] = {};
+#ifdef _WIN32
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if(!file)
+		return false;
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+	uint64_t offset = sizeof(header);
+	for(int s = 0; s < SECTION_COUNT && ok; s++)
+	{
+		ok = std::fwrite(padding, 1, header.sectionOffset[s] - offset, file) == header.sectionOffset[s] - offset;
+		if(sections[s].size > 0)
+			ok = ok && std::fwrite(sections[s].data, sections[s].size, 1, file) == 1;
+		offset = header.sectionOffset[s] + sections[s].size;
+	}
+	return std::fclose(file) == 0 && ok;
+#else
+	const int file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(file < 0)
+		return false;
+	std::vector<iovec> parts;
+	parts.push_back({const_cast<CheckpointHeader*>(&header), sizeof(header)});
+	uint64_t offset = sizeof(header);
+	for(int s = 0; s < SECTION_COUNT; s++)
+	{
+		if(header.sectionOffset[s] > offset)
+			parts.push_back({const_cast<char*>(padding), header.sectionOffset[s] - offset});
+		if(sections[s].size > 0)
+			parts.push_back({const_cast<void*>(sections[s].data), sections[s].size});
+		offset = header.sectionOffset[s] + sections[s].size;
+	}
+	// one gathered write normally covers the whole file, loop only for partial writes
+	size_t first = 0;
+	bool ok = true;
+	while(first < parts.size() && ok)
+	{
+		const ssize_t written = ::writev(file, parts.data() + first, std::min<size_t>(parts.size() - first, IOV_MAX));
+		ok = written > 0;
+		size_t remaining = ok ? written : 0;
+		while(first < parts.size() && remaining >= parts[first].iov_len)
+			remaining -= parts[first++].iov_len;
+		if(first < parts.size() && remaining > 0)
+		{
+			parts[first].iov_base = static_cast<char*>(parts[first].iov_base) + remaining;
+			parts[first].iov_len -= remaining;
+		}
+	}
+	return ::close(file) == 0 && ok;
+#endif
+}
+
+// islands dissolved by removals keep their member lists, which may name particles that no longer exist.
+// Only the islands some particle still belongs to are saved, renumbered in order of first member
+void Checkpoint::getLiveIslands(const SleepSystem& sleep, std::vector<uint32_t>& islandOf, std::vector<uint32_t>& islandStart,
+		std::vector<uint32_t>& islandMembers)
+{
+	std::vector<uint32_t> renumbered(sleep.getIslandCount(), SleepSystem::noIsland);
+	islandOf.assign(sleep.islandOf.size(), SleepSystem::noIsland);
+	for(uint32_t i = 0; i < sleep.islandOf.size(); i++)
+	{
+		const uint32_t island = sleep.islandOf[i];
+		if(island == SleepSystem::noIsland)
+			continue;
+		if(renumbered[island] == SleepSystem::noIsland)
+		{
+			renumbered[island] = islandStart.size();
+			islandStart.push_back(islandMembers.size());
+			islandMembers.insert(islandMembers.end(), sleep.islandMembers.begin() + sleep.islandStart[island],
+					sleep.islandMembers.begin() + sleep.islandStart[island + 1]);
+		}
+		islandOf[i] = renumbered[island];
+	}
+	if(!islandStart.empty())
+		islandStart.push_back(islandMembers.size());
+}
+
+bool Checkpoint::save(const Engine& engine, const std::string& path)
+{
+	const ParticleStore& particles = engine.particles;
+	const uint32_t linkCount = engine.links.size();
+	std::vector<int32_t> linkFirst(linkCount);
+	std::vector<int32_t> linkSecond(linkCount);
+	std::vector<float> linkRestLength(linkCount);
+	std::vector<float> linkStiffness(linkCount);
+	std::vector<uint8_t> linkSpring(linkCount);
+	for(uint32_t l = 0; l < linkCount; l++)
+	{
+		const Link& link = engine.links[l];
+		linkFirst[l] = link.getFirst();
+		linkSecond[l] = link.getSecond();
+		linkRestLength[l] = link.getRestLength();
+		linkStiffness[l] = link.getStiffness();
+		linkSpring[l] = link.isSpring();
+	}
+	const SleepSystem& sleep = engine.sleepSystem;
+	std::vector<uint32_t> islandOf, islandStart, islandMembers;
+	getLiveIslands(sleep, islandOf, islandStart, islandMembers);
+
+	CheckpointHeader header = {};
+	std::memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+	header.version = version;
+	header.byteOrder = byteOrderMark;
+	header.particleCount = particles.size();
+	header.linkCount = linkCount;
+	header.bounds = engine.bounds;
+	header.stepdt = engine.stepdt;
+	header.subSteps = engine.baseSubSteps;
+	header.currentSubSteps = engine.subSteps;
+	header.substepAdaptive = engine.substepSettings.adaptive;
+	header.minSubSteps = engine.substepSettings.minSubSteps;
+	header.maxSubSteps = engine.substepSettings.maxSubSteps;
+	header.maxDisplacement = engine.substepSettings.maxDisplacement;
+	header.maxPenetration = engine.substepSettings.maxPenetration;
+	header.maxLinkStretch = engine.substepSettings.maxLinkStretch;
+	header.framesToRelax = engine.substepSettings.framesToRelax;
+	header.relaxedFrames = engine.relaxedFrames;
+	header.cellSize = engine.grid.getBase().cellSize;
+	header.gravity = engine.gravity;
+	header.maxRadius = particles.maxRadius;
+	header.frameCount = engine.frameCount;
+	header.reorderInterval = engine.reorderInterval;
+	header.sleepEnabled = engine.sleepEnabled;
+	header.sleepMotionThreshold = sleep.settings.motionThreshold;
+	header.sleepFramesToSleep = sleep.settings.framesToSleep;
+	header.sleepContactMargin = sleep.settings.contactMargin;
+	header.islandOfCount = islandOf.size();
+	header.islandStartCount = islandStart.size();
+	header.islandMemberCount = islandMembers.size();
+	header.particleSlotCount = engine.particleHandles.getSlotCount();
+	header.linkSlotCount = engine.linkHandles.getSlotCount();
+	header.openBoundaries = engine.openBoundaries;
+	header.walls = engine.walls;
+	header.broadPhase = static_cast<uint32_t>(engine.broadPhase);
+	header.neighborListEnabled = engine.neighborSettings.enabled;
+	header.neighborSkin = engine.neighborSettings.skin;
+	header.removalCount = engine.removalCount;
+
+	const SectionData sections[SECTION_COUNT] = {
+		getSection(particles.x), getSection(particles.y), getSection(particles.prevX), getSection(particles.prevY),
+		getSection(particles.accX), getSection(particles.accY), getSection(particles.radius), getSection(particles.rigidness),
+		getSection(particles.flags), getSection(particles.stillFrames), getSection(particles.colors),
+		getSection(linkFirst), getSection(linkSecond), getSection(linkRestLength), getSection(linkStiffness), getSection(linkSpring),
+		getSection(islandOf), getSection(islandStart), getSection(islandMembers),
+		getSection(engine.particleHandles.slotGeneration), getSection(engine.particleHandles.handles),
+		getSection(engine.linkHandles.slotGeneration), getSection(engine.linkHandles.handles)
+	};
+	uint64_t offset = sizeof(header);
+	for(int s = 0; s < SECTION_COUNT; s++)
+	{
+		header.sectionOffset[s] = alignSection(offset);
+		header.sectionSize[s] = sections[s].size;
+		offset = header.sectionOffset[s] + sections[s].size;
+	}
+	return writeSections(path, header, sections);
+}
+
+// copies one section of the mapped file into an engine array
+template<typename T>
+static void adoptSection(std::vector<T>& values, const char* data, const CheckpointHeader& header, int section)
+{
+	const T* begin = reinterpret_cast<const T*>(data + header.sectionOffset[section]);
+	values.assign(begin, begin + header.sectionSize[section] / sizeof(T));
+}
+
+// the engine settings must be ones it can run: a corrupt step, size or substep count would otherwise only
+// show as NaN positions, an allocation failure building the grid or frames that never end
+static bool hasValidSettings(const CheckpointHeader& header)
+{
+	const Rect& b = header.bounds;
+	if(!std::isfinite(b.left) || !std::isfinite(b.top) || !std::isfinite(b.width) || !std::isfinite(b.height)
+			|| !(b.width > 0.0f) || !(b.height > 0.0f) || !std::isfinite(header.stepdt) || !(header.stepdt > 0.0f))
+		return false;
+	if(header.cellSize <= 0 || static_cast<double>(b.width / header.cellSize) * static_cast<double>(b.height / header.cellSize)
+			> static_cast<double>(CollisionGrid::maxCellCount))
+		return false;
+	if(header.subSteps <= 0 || header.subSteps > maxSubStepCount || header.minSubSteps <= 0
+			|| header.maxSubSteps < header.minSubSteps || header.maxSubSteps > maxSubStepCount)
+		return false;
+	// adaptive substepping moves the count within its range, otherwise it stays at the constructor's
+	if(header.substepAdaptive ? header.currentSubSteps < header.minSubSteps || header.currentSubSteps > header.maxSubSteps
+			: header.currentSubSteps != header.subSteps)
+		return false;
+	const float values[] = {
+		header.gravity.x, header.gravity.y, header.maxDisplacement, header.maxPenetration, header.maxLinkStretch,
+		header.sleepMotionThreshold, header.sleepContactMargin, header.neighborSkin
+	};
+	for(float value : values)
+		if(!std::isfinite(value))
+			return false;
+	return header.broadPhase <= static_cast<uint32_t>(BroadPhaseType::SpatialHash) && header.neighborSkin >= 0.0f;
+}
+
+static bool isValid(const CheckpointHeader& header, uint64_t fileSize)
+{
+	if(std::memcmp(header.magic, checkpointMagic, sizeof(header.magic)) != 0
+			|| header.version != Checkpoint::version || header.byteOrder != byteOrderMark)
+		return false;
+	const uint64_t particles = header.particleCount;
+	const uint64_t links = header.linkCount;
+	const uint64_t expectedSize[SECTION_COUNT] = {
+		particles * 4, particles * 4, particles * 4, particles * 4, particles * 4, particles * 4,
+		particles * 4, particles * 4, particles, particles * 2, particles * sizeof(Color),
+		links * 4, links * 4, links * 4, links * 4, links,
+		header.islandOfCount * 4ull, header.islandStartCount * 4ull, header.islandMemberCount * 4ull,
+		header.particleSlotCount * 4ull, particles * 8, header.linkSlotCount * 4ull, links * 8
+	};
+	for(int s = 0; s < SECTION_COUNT; s++)
+	{
+		if(header.sectionSize[s] != expectedSize[s] || header.sectionOffset[s] % sectionAlignment != 0
+				|| header.sectionOffset[s] > fileSize || header.sectionSize[s] > fileSize - header.sectionOffset[s])
+			return false;
+	}
+	return hasValidSettings(header);
+}
+
+// link ends index the particle arrays, a bad one would be written out of bounds when counting links
+static bool hasValidLinks(const char* data, const CheckpointHeader& header)
+{
+	const int32_t* first = reinterpret_cast<const int32_t*>(data + header.sectionOffset[SECTION_LINK_FIRST]);
+	const int32_t* second = reinterpret_cast<const int32_t*>(data + header.sectionOffset[SECTION_LINK_SECOND]);
+	for(uint32_t l = 0; l < header.linkCount; l++)
+	{
+		if(first[l] < 0 || second[l] < 0 || static_cast<uint32_t>(first[l]) >= header.particleCount
+				|| static_cast<uint32_t>(second[l]) >= header.particleCount)
+			return false;
+	}
+	return true;
+}
+
+// waking an island writes the flags of its members and removing a particle the island entries of its
+// island's members, bad island sections would send both out of bounds
+static bool hasValidIslands(const char* data, const CheckpointHeader& header)
+{
+	const uint32_t* islandOf = reinterpret_cast<const uint32_t*>(data + header.sectionOffset[SECTION_ISLAND_OF]);
+	const uint32_t* islandStart = reinterpret_cast<const uint32_t*>(data + header.sectionOffset[SECTION_ISLAND_START]);
+	const uint32_t* islandMembers = reinterpret_cast<const uint32_t*>(data + header.sectionOffset[SECTION_ISLAND_MEMBERS]);
+	if(header.islandOfCount > header.particleCount)
+		return false;
+	if(header.islandStartCount == 0)
+		return header.islandMemberCount == 0 && std::all_of(islandOf, islandOf + header.islandOfCount,
+				[](uint32_t island) { return island == SleepSystem::noIsland; });
+	const uint32_t islandCount = header.islandStartCount - 1;
+	for(uint32_t i = 0; i < header.islandOfCount; i++)
+		if(islandOf[i] != SleepSystem::noIsland && islandOf[i] >= islandCount)
+			return false;
+	for(uint32_t k = 0; k < islandCount; k++)
+		if(islandStart[k] > islandStart[k + 1])
+			return false;
+	if(islandStart[islandCount] != header.islandMemberCount)
+		return false;
+	for(uint32_t m = 0; m < header.islandMemberCount; m++)
+		if(islandMembers[m] >= header.islandOfCount)
+			return false;
+	return true;
+}
+
+// every handle must name a distinct slot at its current generation, or the slot table cannot be rebuilt
+template<typename Tag>
+static bool hasValidHandles(const char* data, const CheckpointHeader& header, int generationSection, int handleSection)
+{
+	const uint32_t* generations = reinterpret_cast<const uint32_t*>(data + header.sectionOffset[generationSection]);
+	const uint64_t slotCount = header.sectionSize[generationSection] / sizeof(uint32_t);
+	const uint64_t handleCount = header.sectionSize[handleSection] / sizeof(Handle<Tag>);
+	std::vector<bool> used(slotCount, false);
+	for(uint64_t i = 0; i < handleCount; i++)
+	{
+		Handle<Tag> handle;
+		std::memcpy(&handle, data + header.sectionOffset[handleSection] + i * sizeof(handle), sizeof(handle));
+		if(handle.slot >= slotCount || used[handle.slot] || generations[handle.slot] != handle.generation)
+			return false;
+		used[handle.slot] = true;
+	}
+	return true;
+}
+
+// maps the file read-only (reads it on platforms without mmap) and hands its bytes to apply
+template<typename Apply>
+static bool withMappedFile(const std::string& path, Apply apply)
+{
+#ifdef _WIN32
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if(!file)
+		return false;
+	std::vector<char> data(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	if(!file.read(data.data(), data.size()))
+		return false;
+	return apply(data.data(), static_cast<uint64_t>(data.size()));
+#else
+	const int file = ::open(path.c_str(), O_RDONLY);
+	if(file < 0)
+		return false;
+	struct stat info;
+	if(::fstat(file, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(CheckpointHeader)))
+	{
+		::close(file);
+		return false;
+	}
+	const size_t size = info.st_size;
+	void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if(mapping == MAP_FAILED)
+		return false;
+	::madvise(mapping, size, MADV_SEQUENTIAL);
+	::madvise(mapping, size, MADV_WILLNEED);
+	const bool ok = apply(static_cast<const char*>(mapping), static_cast<uint64_t>(size));
+	::munmap(mapping, size);
+	return ok;
+#endif
+}
+
+static bool readHeader(const char* data, uint64_t size, CheckpointHeader& header)
+{
+	if(size < sizeof(header))
+		return false;
+	std::memcpy(&header, data, sizeof(header));
+	return isValid(header, size) && hasValidLinks(data, header) && hasValidIslands(data, header)
+			&& hasValidHandles<ParticleTag>(data, header, SECTION_PARTICLE_GENERATIONS, SECTION_PARTICLE_HANDLES)
+			&& hasValidHandles<LinkTag>(data, header, SECTION_LINK_GENERATIONS, SECTION_LINK_HANDLES);
+}
+
+void Checkpoint::apply(Engine& engine, const char* data, const CheckpointHeader& header)
+{
+	engine.bounds = header.bounds;
+	engine.gravity = header.gravity;
+	engine.setGridCellSize(header.cellSize);
+	engine.frameCount = header.frameCount;
+	engine.reorderInterval = header.reorderInterval;
+	engine.sleepEnabled = header.sleepEnabled != 0;
+	engine.openBoundaries = header.openBoundaries;
+	engine.walls = header.walls;
+	engine.broadPhase = static_cast<BroadPhaseType>(header.broadPhase);
+	// the list itself is not saved, the first substep rebuilds it
+	engine.neighborSettings.enabled = header.neighborListEnabled != 0;
+	engine.neighborSettings.skin = header.neighborSkin;
+	engine.neighborList.invalidate();
+	engine.removalCount = header.removalCount;
+	engine.linkBatchesDirty = true;
+
+	SubstepSettings substepSettings;
+	substepSettings.adaptive = header.substepAdaptive != 0;
+	substepSettings.minSubSteps = header.minSubSteps;
+	substepSettings.maxSubSteps = header.maxSubSteps;
+	substepSettings.maxDisplacement = header.maxDisplacement;
+	substepSettings.maxPenetration = header.maxPenetration;
+	substepSettings.maxLinkStretch = header.maxLinkStretch;
+	substepSettings.framesToRelax = header.framesToRelax;
+	engine.substepSettings = substepSettings;
+	engine.substepStats = SubstepStats();
+	engine.relaxedFrames = header.relaxedFrames;
+	// the saved positions already hold velocities for this count, no rescaling
+	engine.subSteps = header.currentSubSteps;
+
+	ParticleStore& particles = engine.particles;
+	adoptSection(particles.x, data, header, SECTION_X);
+	adoptSection(particles.y, data, header, SECTION_Y);
+	adoptSection(particles.prevX, data, header, SECTION_PREV_X);
+	adoptSection(particles.prevY, data, header, SECTION_PREV_Y);
+	adoptSection(particles.accX, data, header, SECTION_ACC_X);
+	adoptSection(particles.accY, data, header, SECTION_ACC_Y);
+	adoptSection(particles.radius, data, header, SECTION_RADIUS);
+	adoptSection(particles.rigidness, data, header, SECTION_RIGIDNESS);
+	adoptSection(particles.flags, data, header, SECTION_FLAGS);
+	adoptSection(particles.stillFrames, data, header, SECTION_STILL_FRAMES);
+	adoptSection(particles.colors, data, header, SECTION_COLORS);
+	particles.refreshSummary();
+
+	const int32_t* first = reinterpret_cast<const int32_t*>(data + header.sectionOffset[SECTION_LINK_FIRST]);
+	const int32_t* second = reinterpret_cast<const int32_t*>(data + header.sectionOffset[SECTION_LINK_SECOND]);
+	const float* restLength = reinterpret_cast<const float*>(data + header.sectionOffset[SECTION_LINK_REST_LENGTH]);
+	const float* stiffness = reinterpret_cast<const float*>(data + header.sectionOffset[SECTION_LINK_STIFFNESS]);
+	const uint8_t* spring = reinterpret_cast<const uint8_t*>(data + header.sectionOffset[SECTION_LINK_SPRING]);
+	std::vector<Link>& links = engine.links;
+	links.clear();
+	links.reserve(header.linkCount);
+	for(uint32_t l = 0; l < header.linkCount; l++)
+		links.emplace_back(first[l], second[l], restLength[l], stiffness[l], spring[l] != 0);
+	engine.linkAdjacency.build(links, header.particleCount);
+
+	adoptSection(engine.particleHandles.slotGeneration, data, header, SECTION_PARTICLE_GENERATIONS);
+	adoptSection(engine.particleHandles.handles, data, header, SECTION_PARTICLE_HANDLES);
+	engine.particleHandles.rebuildSlots();
+	adoptSection(engine.linkHandles.slotGeneration, data, header, SECTION_LINK_GENERATIONS);
+	adoptSection(engine.linkHandles.handles, data, header, SECTION_LINK_HANDLES);
+	engine.linkHandles.rebuildSlots();
+
+	SleepSystem& sleep = engine.sleepSystem;
+	SleepSettings settings;
+	settings.motionThreshold = header.sleepMotionThreshold;
+	settings.framesToSleep = header.sleepFramesToSleep;
+	settings.contactMargin = header.sleepContactMargin;
+	sleep.setSettings(settings);
+	adoptSection(sleep.islandOf, data, header, SECTION_ISLAND_OF);
+	adoptSection(sleep.islandStart, data, header, SECTION_ISLAND_START);
+	adoptSection(sleep.islandMembers, data, header, SECTION_ISLAND_MEMBERS);
+	sleep.sleepingCount = 0;
+	for(uint8_t flags : particles.flags)
+		sleep.sleepingCount += (flags & PARTICLE_SLEEPING) != 0;
+}
+
+bool Checkpoint::restore(Engine& engine, const std::string& path)
+{
+	return withMappedFile(path, [&](const char* data, uint64_t size)
+	{
+		CheckpointHeader header;
+		if(!readHeader(data, size, header) || header.stepdt != engine.stepdt || header.subSteps != engine.baseSubSteps)
+			return false;
+		apply(engine, data, header);
+		return true;
+	});
+}
+
+std::unique_ptr<Engine> Checkpoint::load(const std::string& path, uint32_t threadCount)
+{
+	std::unique_ptr<Engine> engine;
+	withMappedFile(path, [&](const char* data, uint64_t size)
+	{
+		CheckpointHeader header;
+		if(!readHeader(data, size, header))
+			return false;
+		engine = std::make_unique<Engine>(header.bounds, header.stepdt, header.subSteps, header.cellSize, threadCount);
+		apply(*engine, data, header);
+		return true;
+	});
+	return engine;
+}
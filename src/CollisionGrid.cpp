@@ -0,0 +1,119 @@
+#include <algorithm>
+
+#include "CollisionGrid.hpp"
+
+void CollisionGrid::resize(uint32_t width, uint32_t height, int cellSize)
+{
+	this->width = std::max(width, 1u);
+	this->height = std::max(height, 1u);
+	this->cellSize = std::max(cellSize, 1);
+	cellStart.assign(getCellCount() + 1, 0);
+	stats = CollisionGridStats();
+}
+
+void CollisionGrid::clear()
+{
+	std::fill(cellStart.begin(), cellStart.end(), 0);
+	cellObjects.clear();
+	objectCell.clear();
+	stats = CollisionGridStats();
+}
+
+uint32_t CollisionGrid::getCellIndex(float x, float y) const
+{
+	int cellX = static_cast<int>(x) / cellSize;
+	int cellY = static_cast<int>(y) / cellSize;
+	cellX = std::min(std::max(cellX, 0), static_cast<int>(width) - 1);
+	cellY = std::min(std::max(cellY, 0), static_cast<int>(height) - 1);
+	return cellX + cellY * width;
+}
+
+CellRange CollisionGrid::getCellRange(float minX, float minY, float maxX, float maxY) const
+{
+	const uint32_t minCell = getCellIndex(minX, minY);
+	const uint32_t maxCell = getCellIndex(maxX, maxY);
+	return {minCell % width, minCell / width, maxCell % width, maxCell / width};
+}
+
+void CollisionGrid::build(const float* x, const float* y, uint32_t count)
+{
+	build(x, y, nullptr, count);
+}
+
+void CollisionGrid::build(const float* x, const float* y, const uint32_t* ids, uint32_t count)
+{
+	const uint32_t cellCount = getCellCount();
+	stats = CollisionGridStats();
+	objectCell.resize(count);
+	cellObjects.resize(count);
+	std::fill(cellStart.begin(), cellStart.end(), 0);
+
+	// count objects per cell
+	const float gridWidth = static_cast<float>(width * cellSize);
+	const float gridHeight = static_cast<float>(height * cellSize);
+	for(uint32_t k = 0; k < count; k++)
+	{
+		const uint32_t i = ids ? ids[k] : k;
+		if(!(x[i] >= 0.0f && x[i] < gridWidth && y[i] >= 0.0f && y[i] < gridHeight))
+			stats.clampedObjects++;
+		const uint32_t cellIndex = getCellIndex(x[i], y[i]);
+		objectCell[k] = cellIndex;
+		cellStart[cellIndex]++;
+	}
+
+	// inclusive prefix sum, cellStart[c] now points one past the end of cell c
+	uint32_t sum = 0;
+	for(uint32_t c = 0; c < cellCount; c++)
+	{
+		const uint32_t cellObjCount = cellStart[c];
+		if(cellObjCount > 0)
+			stats.occupiedCells++;
+		stats.maxCellOccupancy = std::max(stats.maxCellOccupancy, cellObjCount);
+		sum += cellObjCount;
+		cellStart[c] = sum;
+	}
+	cellStart[cellCount] = sum;
+
+	// scatter backwards so that every cellStart[c] ends up at the beginning of its cell
+	// and ids stay in ascending order inside each cell
+	for(uint32_t k = count; k-- > 0;)
+		cellObjects[--cellStart[objectCell[k]]] = ids ? ids[k] : k;
+
+	stats.insertedObjects = sum;
+}
+
+void CollisionGrid::build(const std::vector<CellRange>& ranges)
+{
+	const uint32_t cellCount = getCellCount();
+	const uint32_t count = ranges.size();
+	stats = CollisionGridStats();
+	std::fill(cellStart.begin(), cellStart.end(), 0);
+
+	for(const CellRange& range : ranges)
+		for(uint32_t y = range.minY; y <= range.maxY; y++)
+			for(uint32_t x = range.minX; x <= range.maxX; x++)
+				cellStart[x + y * width]++;
+
+	uint32_t sum = 0;
+	for(uint32_t c = 0; c < cellCount; c++)
+	{
+		const uint32_t cellObjCount = cellStart[c];
+		if(cellObjCount > 0)
+			stats.occupiedCells++;
+		stats.maxCellOccupancy = std::max(stats.maxCellOccupancy, cellObjCount);
+		sum += cellObjCount;
+		cellStart[c] = sum;
+	}
+	cellStart[cellCount] = sum;
+
+	cellObjects.resize(sum);
+	for(uint32_t i = count; i-- > 0;)
+	{
+		const CellRange& range = ranges[i];
+		for(uint32_t y = range.minY; y <= range.maxY; y++)
+			for(uint32_t x = range.minX; x <= range.maxX; x++)
+				cellObjects[--cellStart[x + y * width]] = i;
+	}
+
+	stats.insertedObjects = count;
+}
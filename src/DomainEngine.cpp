@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#include "DomainEngine.hpp"
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+DomainEngine::DomainEngine(Rect bounds, float stepdt, int subSteps, float cellSize, DomainTransport& transport, uint32_t threadCount)
+: transport(transport), engine(bounds, stepdt / subSteps, 1, cellSize, threadCount), subSteps(subSteps)
+{
+	const uint32_t rank = transport.getRank();
+	const uint32_t size = transport.getSize();
+	const float infinity = std::numeric_limits<float>::infinity();
+	slabLeft = rank > 0 ? bounds.left + bounds.width * rank / size : -infinity;
+	slabRight = rank + 1 < size ? bounds.left + bounds.width * (rank + 1) / size : infinity;
+	// the sparse grid only spends time and memory on the cells of the slab and its halo, the dense one on all of bounds
+	engine.setBroadPhase(BroadPhaseType::SpatialHash);
+}
+
+uint32_t DomainEngine::addObject(const VerletObject& obj)
+{
+	const float x = obj.getPosition().x;
+	if(x >= slabLeft && x < slabRight)
+	{
+		engine.addObject(obj);
+		globalIds.push_back(globalCount);
+	}
+	maxRadius = std::max(maxRadius, obj.getRadius());
+	return globalCount++;
+}
+
+uint32_t DomainEngine::addLink(const Link& link)
+{
+	links.push_back(link);
+	linksDirty = true;
+	maxRestLength = std::max(maxRestLength, link.getRestLength());
+	return links.size() - 1;
+}
+
+void DomainEngine::buildParticleLinks()
+{
+	linkStart.assign(globalCount + 1, 0);
+	for(const Link& link : links)
+	{
+		linkStart[link.getFirst() + 1]++;
+		linkStart[link.getSecond() + 1]++;
+	}
+	for(uint32_t i = 0; i < globalCount; i++)
+		linkStart[i + 1] += linkStart[i];
+	linkIds.resize(linkStart[globalCount]);
+	std::vector<uint32_t> fill(linkStart.begin(), linkStart.end() - 1);
+	for(uint32_t l = 0; l < links.size(); l++)
+	{
+		linkIds[fill[links[l].getFirst()]++] = l;
+		linkIds[fill[links[l].getSecond()]++] = l;
+	}
+	linksDirty = false;
+}
+
+bool DomainEngine::update()
+{
+	if(linksDirty)
+		buildParticleLinks();
+	localIndex.resize(globalCount, noIndex);
+	if(reorderInterval > 0 && frameCount % reorderInterval == 0)
+		reorderOwned();
+	frameCount++;
+	for(int s = 0; s < subSteps; s++)
+	{
+		if(!exchangeHalo())
+			return false;
+		const auto start = std::chrono::steady_clock::now();
+		engine.update();
+		timings.simulation += secondsSince(start);
+		dropGhosts();
+	}
+	return true;
+}
+
+DomainParticle DomainEngine::pack(uint32_t index, uint32_t id) const
+{
+	const ParticleStore& particles = engine.getParticles();
+	DomainParticle particle;
+	particle.id = id;
+	particle.x = particles.x[index];
+	particle.y = particles.y[index];
+	particle.prevX = particles.prevX[index];
+	particle.prevY = particles.prevY[index];
+	particle.radius = particles.radius[index];
+	particle.rigidness = particles.rigidness[index];
+	particle.flags = particles.flags[index];
+	particle.color = particles.colors[index];
+	return particle;
+}
+
+void DomainEngine::addParticle(const DomainParticle& particle)
+{
+	VerletObject obj(Vec2(particle.x, particle.y), particle.radius, particle.rigidness, particle.flags & PARTICLE_FIXED);
+	obj.setPrevPosition(Vec2(particle.prevX, particle.prevY));
+	obj.setColor(particle.color);
+	localIndex[particle.id] = engine.addObject(obj);
+}
+
+bool DomainEngine::exchangeHalo()
+{
+	const auto start = std::chrono::steady_clock::now();
+	const ParticleStore& particles = engine.getParticles();
+	const uint32_t rank = transport.getRank();
+	const bool hasNeighbor[2] = {rank > 0, rank + 1 < transport.getSize()};
+	for(int side = 0; side < 2; side++)
+		outgoing[side].clear();
+
+	// particles that left the slab go to the neighbour on that side, one slab per substep
+	for(uint32_t i = globalIds.size(); i-- > 0;)
+	{
+		const float x = particles.x[i];
+		if(!(x < slabLeft || x >= slabRight))
+			continue;
+		outgoing[x < slabLeft ? 0 : 1].push_back(pack(i, globalIds[i]));
+		engine.removeObject(i);
+		globalIds[i] = globalIds.back();
+		globalIds.pop_back();
+	}
+	for(int side = 0; side < 2; side++)
+	{
+		outgoingMigrants[side] = outgoing[side].size();
+		timings.migrated += outgoing[side].size();
+	}
+	const uint32_t owned = globalIds.size();
+	for(uint32_t i = 0; i < owned; i++)
+		localIndex[globalIds[i]] = i;
+
+	// halo: what a neighbour's particles can touch, and the ends of links the neighbour holds the other end of
+	const float halo = getHaloWidth();
+	for(uint32_t i = 0; i < owned; i++)
+	{
+		const uint32_t id = globalIds[i];
+		bool linkedAway = false;
+		for(uint32_t k = linkStart[id]; k < linkStart[id + 1] && !linkedAway; k++)
+		{
+			const Link& link = links[linkIds[k]];
+			const uint32_t other = link.getFirst() == static_cast<int>(id) ? link.getSecond() : link.getFirst();
+			linkedAway = localIndex[other] == noIndex;
+		}
+		const float x = particles.x[i];
+		if(hasNeighbor[0] && (linkedAway || x < slabLeft + halo))
+			outgoing[0].push_back(pack(i, id));
+		if(hasNeighbor[1] && (linkedAway || x >= slabRight - halo))
+			outgoing[1].push_back(pack(i, id));
+	}
+
+	// even ranks talk to the right first and odd ones to the left, so that both ends of every pair meet
+	for(int turn = 0; turn < 2; turn++)
+	{
+		const int side = (rank % 2 == 0) == (turn == 0) ? 1 : 0;
+		if(!hasNeighbor[side])
+			continue;
+		std::vector<char>& out = sendBuffer[side];
+		out.resize(sizeof(uint32_t) + outgoing[side].size() * sizeof(DomainParticle));
+		std::memcpy(out.data(), &outgoingMigrants[side], sizeof(uint32_t));
+		if(!outgoing[side].empty())
+			std::memcpy(out.data() + sizeof(uint32_t), outgoing[side].data(), outgoing[side].size() * sizeof(DomainParticle));
+		if(!transport.exchange(side == 0 ? rank - 1 : rank + 1, out, receiveBuffer[side]))
+			return false;
+	}
+
+	// arrivals join the owned particles, then the ghosts follow: the migrants this rank just sent, the neighbours' halo
+	std::vector<DomainParticle> incoming[2];
+	uint32_t incomingMigrants[2] = {};
+	for(int side = 0; side < 2; side++)
+	{
+		const std::vector<char>& in = receiveBuffer[side];
+		if(!hasNeighbor[side] || in.size() < sizeof(uint32_t))
+			continue;
+		std::memcpy(&incomingMigrants[side], in.data(), sizeof(uint32_t));
+		incoming[side].resize((in.size() - sizeof(uint32_t)) / sizeof(DomainParticle));
+		if(!incoming[side].empty())
+			std::memcpy(incoming[side].data(), in.data() + sizeof(uint32_t), incoming[side].size() * sizeof(DomainParticle));
+		incomingMigrants[side] = std::min<uint32_t>(incomingMigrants[side], incoming[side].size());
+	}
+	for(int side = 0; side < 2; side++)
+	{
+		for(uint32_t k = 0; k < incomingMigrants[side]; k++)
+		{
+			addParticle(incoming[side][k]);
+			globalIds.push_back(incoming[side][k].id);
+		}
+	}
+	for(int side = 0; side < 2; side++)
+	{
+		for(uint32_t k = 0; k < outgoingMigrants[side]; k++)
+		{
+			addParticle(outgoing[side][k]);
+			ghostIds.push_back(outgoing[side][k].id);
+		}
+		for(uint32_t k = incomingMigrants[side]; k < incoming[side].size(); k++)
+		{
+			addParticle(incoming[side][k]);
+			ghostIds.push_back(incoming[side][k].id);
+		}
+	}
+	timings.ghosts += ghostIds.size();
+
+	// every link with both ends present, ghost to ghost ones included so that owned particles collide with them,
+	// in global order like a single engine would hold them
+	localLinks.clear();
+	auto collectLinks = [&](uint32_t id)
+	{
+		for(uint32_t k = linkStart[id]; k < linkStart[id + 1]; k++)
+		{
+			const Link& link = links[linkIds[k]];
+			if(link.getFirst() == static_cast<int>(id) && localIndex[link.getSecond()] != noIndex)
+				localLinks.push_back(linkIds[k]);
+		}
+	};
+	for(uint32_t id : globalIds)
+		collectLinks(id);
+	for(uint32_t id : ghostIds)
+		collectLinks(id);
+	std::sort(localLinks.begin(), localLinks.end());
+	for(uint32_t l : localLinks)
+	{
+		const Link& link = links[l];
+		engine.addLink(Link(localIndex[link.getFirst()], localIndex[link.getSecond()], link.getRestLength(), link.getStiffness(), link.isSpring()));
+	}
+	timings.exchange += secondsSince(start);
+	return true;
+}
+
+void DomainEngine::dropGhosts()
+{
+	const auto start = std::chrono::steady_clock::now();
+	// links first, particles without links are removed without scanning them
+	for(uint32_t l = engine.getLinks().size(); l-- > 0;)
+		engine.removeLink(l);
+	for(uint32_t g = ghostIds.size(); g-- > 0;)
+	{
+		engine.removeObject(globalIds.size() + g);
+		localIndex[ghostIds[g]] = noIndex;
+	}
+	ghostIds.clear();
+	for(uint32_t id : globalIds)
+		localIndex[id] = noIndex;
+	timings.exchange += secondsSince(start);
+}
+
+void DomainEngine::reorderOwned()
+{
+	engine.reorderParticles();
+	const std::vector<uint32_t>& map = engine.getReorderMap();
+	std::vector<uint32_t> reordered(globalIds.size());
+	for(uint32_t i = 0; i < globalIds.size(); i++)
+		reordered[map[i]] = globalIds[i];
+	globalIds.swap(reordered);
+}
+
+uint64_t DomainEngine::getFrameCount() const
+{
+	return frameCount;
+}
+
+uint32_t DomainEngine::getRank() const
+{
+	return transport.getRank();
+}
+
+uint32_t DomainEngine::getOwnedCount() const
+{
+	return globalIds.size();
+}
+
+uint32_t DomainEngine::getGlobalObjectCount() const
+{
+	return globalCount;
+}
+
+uint32_t DomainEngine::getGlobalId(uint32_t index) const
+{
+	return globalIds[index];
+}
+
+void DomainEngine::setHaloWidth(float width)
+{
+	haloWidth = std::max(width, 0.0f);
+}
+
+float DomainEngine::getHaloWidth() const
+{
+	return haloWidth > 0.0f ? haloWidth : 2.0f * maxRadius + maxRestLength;
+}
+
+void DomainEngine::setGravity(Vec2 gravity)
+{
+	engine.setGravity(gravity);
+}
+
+void DomainEngine::setReorderInterval(uint32_t frames)
+{
+	reorderInterval = frames;
+}
+
+Engine& DomainEngine::getEngine()
+{
+	return engine;
+}
+
+const Engine& DomainEngine::getEngine() const
+{
+	return engine;
+}
+
+bool DomainEngine::gatherParticles(std::vector<DomainParticle>& particles)
+{
+	particles.clear();
+	const uint32_t rank = transport.getRank();
+	std::vector<DomainParticle> owned;
+	owned.reserve(globalIds.size());
+	for(uint32_t i = 0; i < globalIds.size(); i++)
+		owned.push_back(pack(i, globalIds[i]));
+	std::vector<char> out;
+	std::vector<char> in;
+	if(rank != 0)
+	{
+		out.resize(owned.size() * sizeof(DomainParticle));
+		if(!owned.empty())
+			std::memcpy(out.data(), owned.data(), out.size());
+		return transport.exchange(0, out, in);
+	}
+	particles = owned;
+	for(uint32_t r = 1; r < transport.getSize(); r++)
+	{
+		if(!transport.exchange(r, out, in))
+			return false;
+		const uint32_t count = in.size() / sizeof(DomainParticle);
+		particles.resize(particles.size() + count);
+		if(count > 0)
+			std::memcpy(particles.data() + particles.size() - count, in.data(), count * sizeof(DomainParticle));
+	}
+	std::sort(particles.begin(), particles.end(), [](const DomainParticle& a, const DomainParticle& b)
+	{
+		return a.id < b.id;
+	});
+	return true;
+}
+
+const DomainTimings& DomainEngine::getTimings() const
+{
+	return timings;
+}
+
+void DomainEngine::resetTimings()
+{
+	timings = DomainTimings();
+}
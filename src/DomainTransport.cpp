@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#ifndef _WIN32
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <unistd.h>
+	#include <sys/socket.h>
+	#include <sys/wait.h>
+#endif
+
+#include "DomainTransport.hpp"
+
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL 0
+#endif
+
+SocketTransport::SocketTransport(uint32_t rank, std::vector<int> sockets, std::vector<int> children)
+: rank(rank), sockets(std::move(sockets)), children(std::move(children))
+{}
+
+SocketTransport::~SocketTransport()
+{
+	waitForPeers();
+}
+
+uint32_t SocketTransport::getRank() const
+{
+	return rank;
+}
+
+uint32_t SocketTransport::getSize() const
+{
+	return sockets.size();
+}
+
+#ifdef _WIN32
+
+std::unique_ptr<SocketTransport> SocketTransport::spawn(uint32_t)
+{
+	return nullptr;
+}
+
+bool SocketTransport::waitForPeers()
+{
+	return true;
+}
+
+bool SocketTransport::exchange(uint32_t, const std::vector<char>&, std::vector<char>&)
+{
+	return false;
+}
+
+#else
+
+std::unique_ptr<SocketTransport> SocketTransport::spawn(uint32_t processes)
+{
+	if(processes == 0)
+		return nullptr;
+	// pairSockets[i * processes + j] is the end rank i holds of the socket between i and j
+	std::vector<int> pairSockets(processes * processes, -1);
+	auto closeAll = [&](uint32_t keep)
+	{
+		for(uint32_t i = 0; i < processes; i++)
+			for(uint32_t j = 0; j < processes; j++)
+				if(i != keep && pairSockets[i * processes + j] >= 0)
+					close(pairSockets[i * processes + j]);
+	};
+	for(uint32_t i = 0; i < processes; i++)
+	{
+		for(uint32_t j = i + 1; j < processes; j++)
+		{
+			int pair[2];
+			if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+			{
+				closeAll(processes);
+				return nullptr;
+			}
+			pairSockets[i * processes + j] = pair[0];
+			pairSockets[j * processes + i] = pair[1];
+		}
+	}
+	// buffered output would be written once by every process
+	std::fflush(nullptr);
+	std::vector<int> children;
+	uint32_t rank = 0;
+	for(uint32_t r = 1; r < processes; r++)
+	{
+		const pid_t child = fork();
+		if(child < 0)
+		{
+			// the children forked so far see their sockets close and fail their first exchange
+			closeAll(processes);
+			for(int pid : children)
+				waitpid(pid, nullptr, 0);
+			return nullptr;
+		}
+		if(child == 0)
+		{
+			rank = r;
+			children.clear();
+			break;
+		}
+		children.push_back(child);
+	}
+	closeAll(rank);
+	std::vector<int> sockets(pairSockets.begin() + rank * processes, pairSockets.begin() + (rank + 1) * processes);
+	for(int socket : sockets)
+		if(socket >= 0)
+			fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+	return std::unique_ptr<SocketTransport>(new SocketTransport(rank, std::move(sockets), std::move(children)));
+}
+
+bool SocketTransport::waitForPeers()
+{
+	for(int& socket : sockets)
+	{
+		if(socket >= 0)
+			close(socket);
+		socket = -1;
+	}
+	bool success = true;
+	for(int pid : children)
+	{
+		int status = 0;
+		success = waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 && success;
+	}
+	children.clear();
+	return success;
+}
+
+bool SocketTransport::exchange(uint32_t peer, const std::vector<char>& out, std::vector<char>& in)
+{
+	if(peer >= sockets.size() || sockets[peer] < 0)
+		return false;
+	const int socket = sockets[peer];
+	uint64_t outHeader = out.size();
+	uint64_t inHeader = 0;
+	const size_t outTotal = sizeof(outHeader) + out.size();
+	size_t sent = 0;
+	size_t received = 0;
+	size_t inTotal = sizeof(inHeader); // grows to the whole message once the header is in
+	while(sent < outTotal || received < inTotal)
+	{
+		pollfd poller = {socket, static_cast<short>((sent < outTotal ? POLLOUT : 0) | (received < inTotal ? POLLIN : 0)), 0};
+		if(poll(&poller, 1, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		// a peer that hung up with data left still reads as POLLIN until recv returns 0
+		if((poller.revents & (POLLERR | POLLNVAL)) || (poller.revents & (POLLHUP | POLLIN)) == POLLHUP)
+			return false;
+		if(sent < outTotal && (poller.revents & POLLOUT))
+		{
+			const bool header = sent < sizeof(outHeader);
+			const char* data = header ? reinterpret_cast<const char*>(&outHeader) + sent : out.data() + (sent - sizeof(outHeader));
+			const size_t size = header ? sizeof(outHeader) - sent : outTotal - sent;
+			const ssize_t count = send(socket, data, size, MSG_NOSIGNAL);
+			if(count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				return false;
+			sent += count > 0 ? count : 0;
+		}
+		if(received < inTotal && (poller.revents & POLLIN))
+		{
+			const bool header = received < sizeof(inHeader);
+			char* data = header ? reinterpret_cast<char*>(&inHeader) + received : in.data() + (received - sizeof(inHeader));
+			const size_t size = header ? sizeof(inHeader) - received : inTotal - received;
+			const ssize_t count = recv(socket, data, size, 0);
+			if(count == 0)
+				return false;
+			if(count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				return false;
+			received += count > 0 ? count : 0;
+			if(header && received == sizeof(inHeader))
+			{
+				in.resize(inHeader);
+				inTotal += inHeader;
+			}
+		}
+	}
+	return true;
+}
+
+#endif
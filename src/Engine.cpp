@@ -1,69 +1,540 @@
-#include <SFML/Graphics.hpp>
-
 #include "Engine.hpp"
 
-Engine::Engine(sf::FloatRect bounds, float stepdt, int subSteps, float cellSize)
-: bounds(bounds), stepdt(stepdt), subSteps(subSteps)
+Engine::Engine(Rect bounds, float stepdt, int subSteps, float cellSize, uint32_t threadCount)
+: bounds(bounds), stepdt(stepdt), baseSubSteps(subSteps), subSteps(subSteps), threadPool(std::max(threadCount, 1u)),
+  narrowPhaseType(detectNarrowPhaseKernel()), narrowPhaseKernel(::getNarrowPhaseKernel(narrowPhaseType))
 {
-	grid.width = bounds.width / cellSize;
-	grid.height = bounds.height / cellSize;
-	grid.cellSize = cellSize;
-	grid.cells.resize(grid.width * grid.height);
+	setGridCellSize(cellSize);
 }
 
 void Engine::update()
 {
+	PHYSENG_PROFILE_SCOPE("update");
+	if(reorderInterval > 0 && frameCount % reorderInterval == 0)
+	{
+		PHYSENG_PROFILE_SCOPE("reorder");
+		reorderParticles();
+	}
+	frameCount++;
+	// particles only fall asleep after the substeps and fixed ones are only added between frames,
+	// so the features seen here hold for the whole frame (waking particles just leaves the general path on)
+	const bool sleeping = sleepSystem.getSleepingCount() > 0;
+	const bool immovable = sleeping || particles.fixedCount > 0;
+	NarrowPhasePolicy policy;
+	policy.immovable = immovable;
+	policy.variableRadius = !particles.hasUniformRadius();
+	policy.variableRigidness = !particles.hasUniformRigidness();
+	narrowPhaseKernel = ::getNarrowPhaseKernel(narrowPhaseType, policy);
+	framePenetration = 0.0f;
+	gridCurrent = false;
+	queryGridCurrent = false;
 	float subdt = getTimeSubstep();
-	for(uint8_t i = 0; i < subSteps; i++)
+	for(int i = 0; i < subSteps; i++)
+	{
+		if(sleeping)
+			solveSubstep<true, true>(subdt);
+		else if(immovable)
+			solveSubstep<true, false>(subdt);
+		else
+			solveSubstep<false, false>(subdt);
+	}
+	if(sleepEnabled)
+	{
+		// the neighbour list may have left the grid frames behind, islands need the current contacts
+		if(broadPhase == BroadPhaseType::SpatialHash)
+			runPhase("sleep", timings.sleep, [&]
+			{
+				if(!gridCurrent)
+					populateGrid(sparseGrid);
+				sleepSystem.update(particles, sparseGrid, links);
+			});
+		else
+			runPhase("sleep", timings.sleep, [&]
+			{
+				if(!gridCurrent)
+					populateGrid(grid);
+				sleepSystem.update(particles, grid, links);
+			});
+	}
+	// last, the sleep update still needs the indices the grid was built with
+	if(openBoundaries)
+		removeEscapedObjects();
+	if(timingEnabled)
+		timings.substeps += subSteps;
+	if(substepSettings.adaptive)
+		chooseSubSteps();
+}
+
+void Engine::chooseSubSteps()
+{
+	SubstepStats& stats = substepStats;
+	measureSubstepMetrics(stats.displacement, stats.linkStretch);
+	stats.penetration = framePenetration;
+	// displacement shrinks in proportion to the substep length; overlap and stretch are mostly the resting
+	// load of stacks and hanging chains, which goes with the square of it. Each metric asks for the current
+	// count scaled by how far it is from its target under that law
+	const SubstepSettings& settings = substepSettings;
+	const float maxCount = static_cast<float>(settings.maxSubSteps);
+	const float shrink = subSteps > 1 ? static_cast<float>(subSteps) / (subSteps - 1) : maxCount;
+	int required = settings.minSubSteps;
+	bool relaxed = true;
+	stats.reasons = 0;
+	auto demand = [&](float value, float target, bool quadratic, SubstepReason reason)
+	{
+		const float ratio = value / target;
+		const float wanted = std::ceil(subSteps * (quadratic ? std::sqrt(ratio) : ratio));
+		if(wanted > maxCount)
+			stats.reasons |= SUBSTEP_CLAMPED;
+		const int count = static_cast<int>(std::min(wanted, maxCount));
+		if(count > settings.minSubSteps)
+			stats.reasons |= reason;
+		required = std::max(required, count);
+		// dropping a substep must leave room below the target, or the next frame asks for it back
+		relaxed = relaxed && ratio * (quadratic ? shrink * shrink : shrink) < relaxMargin;
+	};
+	demand(stats.displacement, settings.maxDisplacement, false, SUBSTEP_DISPLACEMENT);
+	demand(stats.penetration, settings.maxPenetration, true, SUBSTEP_PENETRATION);
+	demand(stats.linkStretch, settings.maxLinkStretch, true, SUBSTEP_LINK_STRETCH);
+	// grow at once, shrink by one substep after a run of calm frames: the resting overlap of a pile depends on
+	// the substep length, so every change shakes it a little and shrinking on the first calm frame oscillates
+	relaxedFrames = relaxed ? relaxedFrames + 1 : 0;
+	stats.subSteps = subSteps;
+	if(required > subSteps)
+		stats.subSteps = required;
+	else if(relaxedFrames >= settings.framesToRelax && subSteps > settings.minSubSteps)
 	{
-		applyGravity();
-		solveCollisions();
-		solveObjectLinkCollisions();
-		solveLinkConstraints();
-		solveBoundaryConstraints();
-		updatePositions(subdt);
+		stats.subSteps = subSteps - 1;
+		relaxedFrames = 0;
 	}
+	setSubStepCount(stats.subSteps);
+}
+
+uint64_t Engine::getFrameCount() const
+{
+	return frameCount;
+}
+
+uint32_t Engine::addObject(const VerletObject& obj)
+{
+	neighborList.invalidate();
+	queryGridCurrent = false;
+	particleHandles.add();
+	linkAdjacency.addParticle();
+	return particles.add(obj);
+}
+
+ParticleView Engine::getObject(uint32_t index)
+{
+	// the view may move the particle
+	queryGridCurrent = false;
+	return ParticleView(particles, index);
+}
+
+uint32_t Engine::getObjectCount() const
+{
+	return particles.size();
+}
+
+const ParticleStore& Engine::getParticles() const
+{
+	return particles;
 }
 
-std::vector<VerletObject>& Engine::getObjects()
+uint32_t Engine::addLink(const Link& link)
 {
-	return objects;
+	links.push_back(link);
+	linkHandles.add();
+	linkAdjacency.addLink(link);
+	queryGridCurrent = false;
+	linkBatchesDirty = true;
+	// a new link pulls on both ends, they must be able to move
+	sleepSystem.wake(particles, link.getFirst());
+	sleepSystem.wake(particles, link.getSecond());
+	return links.size() - 1;
 }
 
-std::vector<Link>& Engine::getLinks()
+const std::vector<Link>& Engine::getLinks() const
 {
 	return links;
 }
 
-//void Engine::addObject(VerletObject o)
-//{
-//	objects.push_back(o);
-//}
+ParticleHandle Engine::getObjectHandle(uint32_t index) const
+{
+	return particleHandles.getHandle(index);
+}
+
+const std::vector<ParticleHandle>& Engine::getObjectHandles() const
+{
+	return particleHandles.getHandles();
+}
+
+bool Engine::isValid(ParticleHandle handle) const
+{
+	return particleHandles.isValid(handle);
+}
+
+uint32_t Engine::getObjectIndex(ParticleHandle handle) const
+{
+	return particleHandles.getIndex(handle);
+}
+
+LinkHandle Engine::getLinkHandle(uint32_t index) const
+{
+	return linkHandles.getHandle(index);
+}
+
+bool Engine::isValid(LinkHandle handle) const
+{
+	return linkHandles.isValid(handle);
+}
+
+uint32_t Engine::getLinkIndex(LinkHandle handle) const
+{
+	return linkHandles.getIndex(handle);
+}
+
+void Engine::removeObject(uint32_t index)
+{
+	const uint32_t last = particles.size() - 1;
+	// links of the removed particle go, links of the last particle follow it to its new index.
+	// Both are found through the adjacency, so the cost is their count and not that of every link
+	while(linkAdjacency.head[index] != LinkAdjacency::noEnd)
+		removeLink(linkAdjacency.head[index] / 2);
+	if(linkAdjacency.head[last] != LinkAdjacency::noEnd)
+	{
+		linkAdjacency.forEachLink(last, [&](uint32_t l, uint32_t end)
+		{
+			if(end == 0)
+				links[l].setFirst(index);
+			else
+				links[l].setSecond(index);
+		});
+		linkBatchesDirty = true;
+	}
+	linkAdjacency.removeParticleSwap(index);
+	sleepSystem.remove(particles, index);
+	neighborList.invalidate();
+	queryGridCurrent = false;
+	particles.removeSwap(index);
+	particleHandles.removeSwap(index);
+	removalCount++;
+}
+
+void Engine::removeObject(ParticleHandle handle)
+{
+	if(particleHandles.isValid(handle))
+		removeObject(particleHandles.getIndex(handle));
+}
+
+void Engine::removeLink(uint32_t index)
+{
+	const uint32_t first = links[index].getFirst();
+	const uint32_t second = links[index].getSecond();
+	// whatever the link held up has to be able to fall
+	sleepSystem.wake(particles, first);
+	sleepSystem.wake(particles, second);
+	linkAdjacency.removeLinkSwap(links, index);
+	links[index] = links.back();
+	links.pop_back();
+	linkHandles.removeSwap(index);
+	linkBatchesDirty = true;
+	queryGridCurrent = false;
+	removalCount++;
+}
+
+void Engine::removeLink(LinkHandle handle)
+{
+	if(linkHandles.isValid(handle))
+		removeLink(linkHandles.getIndex(handle));
+}
+
+uint64_t Engine::getRemovalCount() const
+{
+	return removalCount;
+}
+
+void Engine::setOpenBoundaries(uint8_t sides)
+{
+	openBoundaries = sides;
+}
+
+uint8_t Engine::getOpenBoundaries() const
+{
+	return openBoundaries;
+}
+
+void Engine::setWalls(uint8_t sides)
+{
+	walls = sides & BOUNDARY_ALL;
+}
+
+uint8_t Engine::getWalls() const
+{
+	return walls;
+}
 
 float Engine::getTimeStep()
 {
 	return stepdt;
 }
 
+int Engine::getSubStepCount() const
+{
+	return subSteps;
+}
+
+void Engine::setSubstepSettings(const SubstepSettings& settings)
+{
+	substepSettings = settings;
+	substepSettings.minSubSteps = std::max(substepSettings.minSubSteps, 1);
+	substepSettings.maxSubSteps = std::max(substepSettings.maxSubSteps, substepSettings.minSubSteps);
+	substepStats = SubstepStats();
+	relaxedFrames = 0;
+	if(substepSettings.adaptive)
+		setSubStepCount(std::min(std::max(subSteps, substepSettings.minSubSteps), substepSettings.maxSubSteps));
+	else
+		setSubStepCount(baseSubSteps);
+}
+
+const SubstepSettings& Engine::getSubstepSettings() const
+{
+	return substepSettings;
+}
+
+const SubstepStats& Engine::getSubstepStats() const
+{
+	return substepStats;
+}
+
+void Engine::setNeighborListSettings(const NeighborListSettings& settings)
+{
+	neighborSettings = settings;
+	neighborSettings.skin = std::max(neighborSettings.skin, 0.0f);
+	neighborList.invalidate();
+}
+
+const NeighborListSettings& Engine::getNeighborListSettings() const
+{
+	return neighborSettings;
+}
+
+uint64_t Engine::getNeighborListBuildCount() const
+{
+	return neighborList.buildCount;
+}
+
 float Engine::getTimeSubstep()
 {
 	return stepdt/static_cast<float>(subSteps);
 }
 
-void Engine::setObjectVelocity(VerletObject &object, sf::Vector2f v)
+void Engine::setObjectVelocity(VerletObject &object, Vec2 v)
 {
 	object.setVelocity(v, getTimeSubstep());
 }
 
-const CollisionGrid& Engine::getGrid() const
+void Engine::setObjectVelocity(uint32_t index, Vec2 v)
+{
+	sleepSystem.wake(particles, index);
+	getObject(index).setVelocity(v, getTimeSubstep());
+}
+
+Vec2 Engine::getGravity() const
+{
+	return gravity;
+}
+
+void Engine::setGravity(Vec2 gravity)
+{
+	this->gravity = gravity;
+}
+
+void Engine::setBroadPhase(BroadPhaseType type)
+{
+	broadPhase = type;
+	neighborList.invalidate();
+	queryGridCurrent = false;
+}
+
+BroadPhaseType Engine::getBroadPhase() const
+{
+	return broadPhase;
+}
+
+const HierarchicalGrid& Engine::getGrid() const
 {
 	return grid;
 }
 
+const SparseHierarchicalGrid& Engine::getSparseGrid() const
+{
+	return sparseGrid;
+}
+
+const CollisionGridStats& Engine::getGridStats() const
+{
+	return broadPhase == BroadPhaseType::SpatialHash ? sparseGrid.stats : grid.stats;
+}
+
 void Engine::setGridCellSize(float cellSize)
 {
-	grid.width = bounds.width / cellSize;
-	grid.height = bounds.height / cellSize;
-	grid.cellSize = cellSize;
-	grid.cells.resize(grid.width * grid.height);
+	grid.resize(bounds.width / cellSize, bounds.height / cellSize, cellSize);
+	linkGrid.resize(grid.getBase().width, grid.getBase().height, grid.getBase().cellSize);
+	// the sparse grids only take the cell size, truncated like the dense one
+	sparseGrid.resize(0, 0, grid.getBase().cellSize);
+	linkHash.resize(0, 0, grid.getBase().cellSize);
+	neighborList.invalidate();
+	queryGridCurrent = false;
+}
+
+uint32_t Engine::getThreadCount() const
+{
+	return threadPool.getThreadCount();
+}
+
+void Engine::setTaskGraphEnabled(bool enabled)
+{
+	taskGraphEnabled = enabled;
+}
+
+bool Engine::isTaskGraphEnabled() const
+{
+	return taskGraphEnabled;
+}
+
+void Engine::setNarrowPhaseKernel(NarrowPhaseKernelType type)
+{
+	narrowPhaseType = isNarrowPhaseKernelSupported(type) ? type : NarrowPhaseKernelType::Scalar;
+	narrowPhaseKernel = ::getNarrowPhaseKernel(narrowPhaseType);
+}
+
+NarrowPhaseKernelType Engine::getNarrowPhaseKernel() const
+{
+	return narrowPhaseType;
+}
+
+void Engine::reorderParticles()
+{
+	const uint32_t count = particles.size();
+	if(broadPhase == BroadPhaseType::SpatialHash)
+		mortonSorter.sort(sparseGrid.getBase(), particles.x.data(), particles.y.data(), count, reorderOrder);
+	else
+		mortonSorter.sort(grid.getBase(), particles.x.data(), particles.y.data(), count, reorderOrder);
+	particles.permute(reorderOrder);
+	particleHandles.permute(reorderOrder);
+	linkAdjacency.permute(reorderOrder);
+	neighborList.invalidate();
+	queryGridCurrent = false;
+	reorderMap.resize(count);
+	for(uint32_t i = 0; i < count; i++)
+		reorderMap[reorderOrder[i]] = i;
+	for(Link& link : links)
+	{
+		link.setFirst(reorderMap[link.getFirst()]);
+		link.setSecond(reorderMap[link.getSecond()]);
+	}
+	linkBatchesDirty = true;
+	sleepSystem.remap(reorderOrder, reorderMap);
+	reorderCount++;
+}
+
+void Engine::setReorderInterval(uint32_t frames)
+{
+	reorderInterval = frames;
+}
+
+const std::vector<uint32_t>& Engine::getReorderMap() const
+{
+	return reorderMap;
+}
+
+uint64_t Engine::getReorderCount() const
+{
+	return reorderCount;
+}
+
+void Engine::setSleepEnabled(bool enabled)
+{
+	if(sleepEnabled && !enabled)
+		sleepSystem.wakeAll(particles);
+	sleepEnabled = enabled;
+}
+
+void Engine::setSleepSettings(const SleepSettings& settings)
+{
+	sleepSystem.setSettings(settings);
+}
+
+uint32_t Engine::getSleepingCount() const
+{
+	return sleepSystem.getSleepingCount();
+}
+
+void Engine::wakeObject(uint32_t index)
+{
+	sleepSystem.wake(particles, index);
+}
+
+void Engine::wakeAll()
+{
+	sleepSystem.wakeAll(particles);
+}
+
+void Engine::setTimingEnabled(bool enabled)
+{
+	timingEnabled = enabled;
+}
+
+const EngineTimings& Engine::getTimings() const
+{
+	return timings;
+}
+
+void Engine::resetTimings()
+{
+	timings = EngineTimings();
+}
+
+uint32_t Engine::queryRadius(Vec2 center, float radius, uint32_t* out, uint32_t capacity)
+{
+	if(broadPhase == BroadPhaseType::SpatialHash)
+	{
+		prepareQueries(sparseGrid, linkHash);
+		return gatherInRadius(sparseGrid, center, radius, out, capacity);
+	}
+	prepareQueries(grid, linkGrid);
+	return gatherInRadius(grid, center, radius, out, capacity);
+}
+
+uint32_t Engine::queryRect(const Rect& area, uint32_t* out, uint32_t capacity)
+{
+	if(broadPhase == BroadPhaseType::SpatialHash)
+	{
+		prepareQueries(sparseGrid, linkHash);
+		return gatherInRect(sparseGrid, area, out, capacity);
+	}
+	prepareQueries(grid, linkGrid);
+	return gatherInRect(grid, area, out, capacity);
+}
+
+uint32_t Engine::findNearestObject(Vec2 point, float maxDistance)
+{
+	if(broadPhase == BroadPhaseType::SpatialHash)
+	{
+		prepareQueries(sparseGrid, linkHash);
+		return findNearest(sparseGrid, point, maxDistance);
+	}
+	prepareQueries(grid, linkGrid);
+	return findNearest(grid, point, maxDistance);
+}
+
+bool Engine::rayCast(Vec2 origin, Vec2 direction, float maxDistance, RayHit& hit)
+{
+	if(broadPhase == BroadPhaseType::SpatialHash)
+	{
+		prepareQueries(sparseGrid, linkHash);
+		return castRay(sparseGrid, linkHash, origin, direction, maxDistance, hit);
+	}
+	prepareQueries(grid, linkGrid);
+	return castRay(grid, linkGrid, origin, direction, maxDistance, hit);
 }
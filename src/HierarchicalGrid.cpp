@@ -0,0 +1,93 @@
+#include <algorithm>
+
+#include "HierarchicalGrid.hpp"
+
+// coarser levels down to a single cell, past it every particle already sees the whole world
+static CollisionGrid makeCoarser(const CollisionGrid& finer)
+{
+	CollisionGrid coarser;
+	coarser.resize((finer.width + 1) / 2, (finer.height + 1) / 2, 2 * finer.cellSize);
+	return coarser;
+}
+
+// the plane has no size, every level is kept and halving the bias keeps the cells nested
+static SpatialHashGrid makeCoarser(const SpatialHashGrid& finer)
+{
+	SpatialHashGrid coarser;
+	coarser.coordinateBias = finer.coordinateBias / 2;
+	coarser.resize(0, 0, 2 * finer.cellSize);
+	return coarser;
+}
+
+template<typename Level>
+void BasicHierarchicalGrid<Level>::resize(uint32_t width, uint32_t height, int cellSize)
+{
+	levels.clear();
+	levels.emplace_back();
+	levels[0].resize(width, height, cellSize);
+	while(levels.size() < maxLevels && !levels.back().spansSingleCell())
+		levels.push_back(makeCoarser(levels.back()));
+	levelCount = 1;
+	objectLevel.clear();
+	levelStart.assign(2, 0);
+	levelObjects.clear();
+	stats = CollisionGridStats();
+}
+
+template<typename Level>
+uint32_t BasicHierarchicalGrid<Level>::getLevel(float radius) const
+{
+	uint32_t level = 0;
+	while(level + 1 < levels.size() && static_cast<float>(levels[level].cellSize) < 2.0f * radius)
+		level++;
+	return level;
+}
+
+template<typename Level>
+void BasicHierarchicalGrid<Level>::build(const float* x, const float* y, const float* radius, uint32_t count)
+{
+	objectLevel.resize(count);
+	levelCount = 1;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t level = getLevel(radius[i]);
+		objectLevel[i] = level;
+		levelCount = std::max(levelCount, level + 1);
+	}
+	levelStart.assign(levelCount + 1, 0);
+	if(levelCount == 1)
+	{
+		// everything fits the finest cells, no id lists needed
+		levelStart[1] = count;
+		levels[0].build(x, y, count);
+		stats = levels[0].stats;
+		return;
+	}
+
+	// counting sort of the ids by level, ascending inside every level
+	for(uint32_t i = 0; i < count; i++)
+		levelStart[objectLevel[i] + 1]++;
+	for(uint32_t l = 0; l < levelCount; l++)
+		levelStart[l + 1] += levelStart[l];
+	uint32_t cursor[maxLevels];
+	std::copy(levelStart.begin(), levelStart.begin() + levelCount, cursor);
+	levelObjects.resize(count);
+	for(uint32_t i = 0; i < count; i++)
+		levelObjects[cursor[objectLevel[i]]++] = i;
+
+	stats = CollisionGridStats();
+	for(uint32_t l = 0; l < levelCount; l++)
+	{
+		if(isLevelEmpty(l))
+			continue;
+		Level& grid = levels[l];
+		grid.build(x, y, levelObjects.data() + levelStart[l], levelStart[l + 1] - levelStart[l]);
+		stats.insertedObjects += grid.stats.insertedObjects;
+		stats.clampedObjects += grid.stats.clampedObjects;
+		stats.occupiedCells += grid.stats.occupiedCells;
+		stats.maxCellOccupancy = std::max(stats.maxCellOccupancy, grid.stats.maxCellOccupancy);
+	}
+}
+
+template struct BasicHierarchicalGrid<CollisionGrid>;
+template struct BasicHierarchicalGrid<SpatialHashGrid>;
@@ -0,0 +1,169 @@
+#include <cstring>
+
+#include "Integration.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define PHYSENG_X86 1
+	#include <emmintrin.h>
+#endif
+
+// arrays the integration reads and writes, taken once per call
+struct IntegrationArrays
+{
+	float* x;
+	float* y;
+	float* prevX;
+	float* prevY;
+	float* accX;
+	float* accY;
+	const float* radius;
+	const float* rigidness;
+	const uint8_t* flags;
+
+	explicit IntegrationArrays(ParticleStore& particles)
+		: x(particles.x.data()), y(particles.y.data()), prevX(particles.prevX.data()), prevY(particles.prevY.data()),
+		accX(particles.accX.data()), accY(particles.accY.data()), radius(particles.radius.data()),
+		rigidness(particles.rigidness.data()), flags(particles.flags.data())
+	{
+	}
+};
+
+template<bool Immovable, bool Sleeping>
+static inline void integrateParticle(const IntegrationArrays& p, uint32_t i, const BoundaryLimits& limits, Vec2 gravity, float dtSqr)
+{
+	if(Sleeping && (p.flags[i] & PARTICLE_SLEEPING))
+		return;
+	const bool fixed = Immovable && (p.flags[i] & PARTICLE_IMMOVABLE);
+	const float radius = p.radius[i];
+	const float push = 0.5f * p.rigidness[i];
+	float x = p.x[i];
+	float y = p.y[i];
+	if(x - radius < limits.left)
+		x += push * (radius - (x - limits.left));
+	if(x + radius > limits.right)
+		x -= push * (radius - (limits.right - x));
+	if(y - radius < limits.top)
+		y += push * (radius - (y - limits.top));
+	if(y + radius > limits.bottom)
+		y -= push * (radius - (limits.bottom - y));
+	// compute how much we moved
+	const float dispX = x - p.prevX[i];
+	const float dispY = y - p.prevY[i];
+	const float accX = p.accX[i] + (fixed ? 0.0f : gravity.x);
+	const float accY = p.accY[i] + (fixed ? 0.0f : gravity.y);
+	// update position
+	p.prevX[i] = x;
+	p.prevY[i] = y;
+	p.x[i] = x + (dispX + accX * dtSqr);
+	p.y[i] = y + (dispY + accY * dtSqr);
+	// reset acceleration
+	p.accX[i] = 0.0f;
+	p.accY[i] = 0.0f;
+}
+
+#ifdef PHYSENG_X86
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// lanes whose flags have none of the bits of mask set
+static inline __m128 flagsClear(const uint8_t* flags, uint32_t mask)
+{
+	uint32_t packed;
+	std::memcpy(&packed, flags, 4);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(lanes, _mm_set1_epi32(mask)), zero));
+}
+
+// the scalar steps on 4 particles, both sides of every test computed and selected, no fused multiply-add
+template<bool Immovable, bool Sleeping>
+static void integrateSSE2(const IntegrationArrays& p, uint32_t begin, uint32_t end, const BoundaryLimits& limits, Vec2 gravity, float dtSqr)
+{
+	const __m128 left = _mm_set1_ps(limits.left);
+	const __m128 top = _mm_set1_ps(limits.top);
+	const __m128 right = _mm_set1_ps(limits.right);
+	const __m128 bottom = _mm_set1_ps(limits.bottom);
+	const __m128 gravityX = _mm_set1_ps(gravity.x);
+	const __m128 gravityY = _mm_set1_ps(gravity.y);
+	const __m128 dt2 = _mm_set1_ps(dtSqr);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	uint32_t i = begin;
+	for(; i + 4 <= end; i += 4)
+	{
+		const __m128 radius = _mm_loadu_ps(p.radius + i);
+		const __m128 push = _mm_mul_ps(half, _mm_loadu_ps(p.rigidness + i));
+		const __m128 startX = _mm_loadu_ps(p.x + i);
+		const __m128 startY = _mm_loadu_ps(p.y + i);
+		__m128 x = startX;
+		__m128 y = startY;
+		x = select(_mm_cmplt_ps(_mm_sub_ps(x, radius), left), _mm_add_ps(x, _mm_mul_ps(push, _mm_sub_ps(radius, _mm_sub_ps(x, left)))), x);
+		x = select(_mm_cmpgt_ps(_mm_add_ps(x, radius), right), _mm_sub_ps(x, _mm_mul_ps(push, _mm_sub_ps(radius, _mm_sub_ps(right, x)))), x);
+		y = select(_mm_cmplt_ps(_mm_sub_ps(y, radius), top), _mm_add_ps(y, _mm_mul_ps(push, _mm_sub_ps(radius, _mm_sub_ps(y, top)))), y);
+		y = select(_mm_cmpgt_ps(_mm_add_ps(y, radius), bottom), _mm_sub_ps(y, _mm_mul_ps(push, _mm_sub_ps(radius, _mm_sub_ps(bottom, y)))), y);
+
+		const __m128 prevX = _mm_loadu_ps(p.prevX + i);
+		const __m128 prevY = _mm_loadu_ps(p.prevY + i);
+		__m128 accX = _mm_loadu_ps(p.accX + i);
+		__m128 accY = _mm_loadu_ps(p.accY + i);
+		const __m128 movable = Immovable ? flagsClear(p.flags + i, PARTICLE_IMMOVABLE) : _mm_castsi128_ps(_mm_set1_epi32(-1));
+		const __m128 forceX = _mm_add_ps(accX, _mm_and_ps(movable, gravityX));
+		const __m128 forceY = _mm_add_ps(accY, _mm_and_ps(movable, gravityY));
+		__m128 nextX = _mm_add_ps(x, _mm_add_ps(_mm_sub_ps(x, prevX), _mm_mul_ps(forceX, dt2)));
+		__m128 nextY = _mm_add_ps(y, _mm_add_ps(_mm_sub_ps(y, prevY), _mm_mul_ps(forceY, dt2)));
+		__m128 newPrevX = x;
+		__m128 newPrevY = y;
+		__m128 newAccX = zero;
+		__m128 newAccY = zero;
+		if(Sleeping)
+		{
+			const __m128 awake = flagsClear(p.flags + i, PARTICLE_SLEEPING);
+			nextX = select(awake, nextX, startX);
+			nextY = select(awake, nextY, startY);
+			newPrevX = select(awake, newPrevX, prevX);
+			newPrevY = select(awake, newPrevY, prevY);
+			newAccX = select(awake, newAccX, accX);
+			newAccY = select(awake, newAccY, accY);
+		}
+		_mm_storeu_ps(p.x + i, nextX);
+		_mm_storeu_ps(p.y + i, nextY);
+		_mm_storeu_ps(p.prevX + i, newPrevX);
+		_mm_storeu_ps(p.prevY + i, newPrevY);
+		_mm_storeu_ps(p.accX + i, newAccX);
+		_mm_storeu_ps(p.accY + i, newAccY);
+	}
+	for(; i < end; i++)
+		integrateParticle<Immovable, Sleeping>(p, i, limits, gravity, dtSqr);
+}
+
+#endif
+
+template<bool Immovable, bool Sleeping>
+void integrateParticles(ParticleStore& particles, uint32_t begin, uint32_t end, const BoundaryLimits& limits, Vec2 gravity, float dtSqr)
+{
+	const IntegrationArrays arrays(particles);
+#ifdef PHYSENG_X86
+	integrateSSE2<Immovable, Sleeping>(arrays, begin, end, limits, gravity, dtSqr);
+#else
+	for(uint32_t i = begin; i < end; i++)
+		integrateParticle<Immovable, Sleeping>(arrays, i, limits, gravity, dtSqr);
+#endif
+}
+
+template<bool Immovable, bool Sleeping>
+void integrateParticleList(ParticleStore& particles, const uint32_t* ids, uint32_t count, const BoundaryLimits& limits, Vec2 gravity, float dtSqr)
+{
+	const IntegrationArrays arrays(particles);
+	for(uint32_t k = 0; k < count; k++)
+		integrateParticle<Immovable, Sleeping>(arrays, ids[k], limits, gravity, dtSqr);
+}
+
+template void integrateParticles<false, false>(ParticleStore&, uint32_t, uint32_t, const BoundaryLimits&, Vec2, float);
+template void integrateParticles<true, false>(ParticleStore&, uint32_t, uint32_t, const BoundaryLimits&, Vec2, float);
+template void integrateParticles<true, true>(ParticleStore&, uint32_t, uint32_t, const BoundaryLimits&, Vec2, float);
+template void integrateParticleList<false, false>(ParticleStore&, const uint32_t*, uint32_t, const BoundaryLimits&, Vec2, float);
+template void integrateParticleList<true, false>(ParticleStore&, const uint32_t*, uint32_t, const BoundaryLimits&, Vec2, float);
+template void integrateParticleList<true, true>(ParticleStore&, const uint32_t*, uint32_t, const BoundaryLimits&, Vec2, float);
@@ -1,5 +1,3 @@
-#include <SFML/Graphics.hpp>
-
 #include "Link.hpp"
 
 Link::Link(int first, int second, float restLength, float stiffness, bool spring)
@@ -11,11 +9,21 @@ int Link::getFirst() const
 	return first;
 }
 
+void Link::setFirst(int first)
+{
+	this->first = first;
+}
+
 int Link::getSecond() const
 {
 	return second;
 }
 
+void Link::setSecond(int second)
+{
+	this->second = second;
+}
+
 bool Link::isSpring() const
 {
 	return spring;
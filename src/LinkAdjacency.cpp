@@ -0,0 +1,86 @@
+#include "LinkAdjacency.hpp"
+
+void LinkAdjacency::build(const std::vector<Link>& links, uint32_t particleCount)
+{
+	head.assign(particleCount, noEnd);
+	next.resize(2 * links.size());
+	prev.resize(2 * links.size());
+	for(uint32_t l = 0; l < links.size(); l++)
+	{
+		insert(2 * l, links[l].getFirst());
+		insert(2 * l + 1, links[l].getSecond());
+	}
+}
+
+void LinkAdjacency::addParticle()
+{
+	head.push_back(noEnd);
+}
+
+void LinkAdjacency::addLink(const Link& link)
+{
+	const uint32_t end = next.size();
+	next.resize(end + 2);
+	prev.resize(end + 2);
+	insert(end, link.getFirst());
+	insert(end + 1, link.getSecond());
+}
+
+void LinkAdjacency::removeLinkSwap(const std::vector<Link>& links, uint32_t index)
+{
+	const uint32_t last = links.size() - 1;
+	unlink(2 * index, links[index].getFirst());
+	unlink(2 * index + 1, links[index].getSecond());
+	if(index != last)
+	{
+		move(2 * last, 2 * index, links[last].getFirst());
+		move(2 * last + 1, 2 * index + 1, links[last].getSecond());
+	}
+	next.resize(2 * last);
+	prev.resize(2 * last);
+}
+
+void LinkAdjacency::removeParticleSwap(uint32_t i)
+{
+	head[i] = head.back();
+	head.pop_back();
+}
+
+void LinkAdjacency::permute(const std::vector<uint32_t>& order)
+{
+	std::vector<uint32_t> permuted(head.size());
+	for(uint32_t i = 0; i < order.size(); i++)
+		permuted[i] = head[order[i]];
+	head.swap(permuted);
+}
+
+void LinkAdjacency::insert(uint32_t end, uint32_t particle)
+{
+	next[end] = head[particle];
+	prev[end] = noEnd;
+	if(head[particle] != noEnd)
+		prev[head[particle]] = end;
+	head[particle] = end;
+}
+
+void LinkAdjacency::unlink(uint32_t end, uint32_t particle)
+{
+	if(prev[end] != noEnd)
+		next[prev[end]] = next[end];
+	else
+		head[particle] = next[end];
+	if(next[end] != noEnd)
+		prev[next[end]] = prev[end];
+}
+
+void LinkAdjacency::move(uint32_t from, uint32_t to, uint32_t particle)
+{
+	next[to] = next[from];
+	prev[to] = prev[from];
+	if(prev[to] != noEnd)
+		next[prev[to]] = to;
+	else
+		head[particle] = to;
+	if(next[to] != noEnd)
+		prev[next[to]] = to;
+}
@@ -0,0 +1,55 @@
+#include "LinkBatches.hpp"
+
+void LinkBatches::build(const std::vector<Link>& links, uint32_t particleCount)
+{
+	const uint32_t linkCount = links.size();
+	// greedy coloring: each link takes the lowest color not used yet by either of its particles
+	std::vector<uint64_t> usedColors(particleCount, 0);
+	std::vector<uint32_t> linkColor(linkCount);
+	std::vector<uint32_t> colorCount(maxColors + 1, 0);
+	for(uint32_t k = 0; k < linkCount; k++)
+	{
+		const uint32_t a = links[k].getFirst();
+		const uint32_t b = links[k].getSecond();
+		const uint64_t freeColors = ~(usedColors[a] | usedColors[b]);
+		uint32_t color = maxColors;
+		if(freeColors != 0)
+		{
+			color = 0;
+			while(!(freeColors & (uint64_t(1) << color)))
+				color++;
+			usedColors[a] |= uint64_t(1) << color;
+			usedColors[b] |= uint64_t(1) << color;
+		}
+		linkColor[k] = color;
+		colorCount[color]++;
+	}
+
+	// one batch per used color, in color order
+	batchStart.clear();
+	std::vector<uint32_t> colorOffset(maxColors + 1, 0);
+	uint32_t offset = 0;
+	for(uint32_t color = 0; color <= maxColors; color++)
+	{
+		if(colorCount[color] == 0)
+			continue;
+		batchStart.push_back(offset);
+		colorOffset[color] = offset;
+		offset += colorCount[color];
+	}
+	batchStart.push_back(offset);
+	serialBatch = colorCount[maxColors] > 0;
+
+	first.resize(linkCount);
+	second.resize(linkCount);
+	restLength.resize(linkCount);
+	stiffness.resize(linkCount);
+	for(uint32_t k = 0; k < linkCount; k++)
+	{
+		const uint32_t slot = colorOffset[linkColor[k]]++;
+		first[slot] = links[k].getFirst();
+		second[slot] = links[k].getSecond();
+		restLength[slot] = links[k].getRestLength();
+		stiffness[slot] = links[k].isSpring() ? links[k].getStiffness() : 1.0f;
+	}
+}
@@ -0,0 +1,380 @@
+#include <cmath>
+#include <algorithm>
+
+#include "NarrowPhase.hpp"
+#include "Profiler.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define PHYSENG_X86 1
+	#include <immintrin.h>
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+		#define PHYSENG_TARGET_AVX2
+	#else
+		#define PHYSENG_TARGET_AVX2 __attribute__((target("avx2,fma")))
+	#endif
+#endif
+
+// pair response shared by every kernel, identical to the original per-pair solver:
+// a fixed (or sleeping) particle never moves and pushes a free one by the whole overlap,
+// two free particles split the overlap according to their radii; returns whether they overlapped and raises
+// penetration to the overlap relative to the sum of the radii, pairs of two immovable particles excepted.
+// Without Immovable particles, VariableRadius or VariableRigidness the matching loads and selects
+// are compiled out, the uniform values give exactly the same results as the general formula
+template<bool Immovable, bool VariableRadius, bool VariableRigidness>
+static inline bool collidePair(float* x, float* y, const float* radius, const float* rigidness, const uint8_t* flags, uint32_t i, uint32_t j, float& penetration)
+{
+	const float eps = 0.0001f;
+	const float distX = x[i] - x[j];
+	const float distY = y[i] - y[j];
+	const float distSqr = distX * distX + distY * distY;
+	const float minDist = VariableRadius ? radius[i] + radius[j] : 2.0f * radius[i];
+	if(distSqr < minDist * minDist && distSqr > eps)
+	{
+		const bool fixed1 = Immovable && (flags[i] & PARTICLE_IMMOVABLE);
+		const bool fixed2 = Immovable && (flags[j] & PARTICLE_IMMOVABLE);
+		if(fixed1 && fixed2)
+			return true;
+		const float dist = std::sqrt(distSqr);
+		penetration = std::max(penetration, (minDist - dist) / minDist);
+		const float responseCoef = VariableRigidness ? (rigidness[i] + rigidness[j]) / 2 : rigidness[i];
+		// correction per unit of distVec
+		const float scale = 0.5f * responseCoef * (dist - minDist) / dist;
+		const float weight1 = fixed1 ? 0.0f : (fixed2 ? 1.0f : (VariableRadius ? radius[j] / minDist : 0.5f));
+		const float weight2 = fixed2 ? 0.0f : (fixed1 ? 1.0f : (VariableRadius ? radius[i] / minDist : 0.5f));
+		x[i] -= distX * (scale * weight1);
+		y[i] -= distY * (scale * weight1);
+		x[j] += distX * (scale * weight2);
+		y[j] += distY * (scale * weight2);
+		return true;
+	}
+	return false;
+}
+
+template<bool Immovable, bool VariableRadius, bool VariableRigidness>
+static float collideScalar(ParticleStore& particles, uint32_t index, const uint32_t* candidates, uint32_t candidateCount)
+{
+	float* x = particles.x.data();
+	float* y = particles.y.data();
+	const float* radius = particles.radius.data();
+	const float* rigidness = particles.rigidness.data();
+	const uint8_t* flags = particles.flags.data();
+	uint32_t contacts = 0;
+	float penetration = 0.0f;
+	for(uint32_t k = 0; k < candidateCount; k++)
+		contacts += collidePair<Immovable, VariableRadius, VariableRigidness>(x, y, radius, rigidness, flags, index, candidates[k], penetration);
+	PHYSENG_PROFILE_COUNT(Contacts, contacts);
+	return penetration;
+}
+
+#ifdef PHYSENG_X86
+
+static inline int lowestSetBit(int mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long bit;
+	_BitScanForward(&bit, mask);
+	return bit;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static inline int countSetBits(int mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return __popcnt(mask);
+#else
+	return __builtin_popcount(mask);
+#endif
+}
+
+// the SIMD kernels test the particle against a whole batch of neighbours using its position at the start
+// of the batch, so results differ from the scalar path only by the order in which corrections are applied
+
+template<bool Immovable, bool VariableRadius, bool VariableRigidness>
+static float collideSSE2(ParticleStore& particles, uint32_t index, const uint32_t* candidates, uint32_t candidateCount)
+{
+	float* x = particles.x.data();
+	float* y = particles.y.data();
+	const float* radius = particles.radius.data();
+	const float* rigidness = particles.rigidness.data();
+	const uint8_t* flags = particles.flags.data();
+	const bool fixed1 = Immovable && (flags[index] & PARTICLE_IMMOVABLE);
+	const __m128 radius1 = _mm_set1_ps(radius[index]);
+	const __m128 rigidness1 = _mm_set1_ps(rigidness[index]);
+	const __m128 eps = _mm_set1_ps(0.0001f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	alignas(16) float corrX[4];
+	alignas(16) float corrY[4];
+	__m128 penetration4 = zero;
+
+	uint32_t contacts = 0;
+	uint32_t k = 0;
+	for(; k + 4 <= candidateCount; k += 4)
+	{
+		const uint32_t* c = candidates + k;
+		const __m128 x2 = _mm_set_ps(x[c[3]], x[c[2]], x[c[1]], x[c[0]]);
+		const __m128 y2 = _mm_set_ps(y[c[3]], y[c[2]], y[c[1]], y[c[0]]);
+		const __m128 distX = _mm_sub_ps(_mm_set1_ps(x[index]), x2);
+		const __m128 distY = _mm_sub_ps(_mm_set1_ps(y[index]), y2);
+		const __m128 distSqr = _mm_add_ps(_mm_mul_ps(distX, distX), _mm_mul_ps(distY, distY));
+		const __m128 radius2 = VariableRadius ? _mm_set_ps(radius[c[3]], radius[c[2]], radius[c[1]], radius[c[0]]) : radius1;
+		const __m128 minDist = _mm_add_ps(radius1, radius2);
+		const __m128 overlap = _mm_and_ps(_mm_cmplt_ps(distSqr, _mm_mul_ps(minDist, minDist)), _mm_cmpgt_ps(distSqr, eps));
+		int mask = _mm_movemask_ps(overlap);
+		if(mask == 0)
+			continue;
+		contacts += countSetBits(mask);
+		const __m128 fixed2 = Immovable ? _mm_cmpneq_ps(_mm_set_ps(
+				flags[c[3]] & PARTICLE_IMMOVABLE, flags[c[2]] & PARTICLE_IMMOVABLE,
+				flags[c[1]] & PARTICLE_IMMOVABLE, flags[c[0]] & PARTICLE_IMMOVABLE), zero) : zero;
+		const __m128 rigidness2 = VariableRigidness ? _mm_set_ps(rigidness[c[3]], rigidness[c[2]], rigidness[c[1]], rigidness[c[0]]) : rigidness1;
+		const __m128 dist = _mm_sqrt_ps(distSqr);
+		// the approximate reciprocal is plenty for a metric
+		const __m128 measured = fixed1 ? _mm_andnot_ps(fixed2, overlap) : overlap;
+		penetration4 = _mm_max_ps(penetration4, _mm_and_ps(measured, _mm_sub_ps(one, _mm_mul_ps(dist, _mm_rcp_ps(minDist)))));
+		const __m128 responseCoef = _mm_mul_ps(_mm_add_ps(rigidness1, rigidness2), _mm_set1_ps(0.25f));
+		const __m128 scale = _mm_and_ps(overlap, _mm_div_ps(_mm_mul_ps(responseCoef, _mm_sub_ps(dist, minDist)), dist));
+		__m128 weight1, weight2;
+		if(fixed1)
+		{
+			weight1 = zero;
+			weight2 = _mm_andnot_ps(fixed2, one);
+		}
+		else if(!Immovable && !VariableRadius)
+		{
+			weight1 = half;
+			weight2 = half;
+		}
+		else
+		{
+			const __m128 ratio2 = VariableRadius ? _mm_div_ps(radius2, minDist) : half;
+			const __m128 ratio1 = VariableRadius ? _mm_div_ps(radius1, minDist) : half;
+			weight1 = _mm_or_ps(_mm_and_ps(fixed2, one), _mm_andnot_ps(fixed2, ratio2));
+			weight2 = _mm_andnot_ps(fixed2, ratio1);
+		}
+		const __m128 scale1 = _mm_mul_ps(scale, weight1);
+		const __m128 scale2 = _mm_mul_ps(scale, weight2);
+		// horizontal sum of the corrections of the tested particle
+		__m128 sumX = _mm_mul_ps(distX, scale1);
+		__m128 sumY = _mm_mul_ps(distY, scale1);
+		sumX = _mm_add_ps(sumX, _mm_movehl_ps(sumX, sumX));
+		sumY = _mm_add_ps(sumY, _mm_movehl_ps(sumY, sumY));
+		sumX = _mm_add_ss(sumX, _mm_shuffle_ps(sumX, sumX, 1));
+		sumY = _mm_add_ss(sumY, _mm_shuffle_ps(sumY, sumY, 1));
+		x[index] -= _mm_cvtss_f32(sumX);
+		y[index] -= _mm_cvtss_f32(sumY);
+		// scatter the neighbour corrections
+		_mm_store_ps(corrX, _mm_mul_ps(distX, scale2));
+		_mm_store_ps(corrY, _mm_mul_ps(distY, scale2));
+		while(mask)
+		{
+			const int lane = lowestSetBit(mask);
+			mask &= mask - 1;
+			x[c[lane]] += corrX[lane];
+			y[c[lane]] += corrY[lane];
+		}
+	}
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, penetration4);
+	float penetration = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+	for(; k < candidateCount; k++)
+		contacts += collidePair<Immovable, VariableRadius, VariableRigidness>(x, y, radius, rigidness, flags, index, candidates[k], penetration);
+	PHYSENG_PROFILE_COUNT(Contacts, contacts);
+	return penetration;
+}
+
+template<bool Immovable, bool VariableRadius, bool VariableRigidness>
+PHYSENG_TARGET_AVX2 static float collideAVX2(ParticleStore& particles, uint32_t index, const uint32_t* candidates, uint32_t candidateCount)
+{
+	float* x = particles.x.data();
+	float* y = particles.y.data();
+	const float* radius = particles.radius.data();
+	const float* rigidness = particles.rigidness.data();
+	const uint8_t* flags = particles.flags.data();
+	const bool fixed1 = Immovable && (flags[index] & PARTICLE_IMMOVABLE);
+	const __m256 radius1 = _mm256_set1_ps(radius[index]);
+	const __m256 rigidness1 = _mm256_set1_ps(rigidness[index]);
+	const __m256 eps = _mm256_set1_ps(0.0001f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	alignas(32) float corrX[8];
+	alignas(32) float corrY[8];
+	__m256 penetration8 = zero;
+
+	uint32_t contacts = 0;
+	uint32_t k = 0;
+	for(; k + 8 <= candidateCount; k += 8)
+	{
+		const uint32_t* c = candidates + k;
+		const __m256i ids = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c));
+		const __m256 distX = _mm256_sub_ps(_mm256_set1_ps(x[index]), _mm256_i32gather_ps(x, ids, 4));
+		const __m256 distY = _mm256_sub_ps(_mm256_set1_ps(y[index]), _mm256_i32gather_ps(y, ids, 4));
+		const __m256 distSqr = _mm256_fmadd_ps(distX, distX, _mm256_mul_ps(distY, distY));
+		const __m256 radius2 = VariableRadius ? _mm256_i32gather_ps(radius, ids, 4) : radius1;
+		const __m256 minDist = _mm256_add_ps(radius1, radius2);
+		const __m256 overlap = _mm256_and_ps(_mm256_cmp_ps(distSqr, _mm256_mul_ps(minDist, minDist), _CMP_LT_OQ),
+				_mm256_cmp_ps(distSqr, eps, _CMP_GT_OQ));
+		int mask = _mm256_movemask_ps(overlap);
+		if(mask == 0)
+			continue;
+		contacts += countSetBits(mask);
+		const __m256 fixed2 = Immovable ? _mm256_cmp_ps(_mm256_set_ps(
+				flags[c[7]] & PARTICLE_IMMOVABLE, flags[c[6]] & PARTICLE_IMMOVABLE,
+				flags[c[5]] & PARTICLE_IMMOVABLE, flags[c[4]] & PARTICLE_IMMOVABLE,
+				flags[c[3]] & PARTICLE_IMMOVABLE, flags[c[2]] & PARTICLE_IMMOVABLE,
+				flags[c[1]] & PARTICLE_IMMOVABLE, flags[c[0]] & PARTICLE_IMMOVABLE), zero, _CMP_NEQ_OQ) : zero;
+		const __m256 rigidness2 = VariableRigidness ? _mm256_i32gather_ps(rigidness, ids, 4) : rigidness1;
+		const __m256 dist = _mm256_sqrt_ps(distSqr);
+		const __m256 measured = fixed1 ? _mm256_andnot_ps(fixed2, overlap) : overlap;
+		penetration8 = _mm256_max_ps(penetration8, _mm256_and_ps(measured, _mm256_sub_ps(one, _mm256_mul_ps(dist, _mm256_rcp_ps(minDist)))));
+		const __m256 responseCoef = _mm256_mul_ps(_mm256_add_ps(rigidness1, rigidness2), _mm256_set1_ps(0.25f));
+		const __m256 scale = _mm256_and_ps(overlap, _mm256_div_ps(_mm256_mul_ps(responseCoef, _mm256_sub_ps(dist, minDist)), dist));
+		__m256 weight1, weight2;
+		if(fixed1)
+		{
+			weight1 = zero;
+			weight2 = _mm256_andnot_ps(fixed2, one);
+		}
+		else if(!Immovable && !VariableRadius)
+		{
+			weight1 = half;
+			weight2 = half;
+		}
+		else
+		{
+			const __m256 ratio2 = VariableRadius ? _mm256_div_ps(radius2, minDist) : half;
+			const __m256 ratio1 = VariableRadius ? _mm256_div_ps(radius1, minDist) : half;
+			weight1 = _mm256_blendv_ps(ratio2, one, fixed2);
+			weight2 = _mm256_andnot_ps(fixed2, ratio1);
+		}
+		const __m256 scale1 = _mm256_mul_ps(scale, weight1);
+		const __m256 scale2 = _mm256_mul_ps(scale, weight2);
+		// horizontal sum of the corrections of the tested particle
+		__m256 sum = _mm256_hadd_ps(_mm256_mul_ps(distX, scale1), _mm256_mul_ps(distY, scale1));
+		__m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+		sum128 = _mm_hadd_ps(sum128, sum128);
+		x[index] -= _mm_cvtss_f32(sum128);
+		y[index] -= _mm_cvtss_f32(_mm_shuffle_ps(sum128, sum128, 1));
+		// scatter the neighbour corrections
+		_mm256_store_ps(corrX, _mm256_mul_ps(distX, scale2));
+		_mm256_store_ps(corrY, _mm256_mul_ps(distY, scale2));
+		while(mask)
+		{
+			const int lane = lowestSetBit(mask);
+			mask &= mask - 1;
+			x[c[lane]] += corrX[lane];
+			y[c[lane]] += corrY[lane];
+		}
+	}
+	alignas(32) float lanes[8];
+	_mm256_store_ps(lanes, penetration8);
+	float penetration = 0.0f;
+	for(float lane : lanes)
+		penetration = std::max(penetration, lane);
+	for(; k < candidateCount; k++)
+		contacts += collidePair<Immovable, VariableRadius, VariableRigidness>(x, y, radius, rigidness, flags, index, candidates[k], penetration);
+	PHYSENG_PROFILE_COUNT(Contacts, contacts);
+	return penetration;
+}
+
+static bool cpuSupportsAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const bool osxsave = info[2] & (1 << 27);
+	const bool fma = info[2] & (1 << 12);
+	if(!osxsave || !fma || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return info[1] & (1 << 5);
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif
+
+NarrowPhaseKernelType detectNarrowPhaseKernel()
+{
+	if(isNarrowPhaseKernelSupported(NarrowPhaseKernelType::AVX2))
+		return NarrowPhaseKernelType::AVX2;
+	if(isNarrowPhaseKernelSupported(NarrowPhaseKernelType::SSE2))
+		return NarrowPhaseKernelType::SSE2;
+	return NarrowPhaseKernelType::Scalar;
+}
+
+bool isNarrowPhaseKernelSupported(NarrowPhaseKernelType type)
+{
+	switch(type)
+	{
+#ifdef PHYSENG_X86
+	case NarrowPhaseKernelType::AVX2:
+	{
+		static const bool supported = cpuSupportsAVX2();
+		return supported;
+	}
+	case NarrowPhaseKernelType::SSE2:
+		return true;
+#endif
+	case NarrowPhaseKernelType::Scalar:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// every policy instantiation of a kernel, indexed by policyIndex
+#define PHYSENG_POLICY_TABLE(kernel) { \
+	kernel<false, false, false>, kernel<false, false, true>, kernel<false, true, false>, kernel<false, true, true>, \
+	kernel<true, false, false>, kernel<true, false, true>, kernel<true, true, false>, kernel<true, true, true>}
+
+static uint32_t policyIndex(NarrowPhasePolicy policy)
+{
+	return (policy.immovable ? 4 : 0) + (policy.variableRadius ? 2 : 0) + (policy.variableRigidness ? 1 : 0);
+}
+
+NarrowPhaseKernel getNarrowPhaseKernel(NarrowPhaseKernelType type, NarrowPhasePolicy policy)
+{
+	static const NarrowPhaseKernel scalarKernels[8] = PHYSENG_POLICY_TABLE(collideScalar);
+	if(!isNarrowPhaseKernelSupported(type))
+		return scalarKernels[policyIndex(policy)];
+	switch(type)
+	{
+#ifdef PHYSENG_X86
+	case NarrowPhaseKernelType::AVX2:
+	{
+		static const NarrowPhaseKernel avx2Kernels[8] = PHYSENG_POLICY_TABLE(collideAVX2);
+		return avx2Kernels[policyIndex(policy)];
+	}
+	case NarrowPhaseKernelType::SSE2:
+	{
+		static const NarrowPhaseKernel sse2Kernels[8] = PHYSENG_POLICY_TABLE(collideSSE2);
+		return sse2Kernels[policyIndex(policy)];
+	}
+#endif
+	default:
+		return scalarKernels[policyIndex(policy)];
+	}
+}
+
+const char* getNarrowPhaseKernelName(NarrowPhaseKernelType type)
+{
+	switch(type)
+	{
+	case NarrowPhaseKernelType::AVX2:
+		return "AVX2";
+	case NarrowPhaseKernelType::SSE2:
+		return "SSE2";
+	default:
+		return "Scalar";
+	}
+}
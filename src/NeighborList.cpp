@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "NeighborList.hpp"
+
+void NeighborList::begin(const ParticleStore& particles, float skin)
+{
+	this->skin = skin;
+	builtX = particles.x;
+	builtY = particles.y;
+	entryParticle.clear();
+	entryStart.assign(1, 0);
+	entryFiner.clear();
+	pairCount = 0;
+	stripeStart.assign(1, 0);
+}
+
+void NeighborList::addCandidates(const ParticleStore& particles, uint32_t particle, const uint32_t* candidates, uint32_t count)
+{
+	const float x = particles.x[particle];
+	const float y = particles.y[particle];
+	const float reach = particles.radius[particle] + skin;
+	if(neighbors.size() < pairCount + count)
+		neighbors.resize(std::max<size_t>(2 * neighbors.size(), pairCount + count));
+	// every candidate is written and only the kept ones advance the end, the test is too random to branch on
+	uint32_t* out = neighbors.data() + pairCount;
+	uint32_t kept = 0;
+	for(uint32_t k = 0; k < count; k++)
+	{
+		const uint32_t j = candidates[k];
+		const float distX = particles.x[j] - x;
+		const float distY = particles.y[j] - y;
+		const float maxDist = reach + particles.radius[j];
+		out[kept] = j;
+		kept += j != particle && distX * distX + distY * distY < maxDist * maxDist;
+	}
+	pairCount += kept;
+}
+
+void NeighborList::endEntry(uint32_t particle, bool finer)
+{
+	if(pairCount == entryStart.back())
+		return;
+	entryParticle.push_back(particle);
+	entryStart.push_back(pairCount);
+	entryFiner.push_back(finer);
+}
+
+void NeighborList::endStripe()
+{
+	stripeStart.push_back(entryParticle.size());
+}
+
+void NeighborList::end()
+{
+	valid = true;
+	buildCount++;
+}
+
+bool NeighborList::needsRebuild(const ParticleStore& particles, float skin) const
+{
+	const uint32_t count = particles.size();
+	if(!valid || skin != this->skin || builtX.size() != count)
+		return true;
+	const float maxMotion = 0.25f * skin * skin;
+	const float* x = particles.x.data();
+	const float* y = particles.y.data();
+	const float* oldX = builtX.data();
+	const float* oldY = builtY.data();
+	// no early exit, the branch-free loop vectorizes and is cheaper than the grid build it may save
+	float motion = 0.0f;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const float dispX = x[i] - oldX[i];
+		const float dispY = y[i] - oldY[i];
+		motion = std::max(motion, dispX * dispX + dispY * dispY);
+	}
+	return !(motion <= maxMotion);
+}
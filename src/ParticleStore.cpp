@@ -0,0 +1,197 @@
+#include <algorithm>
+
+#include "ParticleStore.hpp"
+
+uint32_t ParticleStore::add(const VerletObject& obj)
+{
+	const Vec2 position = obj.getPosition();
+	const Vec2 prevPosition = obj.getPrevPosition();
+	x.push_back(position.x);
+	y.push_back(position.y);
+	prevX.push_back(prevPosition.x);
+	prevY.push_back(prevPosition.y);
+	accX.push_back(0.0f);
+	accY.push_back(0.0f);
+	radius.push_back(obj.getRadius());
+	rigidness.push_back(obj.getRigidness());
+	flags.push_back(obj.isFixed() ? PARTICLE_FIXED : 0);
+	stillFrames.push_back(0);
+	colors.push_back(obj.getColor());
+	const bool first = size() == 1;
+	minRadius = first ? obj.getRadius() : std::min(minRadius, obj.getRadius());
+	maxRadius = first ? obj.getRadius() : std::max(maxRadius, obj.getRadius());
+	minRigidness = first ? obj.getRigidness() : std::min(minRigidness, obj.getRigidness());
+	maxRigidness = first ? obj.getRigidness() : std::max(maxRigidness, obj.getRigidness());
+	fixedCount += obj.isFixed();
+	return size() - 1;
+}
+
+uint32_t ParticleStore::size() const
+{
+	return x.size();
+}
+
+void ParticleStore::reserve(uint32_t count)
+{
+	x.reserve(count);
+	y.reserve(count);
+	prevX.reserve(count);
+	prevY.reserve(count);
+	accX.reserve(count);
+	accY.reserve(count);
+	radius.reserve(count);
+	rigidness.reserve(count);
+	flags.reserve(count);
+	stillFrames.reserve(count);
+	colors.reserve(count);
+}
+
+void ParticleStore::clear()
+{
+	x.clear();
+	y.clear();
+	prevX.clear();
+	prevY.clear();
+	accX.clear();
+	accY.clear();
+	radius.clear();
+	rigidness.clear();
+	flags.clear();
+	stillFrames.clear();
+	colors.clear();
+	refreshSummary();
+}
+
+void ParticleStore::refreshSummary()
+{
+	const uint32_t count = size();
+	minRadius = count > 0 ? radius[0] : 0.0f;
+	maxRadius = minRadius;
+	minRigidness = count > 0 ? rigidness[0] : 0.0f;
+	maxRigidness = minRigidness;
+	fixedCount = 0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		minRadius = std::min(minRadius, radius[i]);
+		maxRadius = std::max(maxRadius, radius[i]);
+		minRigidness = std::min(minRigidness, rigidness[i]);
+		maxRigidness = std::max(maxRigidness, rigidness[i]);
+		fixedCount += flags[i] & PARTICLE_FIXED;
+	}
+}
+
+template<typename T>
+static void permuteArray(std::vector<T>& values, const std::vector<uint32_t>& order)
+{
+	std::vector<T> permuted(values.size());
+	for(uint32_t i = 0; i < order.size(); i++)
+		permuted[i] = values[order[i]];
+	values.swap(permuted);
+}
+
+void ParticleStore::permute(const std::vector<uint32_t>& order)
+{
+	permuteArray(x, order);
+	permuteArray(y, order);
+	permuteArray(prevX, order);
+	permuteArray(prevY, order);
+	permuteArray(accX, order);
+	permuteArray(accY, order);
+	permuteArray(radius, order);
+	permuteArray(rigidness, order);
+	permuteArray(flags, order);
+	permuteArray(stillFrames, order);
+	permuteArray(colors, order);
+}
+
+template<typename T>
+static void removeSwapped(std::vector<T>& values, uint32_t i)
+{
+	values[i] = values.back();
+	values.pop_back();
+}
+
+void ParticleStore::removeSwap(uint32_t i)
+{
+	fixedCount -= isFixed(i);
+	removeSwapped(x, i);
+	removeSwapped(y, i);
+	removeSwapped(prevX, i);
+	removeSwapped(prevY, i);
+	removeSwapped(accX, i);
+	removeSwapped(accY, i);
+	removeSwapped(radius, i);
+	removeSwapped(rigidness, i);
+	removeSwapped(flags, i);
+	removeSwapped(stillFrames, i);
+	removeSwapped(colors, i);
+	if(size() == 0)
+		refreshSummary();
+}
+
+ParticleView::ParticleView(ParticleStore& store, uint32_t index)
+: store(&store), index(index)
+{}
+
+uint32_t ParticleView::getIndex() const
+{
+	return index;
+}
+
+Vec2 ParticleView::getPosition() const
+{
+	return {store->x[index], store->y[index]};
+}
+
+void ParticleView::setPosition(Vec2 position)
+{
+	store->x[index] = position.x;
+	store->y[index] = position.y;
+}
+
+Vec2 ParticleView::getPrevPosition() const
+{
+	return {store->prevX[index], store->prevY[index]};
+}
+
+void ParticleView::setPrevPosition(Vec2 prevPosition)
+{
+	store->prevX[index] = prevPosition.x;
+	store->prevY[index] = prevPosition.y;
+}
+
+void ParticleView::setVelocity(Vec2 v, float dt)
+{
+	setPrevPosition(getPosition() - (v * dt));
+}
+
+float ParticleView::getRadius() const
+{
+	return store->radius[index];
+}
+
+float ParticleView::getRigidness() const
+{
+	return store->rigidness[index];
+}
+
+bool ParticleView::isFixed() const
+{
+	return store->isFixed(index);
+}
+
+void ParticleView::setFixed()
+{
+	store->fixedCount += !store->isFixed(index);
+	store->flags[index] |= PARTICLE_FIXED;
+}
+
+Color ParticleView::getColor() const
+{
+	return store->colors[index];
+}
+
+void ParticleView::setColor(Color color)
+{
+	store->colors[index] = color;
+}
@@ -0,0 +1,192 @@
+#ifdef PHYSENG_PROFILING
+
+#include <algorithm>
+#include <cstdio>
+
+#include "Profiler.hpp"
+
+static const char* counterNames[static_cast<int>(ProfileCounter::Count)] = {
+	"pair tests", "contacts", "clamped insertions", "link collision tests"
+};
+
+static const char* occupancyNames[profileOccupancyBuckets] = {
+	"0", "1", "2", "3", "4", "5-8", "9-16", "17+"
+};
+
+static uint32_t getOccupancyBucket(uint32_t count)
+{
+	if(count <= 4)
+		return count;
+	if(count <= 8)
+		return 5;
+	if(count <= 16)
+		return 6;
+	return 7;
+}
+
+void ProfileThreadBuffer::record(const char* name, uint64_t start, uint64_t duration)
+{
+	const uint64_t index = head.load(std::memory_order_relaxed);
+	ring[index & (capacity - 1)] = {name, start, duration};
+	head.store(index + 1, std::memory_order_release);
+
+	const uint32_t count = scopeCount.load(std::memory_order_relaxed);
+	uint32_t slot = 0;
+	while(slot < count && scopeNames[slot] != name)
+		slot++;
+	if(slot == count)
+	{
+		if(count == maxScopes)
+			return;
+		scopeNames[slot] = name;
+		scopeCount.store(count + 1, std::memory_order_release);
+	}
+	scopeCalls[slot].fetch_add(1, std::memory_order_relaxed);
+	scopeTotal[slot].fetch_add(duration, std::memory_order_relaxed);
+	if(duration > scopeMax[slot].load(std::memory_order_relaxed))
+		scopeMax[slot].store(duration, std::memory_order_relaxed);
+}
+
+Profiler::Profiler() : origin(std::chrono::steady_clock::now())
+{
+}
+
+Profiler& Profiler::get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+ProfileThreadBuffer& Profiler::getThreadBuffer()
+{
+	thread_local ProfileThreadBuffer* buffer = nullptr;
+	if(!buffer)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.push_back(std::make_unique<ProfileThreadBuffer>());
+		buffer = threads.back().get();
+		buffer->id = threads.size() - 1;
+		buffer->ring.resize(ProfileThreadBuffer::capacity);
+	}
+	return *buffer;
+}
+
+uint64_t Profiler::now() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Profiler::addCount(ProfileCounter counter, uint64_t amount)
+{
+	getThreadBuffer().counters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+template<typename Grid>
+void Profiler::recordOccupancy(const Grid& grid)
+{
+	ProfileThreadBuffer& buffer = getThreadBuffer();
+	uint64_t occupancy[profileOccupancyBuckets] = {};
+	const uint32_t cellCount = grid.getCellCount();
+	for(uint32_t cell = 0; cell < cellCount; cell++)
+		occupancy[getOccupancyBucket(grid.getObjectCount(cell))]++;
+	for(uint32_t b = 0; b < profileOccupancyBuckets; b++)
+		buffer.occupancy[b].fetch_add(occupancy[b], std::memory_order_relaxed);
+	buffer.counters[static_cast<int>(ProfileCounter::ClampedInsertions)].fetch_add(grid.stats.clampedObjects, std::memory_order_relaxed);
+}
+
+template void Profiler::recordOccupancy(const CollisionGrid& grid);
+template void Profiler::recordOccupancy(const SpatialHashGrid& grid);
+
+ProfileStats Profiler::getStats()
+{
+	ProfileStats stats;
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const auto& buffer : threads)
+	{
+		for(int c = 0; c < static_cast<int>(ProfileCounter::Count); c++)
+			stats.counters[c] += buffer->counters[c].load(std::memory_order_relaxed);
+		for(uint32_t b = 0; b < profileOccupancyBuckets; b++)
+			stats.occupancy[b] += buffer->occupancy[b].load(std::memory_order_relaxed);
+		const uint32_t scopeCount = buffer->scopeCount.load(std::memory_order_acquire);
+		for(uint32_t s = 0; s < scopeCount; s++)
+		{
+			auto it = std::find_if(stats.scopes.begin(), stats.scopes.end(),
+					[&](const ProfileScopeStats& scope){ return scope.name == buffer->scopeNames[s]; });
+			if(it == stats.scopes.end())
+			{
+				stats.scopes.push_back({buffer->scopeNames[s]});
+				it = stats.scopes.end() - 1;
+			}
+			it->calls += buffer->scopeCalls[s].load(std::memory_order_relaxed);
+			it->totalMs += buffer->scopeTotal[s].load(std::memory_order_relaxed) * 1e-6;
+			it->maxMs = std::max(it->maxMs, buffer->scopeMax[s].load(std::memory_order_relaxed) * 1e-6);
+		}
+	}
+	return stats;
+}
+
+void Profiler::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const auto& buffer : threads)
+	{
+		buffer->head.store(0, std::memory_order_relaxed);
+		for(auto& counter : buffer->counters)
+			counter.store(0, std::memory_order_relaxed);
+		for(auto& bucket : buffer->occupancy)
+			bucket.store(0, std::memory_order_relaxed);
+		for(uint32_t s = 0; s < ProfileThreadBuffer::maxScopes; s++)
+		{
+			buffer->scopeCalls[s].store(0, std::memory_order_relaxed);
+			buffer->scopeTotal[s].store(0, std::memory_order_relaxed);
+			buffer->scopeMax[s].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+	FILE* file = std::fopen(path.c_str(), "w");
+	if(!file)
+		return false;
+	std::lock_guard<std::mutex> lock(mutex);
+	std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	uint64_t lastTime = 0;
+	for(const auto& buffer : threads)
+	{
+		std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+				first ? "" : ",\n", buffer->id, buffer->id);
+		first = false;
+		const uint64_t head = buffer->head.load(std::memory_order_acquire);
+		const uint64_t oldest = head > ProfileThreadBuffer::capacity ? head - ProfileThreadBuffer::capacity : 0;
+		for(uint64_t e = oldest; e < head; e++)
+		{
+			const ProfileEvent& event = buffer->ring[e & (ProfileThreadBuffer::capacity - 1)];
+			std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					event.name, buffer->id, event.start * 1e-3, event.duration * 1e-3);
+			lastTime = std::max(lastTime, event.start + event.duration);
+		}
+	}
+	// the counters are totals, shown as a single sample at the end of the trace
+	for(int c = 0; c < static_cast<int>(ProfileCounter::Count); c++)
+	{
+		uint64_t total = 0;
+		for(const auto& buffer : threads)
+			total += buffer->counters[c].load(std::memory_order_relaxed);
+		std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+				counterNames[c], lastTime * 1e-3, static_cast<unsigned long long>(total));
+	}
+	std::fprintf(file, ",\n{\"name\":\"cell occupancy\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{", lastTime * 1e-3);
+	for(uint32_t b = 0; b < profileOccupancyBuckets; b++)
+	{
+		uint64_t total = 0;
+		for(const auto& buffer : threads)
+			total += buffer->occupancy[b].load(std::memory_order_relaxed);
+		std::fprintf(file, "%s\"%s\":%llu", b ? "," : "", occupancyNames[b], static_cast<unsigned long long>(total));
+	}
+	std::fprintf(file, "}}\n]}\n");
+	return std::fclose(file) == 0;
+}
+
+#endif
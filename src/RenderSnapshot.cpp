@@ -0,0 +1,25 @@
+#include "RenderSnapshot.hpp"
+#include "Engine.hpp"
+
+void RenderSnapshot::capture(const Engine& engine, uint64_t frame)
+{
+	const ParticleStore& particles = engine.getParticles();
+	x.assign(particles.x.begin(), particles.x.end());
+	y.assign(particles.y.begin(), particles.y.end());
+	radius.assign(particles.radius.begin(), particles.radius.end());
+	flags.assign(particles.flags.begin(), particles.flags.end());
+	colors.assign(particles.colors.begin(), particles.colors.end());
+	const std::vector<ParticleHandle>& objectHandles = engine.getObjectHandles();
+	handles.assign(objectHandles.begin(), objectHandles.end());
+
+	const std::vector<Link>& links = engine.getLinks();
+	linkPoints.resize(2 * links.size());
+	for(uint32_t k = 0; k < links.size(); k++)
+	{
+		const uint32_t first = links[k].getFirst();
+		const uint32_t second = links[k].getSecond();
+		linkPoints[2 * k] = {particles.x[first], particles.y[first]};
+		linkPoints[2 * k + 1] = {particles.x[second], particles.y[second]};
+	}
+	this->frame = frame;
+}
@@ -1,43 +1,86 @@
 #include <SFML/Graphics.hpp>
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 #include "Renderer.hpp"
 #include "Engine.hpp"
+#include "SfmlConversions.hpp"
 
+static const unsigned circleTextureSize = 64;
+static const float outlineScale = 1.5f; // outer radius of the fixed object ring relative to the object radius
 
 Renderer::Renderer(sf::RenderTarget& window)
-: window(window)
-{}
+: window(window), particleVertices(sf::Quads), linkVertices(sf::Lines)
+{
+	createCircleTexture();
+}
 
-void Renderer::render(Engine& engine)
+void Renderer::createCircleTexture()
 {
-	sf::CircleShape circle(1.0f);
-	circle.setPointCount(32);
-	circle.setOrigin(1.0f, 1.0f);
-	for(const auto& obj : engine.getObjects())
+	const float center = circleTextureSize / 2.0f;
+	const float discRadius = center - 1.0f;
+	const float ringInnerRadius = discRadius / outlineScale;
+	sf::Image image;
+	image.create(2 * circleTextureSize, circleTextureSize, sf::Color::Transparent);
+	for(unsigned y = 0; y < circleTextureSize; y++)
 	{
-		circle.setPosition(obj.getPosition());
-		circle.setScale(obj.getRadius(), obj.getRadius());
-		circle.setFillColor(obj.getColor());
-		if(obj.isFixed())
-		{
-			circle.setOutlineThickness(0.5f);
-			circle.setOutlineColor(sf::Color::Green);
-		}
-		else
+		for(unsigned x = 0; x < circleTextureSize; x++)
 		{
-			circle.setOutlineThickness(0.0f); // Reset outline for non-fixed objects
-			circle.setOutlineColor(sf::Color::Transparent); // This can be any color as thickness is 0
+			const float dx = x + 0.5f - center;
+			const float dy = y + 0.5f - center;
+			const float dist = std::sqrt(dx * dx + dy * dy);
+			// one pixel of antialiasing on every edge
+			const float disc = std::min(std::max(discRadius - dist + 0.5f, 0.0f), 1.0f);
+			const float ring = std::min(disc, std::min(std::max(dist - ringInnerRadius + 0.5f, 0.0f), 1.0f));
+			image.setPixel(x, y, sf::Color(255, 255, 255, static_cast<sf::Uint8>(255 * disc)));
+			image.setPixel(x + circleTextureSize, y, sf::Color(255, 255, 255, static_cast<sf::Uint8>(255 * ring)));
 		}
-		window.draw(circle);
 	}
+	circleTexture.loadFromImage(image);
+	circleTexture.setSmooth(true);
+}
+
+void Renderer::render(const Engine& engine)
+{
+	engineSnapshot.capture(engine, 0);
+	render(engineSnapshot);
+}
+
+void Renderer::render(const RenderSnapshot& snapshot)
+{
+	const uint32_t count = snapshot.size();
+	uint32_t fixedCount = 0;
+	for(uint32_t i = 0; i < count; i++)
+		fixedCount += (snapshot.flags[i] & PARTICLE_FIXED) != 0;
 
-	for(const auto& link : engine.getLinks())
+	// one textured quad per object plus one outline ring quad per fixed object, all in a single draw call
+	particleVertices.resize(4 * (count + fixedCount));
+	const float textureSize = static_cast<float>(circleTextureSize);
+	uint32_t v = 0;
+	auto addQuad = [&](float x, float y, float halfSize, sf::Color color, float textureLeft)
+	{
+		sf::Vertex* quad = &particleVertices[v];
+		quad[0] = sf::Vertex({x - halfSize, y - halfSize}, color, {textureLeft, 0.0f});
+		quad[1] = sf::Vertex({x + halfSize, y - halfSize}, color, {textureLeft + textureSize, 0.0f});
+		quad[2] = sf::Vertex({x + halfSize, y + halfSize}, color, {textureLeft + textureSize, textureSize});
+		quad[3] = sf::Vertex({x - halfSize, y + halfSize}, color, {textureLeft, textureSize});
+		v += 4;
+	};
+	// the disc texture leaves a one pixel border, scale the quad so the disc matches the object radius
+	const float discScale = circleTextureSize / (circleTextureSize - 2.0f);
+	for(uint32_t i = 0; i < count; i++)
 	{
-		sf::Vertex line[] = {
-			sf::Vertex(engine.getObjects()[link.getFirst()].getPosition(), sf::Color::White),
-			sf::Vertex(engine.getObjects()[link.getSecond()].getPosition(), sf::Color::White)
-		};
-		window.draw(line, 2, sf::Lines);
+		if(snapshot.flags[i] & PARTICLE_FIXED)
+			addQuad(snapshot.x[i], snapshot.y[i], snapshot.radius[i] * outlineScale * discScale, sf::Color::Green, textureSize);
+		addQuad(snapshot.x[i], snapshot.y[i], snapshot.radius[i] * discScale, toSf(snapshot.colors[i]), 0.0f);
 	}
+	window.draw(particleVertices, sf::RenderStates(&circleTexture));
+
+	const uint32_t linkPointCount = snapshot.linkPoints.size();
+	linkVertices.resize(linkPointCount);
+	for(uint32_t k = 0; k < linkPointCount; k++)
+		linkVertices[k] = sf::Vertex(toSf(snapshot.linkPoints[k]), sf::Color::White);
+	if(linkPointCount > 0)
+		window.draw(linkVertices);
 }
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+#include "Scene.hpp"
+
+static constexpr float autoRestLength = -1.0f;
+// far more than a scene runs at interactive rates, and little enough that declaring them cannot exhaust memory
+static constexpr uint64_t maxSceneParticles = 1u << 24;
+
+// walks the tokens of one line, a # ends the line
+struct SceneTokens
+{
+	const char* cursor;
+	const char* end;
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+	bool next(std::string_view& token)
+	{
+		while(cursor < end && isSpace(*cursor))
+			cursor++;
+		if(cursor == end || *cursor == '#')
+			return false;
+		const char* begin = cursor;
+		while(cursor < end && !isSpace(*cursor) && *cursor != '#')
+			cursor++;
+		token = std::string_view(begin, cursor - begin);
+		return true;
+	}
+	bool number(float& value)
+	{
+		std::string_view token;
+		if(!next(token))
+			return false;
+		const std::from_chars_result parsed = std::from_chars(token.data(), token.data() + token.size(), value);
+		return parsed.ec == std::errc() && parsed.ptr == token.data() + token.size() && std::isfinite(value);
+	}
+	bool count(uint32_t& value)
+	{
+		std::string_view token;
+		if(!next(token))
+			return false;
+		const std::from_chars_result parsed = std::from_chars(token.data(), token.data() + token.size(), value);
+		return parsed.ec == std::errc() && parsed.ptr == token.data() + token.size();
+	}
+	bool finished()
+	{
+		std::string_view token;
+		return !next(token);
+	}
+};
+
+static bool parseSides(std::string_view token, uint8_t& sides)
+{
+	sides = 0;
+	if(token == "none")
+		return true;
+	if(token == "all")
+	{
+		sides = BOUNDARY_ALL;
+		return true;
+	}
+	while(!token.empty())
+	{
+		const size_t comma = std::min(token.find(','), token.size());
+		const std::string_view side = token.substr(0, comma);
+		if(side == "left")
+			sides |= BOUNDARY_LEFT;
+		else if(side == "right")
+			sides |= BOUNDARY_RIGHT;
+		else if(side == "top")
+			sides |= BOUNDARY_TOP;
+		else if(side == "bottom")
+			sides |= BOUNDARY_BOTTOM;
+		else
+			return false;
+		token.remove_prefix(std::min(comma + 1, token.size()));
+	}
+	return true;
+}
+
+// parses the statement starting with keyword, returns the expected form when the rest of the line does not match it
+static const char* parseStatement(Scene& scene, std::string_view keyword, SceneTokens& tokens)
+{
+	std::string_view token;
+	if(keyword == "bounds")
+	{
+		Rect& b = scene.bounds;
+		if(!tokens.number(b.left) || !tokens.number(b.top) || !tokens.number(b.width) || !tokens.number(b.height)
+				|| b.left != 0.0f || b.top != 0.0f || b.width <= 0.0f || b.height <= 0.0f || !tokens.finished())
+			return "bounds 0 0 <width> <height>, with a positive size: the dense grid starts at the origin";
+	}
+	else if(keyword == "timestep")
+	{
+		uint32_t subSteps;
+		if(!tokens.number(scene.stepdt) || !tokens.count(subSteps) || scene.stepdt <= 0.0f || subSteps == 0 || subSteps > 1024 || !tokens.finished())
+			return "timestep <stepdt> <substeps>, with a positive step and 1 to 1024 substeps";
+		scene.subSteps = subSteps;
+	}
+	else if(keyword == "cellsize")
+	{
+		if(!tokens.number(scene.cellSize) || scene.cellSize < 1.0f || !tokens.finished())
+			return "cellsize <size>, at least 1: grid cells have a whole number size";
+	}
+	else if(keyword == "gravity")
+	{
+		if(!tokens.number(scene.gravity.x) || !tokens.number(scene.gravity.y) || !tokens.finished())
+			return "gravity <x> <y>";
+	}
+	else if(keyword == "walls" || keyword == "open")
+	{
+		if(!tokens.next(token) || !parseSides(token, keyword == "walls" ? scene.walls : scene.openBoundaries) || !tokens.finished())
+			return "walls|open <none|all|left,right,top,bottom>";
+	}
+	else if(keyword == "broadphase")
+	{
+		if(!tokens.next(token) || (token != "grid" && token != "hash") || !tokens.finished())
+			return "broadphase <grid|hash>";
+		scene.broadPhase = token == "hash" ? BroadPhaseType::SpatialHash : BroadPhaseType::Grid;
+	}
+	else if(keyword == "sleep")
+	{
+		if(!tokens.next(token) || (token != "on" && token != "off") || !tokens.finished())
+			return "sleep <on|off>";
+		scene.sleep = token == "on";
+	}
+	else if(keyword == "particle")
+	{
+		const char* usage = "particle <x> <y> <radius> <rigidness> [fixed] [velocity <vx> <vy>] [color <r> <g> <b>], with a positive radius";
+		SceneParticle particle;
+		if(!tokens.number(particle.position.x) || !tokens.number(particle.position.y) || !tokens.number(particle.radius)
+				|| !tokens.number(particle.rigidness) || particle.radius <= 0.0f)
+			return usage;
+		while(tokens.next(token))
+		{
+			uint32_t r, g, b;
+			if(token == "fixed")
+				particle.fixed = true;
+			else if(token == "velocity" && tokens.number(particle.velocity.x) && tokens.number(particle.velocity.y))
+				continue;
+			else if(token == "color" && tokens.count(r) && tokens.count(g) && tokens.count(b) && r < 256 && g < 256 && b < 256)
+				particle.color = Color(r, g, b);
+			else
+				return usage;
+		}
+		scene.particles.push_back(particle);
+	}
+	else if(keyword == "lattice")
+	{
+		const char* usage = "lattice <x> <y> <columns> <rows> <spacing> <radius> <rigidness> [pinned] [linked <stiffness>] [jitter <amount>], with a positive spacing and radius";
+		Vec2 origin;
+		uint32_t columns, rows;
+		float spacing, radius, rigidness;
+		float stiffness = 1.0f;
+		float jitter = 0.0f;
+		bool pinned = false;
+		bool linked = false;
+		if(!tokens.number(origin.x) || !tokens.number(origin.y) || !tokens.count(columns) || !tokens.count(rows)
+				|| !tokens.number(spacing) || !tokens.number(radius) || !tokens.number(rigidness) || spacing <= 0.0f || radius <= 0.0f)
+			return usage;
+		while(tokens.next(token))
+		{
+			if(token == "pinned")
+				pinned = true;
+			else if(token == "linked" && tokens.number(stiffness))
+				linked = true;
+			else if(token == "jitter" && tokens.number(jitter))
+				continue;
+			else
+				return usage;
+		}
+		if(static_cast<uint64_t>(columns) * rows + scene.particles.size() > maxSceneParticles)
+			return "lattice with at most 16777216 particles in the scene";
+		const uint32_t base = scene.particles.size();
+		scene.particles.reserve(base + columns * rows);
+		for(uint32_t row = 0; row < rows; row++)
+		{
+			for(uint32_t column = 0; column < columns; column++)
+			{
+				// the same horizontal offsets on every load, so that a pile does not stay a perfect lattice
+				const uint32_t i = row * columns + column;
+				const float offset = jitter * static_cast<float>((i * 2654435761u) % 17) / 17.0f;
+				SceneParticle particle;
+				particle.position = Vec2(origin.x + column * spacing + offset, origin.y + row * spacing);
+				particle.radius = radius;
+				particle.rigidness = rigidness;
+				particle.fixed = pinned && row == 0;
+				scene.particles.push_back(particle);
+			}
+		}
+		for(uint32_t row = 0; row < rows && linked; row++)
+		{
+			for(uint32_t column = 0; column < columns; column++)
+			{
+				const uint32_t id = base + row * columns + column;
+				if(column + 1 < columns)
+					scene.links.push_back({id, id + 1, spacing, stiffness, false});
+				if(row + 1 < rows)
+					scene.links.push_back({id, id + columns, spacing, stiffness, false});
+			}
+		}
+	}
+	else if(keyword == "link")
+	{
+		const char* usage = "link <first> <second> <rest length|auto> <stiffness> [spring], between two declared particles";
+		SceneLink link;
+		if(!tokens.count(link.first) || !tokens.count(link.second))
+			return usage;
+		SceneTokens length = tokens;
+		if(tokens.next(token) && token == "auto")
+			link.restLength = autoRestLength;
+		else if(!length.number(link.restLength) || link.restLength < 0.0f)
+			return usage;
+		else
+			tokens = length;
+		if(!tokens.number(link.stiffness))
+			return usage;
+		if(tokens.next(token))
+		{
+			if(token != "spring" || !tokens.finished())
+				return usage;
+			link.spring = true;
+		}
+		if(link.first == link.second || link.first >= scene.particles.size() || link.second >= scene.particles.size())
+			return usage;
+		if(link.restLength == autoRestLength)
+		{
+			const Vec2 d = scene.particles[link.second].position - scene.particles[link.first].position;
+			link.restLength = std::sqrt(d.x * d.x + d.y * d.y);
+		}
+		scene.links.push_back(link);
+	}
+	else if(keyword == "emitter")
+	{
+		SceneEmitter emitter;
+		if(!tokens.number(emitter.position.x) || !tokens.number(emitter.position.y) || !tokens.number(emitter.velocity.x)
+				|| !tokens.number(emitter.velocity.y) || !tokens.number(emitter.radius) || !tokens.number(emitter.rigidness)
+				|| !tokens.count(emitter.interval) || !tokens.count(emitter.count) || emitter.radius <= 0.0f || emitter.interval == 0)
+			return "emitter <x> <y> <vx> <vy> <radius> <rigidness> <interval> <count> [start], with a positive radius and interval";
+		SceneTokens rest = tokens;
+		if(!rest.finished() && (!tokens.count(emitter.start) || !tokens.finished()))
+			return "emitter <x> <y> <vx> <vy> <radius> <rigidness> <interval> <count> [start], with a positive radius and interval";
+		scene.emitters.push_back(emitter);
+	}
+	else
+		return "a statement: bounds, timestep, cellsize, gravity, walls, open, broadphase, sleep, particle, lattice, link or emitter";
+	return nullptr;
+}
+
+bool Scene::parse(const char* text, size_t size, std::string& error)
+{
+	*this = Scene();
+	const char* end = text + size;
+	uint32_t line = 1;
+	for(const char* cursor = text; cursor < end; line++)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+		if(!lineEnd)
+			lineEnd = end;
+		SceneTokens tokens = {cursor, lineEnd};
+		std::string_view keyword;
+		if(tokens.next(keyword))
+		{
+			if(const char* expected = parseStatement(*this, keyword, tokens))
+			{
+				error = "line " + std::to_string(line) + ": expected " + expected;
+				return false;
+			}
+		}
+		cursor = lineEnd + 1;
+	}
+	// bounds, cell size and radii may come in any order, the grid they give is only known at the end
+	const float gridCellSize = std::floor(getGridCellSize());
+	if(static_cast<double>(bounds.width / gridCellSize) * static_cast<double>(bounds.height / gridCellSize)
+			> static_cast<double>(CollisionGrid::maxCellCount))
+	{
+		error = "expected bounds and cellsize giving at most " + std::to_string(CollisionGrid::maxCellCount) + " grid cells";
+		return false;
+	}
+	return true;
+}
+
+bool Scene::load(const std::string& path, std::string& error)
+{
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if(!file)
+	{
+		error = "could not open " + path;
+		return false;
+	}
+	std::string text;
+	char buffer[1 << 16];
+	size_t count;
+	if(std::fseek(file, 0, SEEK_END) == 0)
+	{
+		const long size = std::ftell(file);
+		text.reserve(size > 0 ? size : 0);
+		std::rewind(file);
+	}
+	while((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, count);
+	const bool failed = std::ferror(file);
+	std::fclose(file);
+	if(failed)
+	{
+		error = "could not read " + path;
+		return false;
+	}
+	if(!parse(text.data(), text.size(), error))
+	{
+		error = path + ", " + error;
+		return false;
+	}
+	return true;
+}
+
+float Scene::getGridCellSize() const
+{
+	float minRadius = 0.0f;
+	for(const SceneParticle& particle : particles)
+		minRadius = minRadius > 0.0f ? std::min(minRadius, particle.radius) : particle.radius;
+	for(const SceneEmitter& emitter : emitters)
+		minRadius = minRadius > 0.0f ? std::min(minRadius, emitter.radius) : emitter.radius;
+	// the grid truncates its cell size to a whole number, at least 1
+	return cellSize > 0.0f ? cellSize : std::max(1.0f, 2.0f * minRadius);
+}
+
+std::unique_ptr<Engine> Scene::createEngine(uint32_t threadCount) const
+{
+	std::unique_ptr<Engine> engine(new Engine(bounds, stepdt, subSteps, getGridCellSize(), threadCount));
+	engine->setGravity(gravity);
+	engine->setWalls(walls);
+	engine->setOpenBoundaries(openBoundaries);
+	engine->setBroadPhase(broadPhase);
+	engine->setSleepEnabled(sleep);
+	for(const SceneParticle& particle : particles)
+	{
+		VerletObject obj(particle.position, particle.radius, particle.rigidness, particle.fixed);
+		obj.setColor(particle.color);
+		if(particle.velocity != Vec2())
+			engine->setObjectVelocity(obj, particle.velocity);
+		engine->addObject(obj);
+	}
+	for(const SceneLink& link : links)
+		engine->addLink(Link(link.first, link.second, link.restLength, link.stiffness, link.spring));
+	return engine;
+}
+
+void Scene::emit(Engine& engine, uint64_t frame) const
+{
+	for(const SceneEmitter& emitter : emitters)
+	{
+		if(frame < emitter.start || (frame - emitter.start) % emitter.interval != 0 || (frame - emitter.start) / emitter.interval >= emitter.count)
+			continue;
+		VerletObject obj(emitter.position, emitter.radius, emitter.rigidness, false);
+		engine.setObjectVelocity(obj, emitter.velocity);
+		engine.addObject(obj);
+	}
+}
@@ -0,0 +1,129 @@
+#include <chrono>
+
+#include "SimulationThread.hpp"
+
+SimulationThread::SimulationThread(Engine& engine)
+: engine(engine)
+{}
+
+SimulationThread::~SimulationThread()
+{
+	stop();
+}
+
+void SimulationThread::start()
+{
+	if(thread.joinable())
+		return;
+	stopping = false;
+	publish();
+	thread = std::thread(&SimulationThread::loop, this);
+}
+
+void SimulationThread::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+	if(thread.joinable())
+		thread.join();
+}
+
+void SimulationThread::post(std::function<void(Engine&)> command)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		commands.push_back(std::move(command));
+	}
+	wakeCondition.notify_all();
+}
+
+void SimulationThread::setRunning(bool running)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->running = running;
+	}
+	wakeCondition.notify_all();
+}
+
+bool SimulationThread::isRunning() const
+{
+	return running;
+}
+
+const RenderSnapshot& SimulationThread::acquireSnapshot()
+{
+	return snapshots.acquire();
+}
+
+float SimulationThread::getStepRate() const
+{
+	return stepRate;
+}
+
+bool SimulationThread::applyCommands()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingCommands.swap(commands);
+	}
+	for(auto& command : pendingCommands)
+		command(engine);
+	const bool applied = !pendingCommands.empty();
+	pendingCommands.clear();
+	return applied;
+}
+
+void SimulationThread::publish()
+{
+	snapshots.getWriteBuffer().capture(engine, frame);
+	snapshots.publish();
+}
+
+void SimulationThread::loop()
+{
+	typedef std::chrono::steady_clock Clock;
+	const auto stepDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(engine.getTimeStep()));
+	auto nextStep = Clock::now();
+	auto rateStart = Clock::now();
+	uint32_t rateSteps = 0;
+	while(!stopping)
+	{
+		const bool changed = applyCommands();
+		if(!running)
+		{
+			if(changed)
+				publish();
+			stepRate = 0.0f;
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [this]{ return stopping || running || !commands.empty(); });
+			nextStep = Clock::now();
+			rateStart = nextStep;
+			rateSteps = 0;
+			continue;
+		}
+
+		engine.update();
+		frame++;
+		publish();
+
+		rateSteps++;
+		const auto now = Clock::now();
+		if(now - rateStart >= std::chrono::seconds(1))
+		{
+			stepRate = rateSteps / std::chrono::duration<float>(now - rateStart).count();
+			rateStart = now;
+			rateSteps = 0;
+		}
+
+		// fixed timestep, but never try to catch up on more than a few late steps
+		nextStep += stepDuration;
+		if(now - nextStep > 4 * stepDuration)
+			nextStep = now;
+		std::unique_lock<std::mutex> lock(mutex);
+		wakeCondition.wait_until(lock, nextStep, [this]{ return stopping.load(); });
+	}
+}
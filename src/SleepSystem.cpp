@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cmath>
+
+#include "SleepSystem.hpp"
+
+void SleepSystem::setSettings(const SleepSettings& settings)
+{
+	this->settings = settings;
+}
+
+const SleepSettings& SleepSystem::getSettings() const
+{
+	return settings;
+}
+
+uint32_t SleepSystem::findRoot(uint32_t i)
+{
+	while(parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+void SleepSystem::unite(uint32_t a, uint32_t b)
+{
+	a = findRoot(a);
+	b = findRoot(b);
+	if(a != b)
+		parent[std::max(a, b)] = std::min(a, b);
+}
+
+bool SleepSystem::touching(const ParticleStore& particles, uint32_t a, uint32_t b) const
+{
+	const float distX = particles.x[a] - particles.x[b];
+	const float distY = particles.y[a] - particles.y[b];
+	const float maxDist = particles.radius[a] + particles.radius[b] + settings.contactMargin;
+	return distX * distX + distY * distY < maxDist * maxDist;
+}
+
+template<typename Grid, typename Visitor>
+void SleepSystem::forEachNeighbor(const ParticleStore& particles, const Grid& grid, uint32_t i, Visitor visit) const
+{
+	const uint32_t level = grid.objectLevel[i];
+	uint32_t cellX, cellY;
+	grid.levels[level].getCellCoords(particles.x[i], particles.y[i], cellX, cellY);
+	grid.forEachNeighborCell(level, cellX, cellY, [&](const uint32_t* objects, uint32_t objCount)
+	{
+		for(uint32_t k = 0; k < objCount; k++)
+			if(objects[k] != i)
+				visit(objects[k]);
+	});
+}
+
+template<typename Grid>
+void SleepSystem::update(ParticleStore& particles, const Grid& grid, const std::vector<Link>& links)
+{
+	const uint32_t count = particles.size();
+	// particles added after the last grid build are not in the grid yet, leave them for the next frame
+	const uint32_t gridCount = std::min<uint32_t>(count, grid.getObjectCount());
+	bool sleepCandidates = false;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(particles.flags[i] & PARTICLE_IMMOVABLE)
+			continue;
+		const float motionX = particles.x[i] - particles.prevX[i];
+		const float motionY = particles.y[i] - particles.prevY[i];
+		if(motionX * motionX + motionY * motionY < settings.motionThreshold * settings.motionThreshold)
+		{
+			if(particles.stillFrames[i] < settings.framesToSleep)
+				particles.stillFrames[i]++;
+			sleepCandidates |= particles.stillFrames[i] >= settings.framesToSleep && i < gridCount;
+		}
+		else
+		{
+			particles.stillFrames[i] = 0;
+			// something moving touches a sleeping island, wake it up
+			if(sleepingCount > 0 && i < gridCount)
+				forEachNeighbor(particles, grid, i, [&](uint32_t j)
+				{
+					if(particles.isSleeping(j) && touching(particles, i, j))
+						wake(particles, j);
+				});
+		}
+	}
+
+	// islands only need rebuilding when some particle has become still enough to sleep
+	if(sleepCandidates)
+	{
+		buildIslands(particles, grid, links);
+		sleepStillIslands(particles);
+	}
+}
+
+template<typename Grid>
+void SleepSystem::buildIslands(const ParticleStore& particles, const Grid& grid, const std::vector<Link>& links)
+{
+	const uint32_t count = std::min<uint32_t>(particles.size(), grid.getObjectCount());
+	parent.resize(count);
+	for(uint32_t i = 0; i < count; i++)
+		parent[i] = i;
+	// fixed particles are static ground and do not connect the islands resting on them
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(particles.isFixed(i))
+			continue;
+		forEachNeighbor(particles, grid, i, [&](uint32_t j)
+		{
+			if(j > i && j < count && !particles.isFixed(j) && touching(particles, i, j))
+				unite(i, j);
+		});
+	}
+	for(const Link& link : links)
+	{
+		const uint32_t first = link.getFirst();
+		const uint32_t second = link.getSecond();
+		if(first < count && second < count && !particles.isFixed(first) && !particles.isFixed(second))
+			unite(first, second);
+	}
+
+	// number the islands and group their members
+	islandOf.assign(particles.size(), noIsland);
+	islandStart.clear();
+	uint32_t islandCount = 0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(particles.isFixed(i))
+			continue;
+		const uint32_t root = findRoot(i);
+		if(root == i)
+			islandOf[i] = islandCount++;
+		else
+			islandOf[i] = islandOf[root];
+	}
+	islandStart.assign(islandCount + 1, 0);
+	for(uint32_t i = 0; i < count; i++)
+		if(islandOf[i] != noIsland)
+			islandStart[islandOf[i] + 1]++;
+	for(uint32_t k = 0; k < islandCount; k++)
+		islandStart[k + 1] += islandStart[k];
+	islandMembers.resize(islandStart[islandCount]);
+	std::vector<uint32_t> cursor(islandStart.begin(), islandStart.end() - 1);
+	for(uint32_t i = 0; i < count; i++)
+		if(islandOf[i] != noIsland)
+			islandMembers[cursor[islandOf[i]]++] = i;
+}
+
+void SleepSystem::sleepStillIslands(ParticleStore& particles)
+{
+	const uint32_t islandCount = getIslandCount();
+	for(uint32_t k = 0; k < islandCount; k++)
+	{
+		bool still = true;
+		bool awake = false;
+		for(uint32_t m = islandStart[k]; m < islandStart[k + 1] && still; m++)
+		{
+			const uint32_t i = islandMembers[m];
+			if(!particles.isSleeping(i))
+			{
+				awake = true;
+				still = particles.stillFrames[i] >= settings.framesToSleep;
+			}
+		}
+		if(!still || !awake)
+			continue;
+		for(uint32_t m = islandStart[k]; m < islandStart[k + 1]; m++)
+		{
+			const uint32_t i = islandMembers[m];
+			if(particles.isSleeping(i))
+				continue;
+			particles.flags[i] |= PARTICLE_SLEEPING;
+			particles.prevX[i] = particles.x[i];
+			particles.prevY[i] = particles.y[i];
+			particles.accX[i] = 0.0f;
+			particles.accY[i] = 0.0f;
+			sleepingCount++;
+		}
+	}
+}
+
+void SleepSystem::wake(ParticleStore& particles, uint32_t i)
+{
+	auto wakeParticle = [&](uint32_t j)
+	{
+		if(particles.isSleeping(j))
+		{
+			particles.flags[j] &= ~PARTICLE_SLEEPING;
+			sleepingCount--;
+		}
+		particles.stillFrames[j] = 0;
+	};
+	const uint32_t island = i < islandOf.size() ? islandOf[i] : noIsland;
+	if(island == noIsland)
+	{
+		wakeParticle(i);
+		return;
+	}
+	for(uint32_t m = islandStart[island]; m < islandStart[island + 1]; m++)
+		wakeParticle(islandMembers[m]);
+}
+
+void SleepSystem::wakeAll(ParticleStore& particles)
+{
+	for(uint32_t i = 0; i < particles.size(); i++)
+	{
+		particles.flags[i] &= ~PARTICLE_SLEEPING;
+		particles.stillFrames[i] = 0;
+	}
+	sleepingCount = 0;
+}
+
+void SleepSystem::remap(const std::vector<uint32_t>& order, const std::vector<uint32_t>& oldToNew)
+{
+	if(islandOf.empty())
+		return;
+	std::vector<uint32_t> remapped(order.size(), noIsland);
+	for(uint32_t i = 0; i < order.size(); i++)
+		if(order[i] < islandOf.size())
+			remapped[i] = islandOf[order[i]];
+	islandOf.swap(remapped);
+	// islands dissolved by removals may still list particles that are gone, nothing reads them anymore
+	for(uint32_t& member : islandMembers)
+		if(member < oldToNew.size())
+			member = oldToNew[member];
+}
+
+void SleepSystem::remove(ParticleStore& particles, uint32_t i)
+{
+	wake(particles, i);
+	if(i >= islandOf.size())
+		return;
+	// the woken island is dissolved, its stale member list becomes unreachable
+	const uint32_t island = islandOf[i];
+	if(island != noIsland)
+		for(uint32_t m = islandStart[island]; m < islandStart[island + 1]; m++)
+			islandOf[islandMembers[m]] = noIsland;
+	const uint32_t last = particles.size() - 1;
+	if(last < islandOf.size())
+	{
+		const uint32_t lastIsland = islandOf[last];
+		if(lastIsland != noIsland)
+			for(uint32_t m = islandStart[lastIsland]; m < islandStart[lastIsland + 1]; m++)
+				if(islandMembers[m] == last)
+					islandMembers[m] = i;
+		islandOf[i] = lastIsland;
+		islandOf.pop_back();
+	}
+}
+
+void SleepSystem::clear()
+{
+	islandOf.clear();
+	islandStart.clear();
+	islandMembers.clear();
+	sleepingCount = 0;
+}
+
+uint32_t SleepSystem::getSleepingCount() const
+{
+	return sleepingCount;
+}
+
+uint32_t SleepSystem::getIslandCount() const
+{
+	return islandStart.empty() ? 0 : islandStart.size() - 1;
+}
+
+template void SleepSystem::update(ParticleStore& particles, const HierarchicalGrid& grid, const std::vector<Link>& links);
+template void SleepSystem::update(ParticleStore& particles, const SparseHierarchicalGrid& grid, const std::vector<Link>& links);
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cmath>
+
+#include "SpatialHashGrid.hpp"
+
+void SpatialHashGrid::resize(uint32_t, uint32_t, int cellSize)
+{
+	this->cellSize = std::max(cellSize, 1);
+	clear();
+}
+
+void SpatialHashGrid::clear()
+{
+	resetTable(0);
+	cellKeys.clear();
+	cellStart.assign(1, 0);
+	cellObjects.clear();
+	objectCell.clear();
+	bounds = {1, 1, 0, 0};
+	stats = CollisionGridStats();
+}
+
+bool SpatialHashGrid::getCellCoord(float position, uint32_t& cell) const
+{
+	const float limit = static_cast<float>(coordinateBias / 2);
+	const float coord = std::floor(position / cellSize);
+	// NaN fails both comparisons and lands at -limit
+	const bool inside = coord > -limit && coord < limit;
+	const float clamped = inside ? coord : (coord >= limit ? limit : -limit);
+	cell = static_cast<uint32_t>(static_cast<int32_t>(clamped)) + coordinateBias;
+	return inside;
+}
+
+void SpatialHashGrid::getCellCoords(float x, float y, uint32_t& cellX, uint32_t& cellY) const
+{
+	getCellCoord(x, cellX);
+	getCellCoord(y, cellY);
+}
+
+uint32_t SpatialHashGrid::getCellIndex(float x, float y) const
+{
+	uint32_t cellX, cellY;
+	getCellCoords(x, y, cellX, cellY);
+	return findCell(cellX, cellY);
+}
+
+CellRange SpatialHashGrid::getCellRange(float minX, float minY, float maxX, float maxY) const
+{
+	CellRange range;
+	getCellCoords(minX, minY, range.minX, range.minY);
+	getCellCoords(maxX, maxY, range.maxX, range.maxY);
+	return range;
+}
+
+uint32_t SpatialHashGrid::findColumn(uint32_t cellX) const
+{
+	return std::lower_bound(cellKeys.begin(), cellKeys.end(), getKey(cellX, 0)) - cellKeys.begin();
+}
+
+void SpatialHashGrid::resetTable(uint32_t insertions)
+{
+	// sized for the cells of the last build rather than for every insertion, objects with an extent share
+	// most of their cells and a table that stays in cache beats one that never grows
+	const uint32_t expectedCells = std::min<uint32_t>(insertions, cellKeys.size() + cellKeys.size() / 4);
+	uint32_t slotCount = 16;
+	while(slotCount < 2 * expectedCells)
+		slotCount *= 2;
+	slotKeys.assign(slotCount, emptySlot);
+	slotCells.resize(slotCount);
+	slotMask = slotCount - 1;
+	cellKeys.clear();
+	cellCount.clear();
+}
+
+void SpatialHashGrid::growTable()
+{
+	const uint32_t slotCount = 2 * (slotMask + 1);
+	slotKeys.assign(slotCount, emptySlot);
+	slotCells.resize(slotCount);
+	slotMask = slotCount - 1;
+	for(uint32_t c = 0; c < cellKeys.size(); c++)
+	{
+		uint32_t slot = hashKey(cellKeys[c]) & slotMask;
+		while(slotKeys[slot] != emptySlot)
+			slot = (slot + 1) & slotMask;
+		slotKeys[slot] = cellKeys[c];
+		slotCells[slot] = c;
+	}
+}
+
+uint32_t SpatialHashGrid::insert(uint64_t key)
+{
+	for(uint32_t slot = hashKey(key) & slotMask;; slot = (slot + 1) & slotMask)
+	{
+		if(slotKeys[slot] == key)
+		{
+			cellCount[slotCells[slot]]++;
+			return slotCells[slot];
+		}
+		if(slotKeys[slot] == emptySlot)
+		{
+			const uint32_t cell = cellKeys.size();
+			slotKeys[slot] = key;
+			slotCells[slot] = cell;
+			cellKeys.push_back(key);
+			cellCount.push_back(1);
+			// keep the table at most half full
+			if(2 * cellKeys.size() > slotMask + 1)
+				growTable();
+			return cell;
+		}
+	}
+}
+
+void SpatialHashGrid::sortCells()
+{
+	const uint32_t cells = cellKeys.size();
+	bounds = {1, 1, 0, 0};
+	if(cells > 0)
+		bounds = {0xffffffff, 0xffffffff, 0, 0};
+	for(uint64_t key : cellKeys)
+	{
+		const uint32_t cellX = static_cast<uint32_t>(key >> 32);
+		const uint32_t cellY = static_cast<uint32_t>(key);
+		bounds.minX = std::min(bounds.minX, cellX);
+		bounds.minY = std::min(bounds.minY, cellY);
+		bounds.maxX = std::max(bounds.maxX, cellX);
+		bounds.maxY = std::max(bounds.maxY, cellY);
+	}
+
+	// LSD radix sort of the cells on their coordinates relative to the bounds, 8 bit digits
+	// and only as many digits as the occupied area needs
+	uint32_t rowBits = 0;
+	while(rowBits < 32 && ((bounds.maxY - bounds.minY) >> rowBits) > 0)
+		rowBits++;
+	uint32_t columnBits = 0;
+	while(columnBits < 32 && ((bounds.maxX - bounds.minX) >> columnBits) > 0)
+		columnBits++;
+	const uint32_t keyBits = rowBits + columnBits;
+	relativeKeys.resize(cells);
+	relativeScratch.resize(cells);
+	order.resize(cells);
+	orderScratch.resize(cells);
+	for(uint32_t c = 0; c < cells; c++)
+	{
+		const uint64_t key = cellKeys[c];
+		relativeKeys[c] = (static_cast<uint64_t>(static_cast<uint32_t>(key >> 32) - bounds.minX) << rowBits)
+				| (static_cast<uint32_t>(key) - bounds.minY);
+		order[c] = c;
+	}
+	for(uint32_t shift = 0; shift < keyBits; shift += 8)
+	{
+		uint32_t offsets[257] = {};
+		for(uint32_t c = 0; c < cells; c++)
+			offsets[((relativeKeys[c] >> shift) & 0xff) + 1]++;
+		for(uint32_t d = 0; d < 256; d++)
+			offsets[d + 1] += offsets[d];
+		for(uint32_t c = 0; c < cells; c++)
+		{
+			const uint32_t slot = offsets[(relativeKeys[c] >> shift) & 0xff]++;
+			relativeScratch[slot] = relativeKeys[c];
+			orderScratch[slot] = order[c];
+		}
+		relativeKeys.swap(relativeScratch);
+		order.swap(orderScratch);
+	}
+
+	// order[rank] is the insertion index of the cell of that rank
+	cellRank.resize(cells);
+	cellStart.resize(cells + 1);
+	uint32_t sum = 0;
+	stats.occupiedCells = cells;
+	for(uint32_t rank = 0; rank < cells; rank++)
+	{
+		const uint32_t cell = order[rank];
+		cellRank[cell] = rank;
+		stats.maxCellOccupancy = std::max(stats.maxCellOccupancy, cellCount[cell]);
+		sum += cellCount[cell];
+		cellStart[rank] = sum;
+	}
+	cellStart[cells] = sum;
+	for(uint32_t slot = 0; slot <= slotMask; slot++)
+		if(slotKeys[slot] != emptySlot)
+			slotCells[slot] = cellRank[slotCells[slot]];
+	for(uint32_t c = 0; c < cells; c++)
+		relativeScratch[cellRank[c]] = cellKeys[c];
+	cellKeys.swap(relativeScratch);
+	linkColumns();
+}
+
+void SpatialHashGrid::linkColumns()
+{
+	const uint32_t cells = cellKeys.size();
+	leftStart.resize(cells);
+	rightStart.resize(cells);
+	uint32_t previous = 0; // first cell of the column before the current one
+	for(uint32_t begin = 0; begin < cells;)
+	{
+		const uint32_t cellX = static_cast<uint32_t>(cellKeys[begin] >> 32);
+		uint32_t end = begin + 1;
+		while(end < cells && static_cast<uint32_t>(cellKeys[end] >> 32) == cellX)
+			end++;
+		uint32_t nextEnd = end;
+		while(nextEnd < cells && static_cast<uint32_t>(cellKeys[nextEnd] >> 32) == cellX + 1)
+			nextEnd++;
+		// a side column that is not adjacent is an empty range, it points at a cell of another column
+		// which the row bound of forEachCellAround rejects
+		if(previous == begin || static_cast<uint32_t>(cellKeys[previous] >> 32) + 1 != cellX)
+			previous = begin;
+		uint32_t left = previous;
+		uint32_t right = end;
+		for(uint32_t c = begin; c < end; c++)
+		{
+			const uint32_t cellY = static_cast<uint32_t>(cellKeys[c]);
+			while(left < begin && cellKeys[left] < getKey(cellX - 1, cellY - 1))
+				left++;
+			while(right < nextEnd && cellKeys[right] < getKey(cellX + 1, cellY - 1))
+				right++;
+			leftStart[c] = left;
+			rightStart[c] = right;
+		}
+		previous = begin;
+		begin = end;
+	}
+}
+
+void SpatialHashGrid::build(const float* x, const float* y, uint32_t count)
+{
+	build(x, y, nullptr, count);
+}
+
+void SpatialHashGrid::build(const float* x, const float* y, const uint32_t* ids, uint32_t count)
+{
+	stats = CollisionGridStats();
+	resetTable(count);
+	objectCell.resize(count);
+	cellObjects.resize(count);
+	for(uint32_t k = 0; k < count; k++)
+	{
+		const uint32_t i = ids ? ids[k] : k;
+		uint32_t cellX, cellY;
+		const bool insideX = getCellCoord(x[i], cellX);
+		const bool insideY = getCellCoord(y[i], cellY);
+		if(!(insideX && insideY))
+			stats.clampedObjects++;
+		objectCell[k] = insert(getKey(cellX, cellY));
+	}
+	sortCells();
+
+	// scatter backwards so that ids stay in ascending order inside each cell
+	for(uint32_t k = count; k-- > 0;)
+	{
+		objectCell[k] = cellRank[objectCell[k]];
+		cellObjects[--cellStart[objectCell[k]]] = ids ? ids[k] : k;
+	}
+	stats.insertedObjects = count;
+}
+
+void SpatialHashGrid::build(const std::vector<CellRange>& ranges)
+{
+	stats = CollisionGridStats();
+	uint32_t insertions = 0;
+	for(const CellRange& range : ranges)
+		insertions += static_cast<uint32_t>(getRangeCellCount(range));
+	resetTable(insertions);
+	// objectCell keeps the cell of every insertion so that the scatter does not probe the table again
+	objectCell.resize(insertions);
+	uint32_t k = 0;
+	for(const CellRange& range : ranges)
+		for(uint32_t y = range.minY; y <= range.maxY; y++)
+			for(uint32_t x = range.minX; x <= range.maxX; x++)
+				objectCell[k++] = insert(getKey(x, y));
+	sortCells();
+
+	cellObjects.resize(insertions);
+	for(uint32_t i = ranges.size(); i-- > 0;)
+	{
+		const CellRange& range = ranges[i];
+		for(uint64_t n = getRangeCellCount(range); n > 0; n--)
+		{
+			k--;
+			cellObjects[--cellStart[cellRank[objectCell[k]]]] = i;
+		}
+	}
+	objectCell.clear();
+	stats.insertedObjects = ranges.size();
+}
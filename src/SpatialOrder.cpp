@@ -0,0 +1,44 @@
+#include "SpatialOrder.hpp"
+
+template<typename Grid>
+void MortonSorter::sort(const Grid& grid, const float* x, const float* y, uint32_t count, std::vector<uint32_t>& order)
+{
+	keys.resize(count);
+	keysScratch.resize(count);
+	order.resize(count);
+	orderScratch.resize(count);
+	// cells outside the bounds of the last build wrap around, which only costs locality
+	const CellRange bounds = grid.getBounds();
+	uint32_t allBits = 0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		uint32_t cellX, cellY;
+		grid.getCellCoords(x[i], y[i], cellX, cellY);
+		keys[i] = getMortonKey(cellX - bounds.minX, cellY - bounds.minY);
+		allBits |= keys[i];
+		order[i] = i;
+	}
+
+	// LSD radix sort on 8 bit digits, skipping the digits no key uses
+	for(uint32_t shift = 0; shift < 32; shift += 8)
+	{
+		if(((allBits >> shift) & 0xff) == 0)
+			continue;
+		uint32_t offsets[257] = {};
+		for(uint32_t i = 0; i < count; i++)
+			offsets[((keys[i] >> shift) & 0xff) + 1]++;
+		for(uint32_t d = 0; d < 256; d++)
+			offsets[d + 1] += offsets[d];
+		for(uint32_t i = 0; i < count; i++)
+		{
+			const uint32_t slot = offsets[(keys[i] >> shift) & 0xff]++;
+			keysScratch[slot] = keys[i];
+			orderScratch[slot] = order[i];
+		}
+		keys.swap(keysScratch);
+		order.swap(orderScratch);
+	}
+}
+
+template void MortonSorter::sort(const CollisionGrid& grid, const float* x, const float* y, uint32_t count, std::vector<uint32_t>& order);
+template void MortonSorter::sort(const SpatialHashGrid& grid, const float* x, const float* y, uint32_t count, std::vector<uint32_t>& order);
@@ -0,0 +1,123 @@
+#include <thread>
+
+#include "TaskGraph.hpp"
+
+void TaskGraph::reset(uint32_t taskCount)
+{
+	this->taskCount = taskCount;
+	dependencyCount.assign(taskCount, 0);
+	edgeBefore.clear();
+	edgeAfter.clear();
+	successorsDirty = true;
+}
+
+void TaskGraph::addDependency(uint32_t before, uint32_t after)
+{
+	edgeBefore.push_back(before);
+	edgeAfter.push_back(after);
+	dependencyCount[after]++;
+	successorsDirty = true;
+}
+
+void TaskGraph::buildSuccessors()
+{
+	successorStart.assign(taskCount + 1, 0);
+	for(uint32_t before : edgeBefore)
+		successorStart[before + 1]++;
+	for(uint32_t t = 0; t < taskCount; t++)
+		successorStart[t + 1] += successorStart[t];
+	successors.resize(edgeBefore.size());
+	std::vector<uint32_t> next(successorStart.begin(), successorStart.end() - 1);
+	for(uint32_t e = 0; e < edgeBefore.size(); e++)
+		successors[next[edgeBefore[e]]++] = edgeAfter[e];
+	successorsDirty = false;
+}
+
+void TaskGraph::push(uint32_t thread, uint32_t task)
+{
+	ReadyQueue& queue = *queues[thread];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	queue.tasks[queue.tail++] = task;
+}
+
+bool TaskGraph::popBack(uint32_t thread, uint32_t& task)
+{
+	ReadyQueue& queue = *queues[thread];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if(queue.head == queue.tail)
+		return false;
+	task = queue.tasks[--queue.tail];
+	return true;
+}
+
+bool TaskGraph::popFront(uint32_t thread, uint32_t& task)
+{
+	ReadyQueue& queue = *queues[thread];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if(queue.head == queue.tail)
+		return false;
+	task = queue.tasks[queue.head++];
+	return true;
+}
+
+void TaskGraph::work(uint32_t thread, const std::function<void(uint32_t)>& task)
+{
+	const uint32_t threadCount = queues.size();
+	while(remaining.load(std::memory_order_acquire) > 0)
+	{
+		uint32_t t;
+		bool found = popBack(thread, t);
+		for(uint32_t k = 1; !found && k < threadCount; k++)
+			found = popFront((thread + k) % threadCount, t);
+		if(!found)
+		{
+			// every ready task is taken, the ones left wait on tasks still running
+			std::this_thread::yield();
+			continue;
+		}
+		task(t);
+		for(uint32_t e = successorStart[t]; e < successorStart[t + 1]; e++)
+			if(pending[successors[e]].fetch_sub(1, std::memory_order_acq_rel) == 1)
+				push(thread, successors[e]);
+		remaining.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+void TaskGraph::run(ThreadPool& pool, const std::function<void(uint32_t)>& task)
+{
+	if(taskCount == 0)
+		return;
+	if(successorsDirty)
+		buildSuccessors();
+	if(pendingCapacity < taskCount)
+	{
+		pending.reset(new std::atomic<uint32_t>[taskCount]);
+		pendingCapacity = taskCount;
+	}
+	const uint32_t threadCount = pool.getThreadCount();
+	while(queues.size() < threadCount)
+		queues.emplace_back(new ReadyQueue());
+	queues.resize(threadCount);
+	for(const std::unique_ptr<ReadyQueue>& queue : queues)
+	{
+		queue->tasks.resize(taskCount);
+		queue->head = 0;
+		queue->tail = 0;
+	}
+	// the tasks ready from the start are dealt round robin, stealing evens out the rest
+	uint32_t ready = 0;
+	for(uint32_t t = 0; t < taskCount; t++)
+	{
+		pending[t].store(dependencyCount[t], std::memory_order_relaxed);
+		if(dependencyCount[t] == 0)
+		{
+			ReadyQueue& queue = *queues[ready++ % threadCount];
+			queue.tasks[queue.tail++] = t;
+		}
+	}
+	remaining.store(taskCount, std::memory_order_release);
+	pool.run([this, &task](uint32_t thread)
+	{
+		work(thread, task);
+	});
+}
@@ -0,0 +1,84 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+	// the caller of dispatch is the first thread of the pool
+	for(uint32_t i = 1; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	startCondition.notify_all();
+	for(std::thread& worker : workers)
+		worker.join();
+}
+
+uint32_t ThreadPool::getThreadCount() const
+{
+	return workers.size() + 1;
+}
+
+void ThreadPool::dispatch(uint32_t taskCount, const std::function<void(uint32_t)>& task)
+{
+	if(workers.empty() || taskCount <= 1)
+	{
+		for(uint32_t i = 0; i < taskCount; i++)
+			task(i);
+		return;
+	}
+	nextTask.store(0, std::memory_order_relaxed);
+	run([this, taskCount, &task](uint32_t)
+	{
+		uint32_t i;
+		while((i = nextTask.fetch_add(1, std::memory_order_relaxed)) < taskCount)
+			task(i);
+	});
+}
+
+void ThreadPool::run(const std::function<void(uint32_t)>& work)
+{
+	if(workers.empty())
+	{
+		work(0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &work;
+		busyWorkers = workers.size();
+		generation++;
+	}
+	startCondition.notify_all();
+	work(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this]{ return busyWorkers == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::workerLoop(uint32_t thread)
+{
+	uint64_t seenGeneration = 0;
+	while(true)
+	{
+		const std::function<void(uint32_t)>* work;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			startCondition.wait(lock, [&]{ return stopping || generation != seenGeneration; });
+			if(stopping)
+				return;
+			seenGeneration = generation;
+			work = job;
+		}
+		(*work)(thread);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(--busyWorkers == 0)
+				doneCondition.notify_one();
+		}
+	}
+}
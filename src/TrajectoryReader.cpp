@@ -0,0 +1,197 @@
+#include <cstring>
+
+#include "TrajectoryReader.hpp"
+
+#ifdef _WIN32
+	#define trajectorySeek _fseeki64
+	#define trajectoryTell _ftelli64
+#else
+	#define trajectorySeek fseeko
+	#define trajectoryTell ftello
+#endif
+
+template<typename T>
+static bool readArray(const uint8_t*& data, const uint8_t* end, std::vector<T>& values, uint32_t start, uint32_t count)
+{
+	const uint64_t bytes = static_cast<uint64_t>(count) * sizeof(T);
+	if(static_cast<uint64_t>(end - data) < bytes)
+		return false;
+	values.resize(start + count);
+	if(bytes > 0)
+		std::memcpy(values.data() + start, data, bytes);
+	data += bytes;
+	return true;
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+	close();
+}
+
+bool TrajectoryReader::open(const std::string& path)
+{
+	close();
+	file = std::fopen(path.c_str(), "rb");
+	if(!file)
+		return false;
+	if(std::fread(&fileHeader, sizeof(fileHeader), 1, file) != 1
+			|| std::memcmp(fileHeader.magic, trajectoryMagic, sizeof(trajectoryMagic)) != 0
+			|| fileHeader.version != trajectoryVersion || !(fileHeader.quantization > 0.0f))
+	{
+		close();
+		return false;
+	}
+	trajectorySeek(file, 0, SEEK_END);
+	const uint64_t fileSize = trajectoryTell(file);
+	uint64_t offset = sizeof(fileHeader);
+	TrajectoryRecordHeader header;
+	while(offset + sizeof(header) <= fileSize)
+	{
+		trajectorySeek(file, offset, SEEK_SET);
+		if(std::fread(&header, sizeof(header), 1, file) != 1 || offset + sizeof(header) + header.payloadSize > fileSize)
+			break;
+		// the first record must be a keyframe, anything before one could not be decoded
+		if(records.empty() && header.type != TRAJECTORY_KEYFRAME)
+			break;
+		records.push_back({offset, header.frame, header.type == TRAJECTORY_KEYFRAME});
+		offset += sizeof(header) + header.payloadSize;
+	}
+	return true;
+}
+
+void TrajectoryReader::close()
+{
+	if(file)
+		std::fclose(file);
+	file = nullptr;
+	records.clear();
+	decodedRecord = -1;
+	history = TrajectoryHistory();
+}
+
+uint32_t TrajectoryReader::getRecordCount() const
+{
+	return records.size();
+}
+
+uint64_t TrajectoryReader::getFrame(uint32_t index) const
+{
+	return records[index].frame;
+}
+
+uint32_t TrajectoryReader::getKeyframeInterval() const
+{
+	return fileHeader.keyframeInterval;
+}
+
+float TrajectoryReader::getQuantization() const
+{
+	return fileHeader.quantization;
+}
+
+bool TrajectoryReader::decodeRecord(uint32_t index)
+{
+	TrajectoryRecordHeader header;
+	trajectorySeek(file, records[index].offset, SEEK_SET);
+	if(std::fread(&header, sizeof(header), 1, file) != 1)
+		return false;
+	payload.resize(header.payloadSize);
+	if(header.payloadSize > 0 && std::fread(payload.data(), header.payloadSize, 1, file) != 1)
+		return false;
+	const bool keyframe = header.type == TRAJECTORY_KEYFRAME;
+	const uint32_t count = header.particleCount;
+	// keyframes resend everything, other records continue the arrays where the previous one left them
+	if(header.staticStart > count || header.linkStart > header.linkCount
+			|| (keyframe && (header.staticStart != 0 || header.linkStart != 0))
+			|| (!keyframe && (header.staticStart != radius.size() || 2 * header.linkStart != links.size())))
+		return false;
+	// nothing is resized for counts the payload is too small to hold
+	const uint64_t staticSize = static_cast<uint64_t>(count - header.staticStart) * (sizeof(float) + sizeof(Color) + sizeof(uint8_t));
+	const uint64_t linkSize = static_cast<uint64_t>(header.linkCount - header.linkStart) * 2 * sizeof(int32_t);
+	if(staticSize + linkSize + 2 * getMinimumAxisSize(count) > header.payloadSize)
+		return false;
+
+	const uint8_t* data = payload.data();
+	const uint8_t* end = data + payload.size();
+	const uint32_t staticCount = count - header.staticStart;
+	if(!readArray(data, end, radius, header.staticStart, staticCount)
+			|| !readArray(data, end, colors, header.staticStart, staticCount)
+			|| !readArray(data, end, flags, header.staticStart, staticCount)
+			|| !readArray(data, end, links, 2 * header.linkStart, 2 * (header.linkCount - header.linkStart)))
+		return false;
+	for(uint32_t k = 2 * header.linkStart; k < links.size(); k++)
+		if(links[k] < 0 || static_cast<uint32_t>(links[k]) >= count)
+			return false;
+
+	if(!unpackTrajectoryAxis(data, end, history.x, count, keyframe, history.framesSinceKeyframe)
+			|| !unpackTrajectoryAxis(data, end, history.y, count, keyframe, history.framesSinceKeyframe))
+		return false;
+	history.advance();
+	history.framesSinceKeyframe = keyframe ? 1 : history.framesSinceKeyframe + 1;
+	decodedRecord = index;
+	return true;
+}
+
+bool TrajectoryReader::read(uint32_t index, RenderSnapshot& snapshot)
+{
+	if(index >= records.size())
+		return false;
+	// paused or at the last record the same index comes every display frame, its positions are still in history
+	if(decodedRecord != static_cast<int64_t>(index))
+	{
+		if(decodedRecord < 0 || index < static_cast<uint32_t>(decodedRecord) || records[index].keyframe)
+		{
+			// restart from the closest keyframe at or before index
+			uint32_t keyframe = index;
+			while(!records[keyframe].keyframe)
+				keyframe--;
+			decodedRecord = static_cast<int64_t>(keyframe) - 1;
+		}
+		else
+		{
+			// a keyframe between the decoded record and the target lets the decoder skip ahead
+			for(uint32_t k = index; k > decodedRecord + 1; k--)
+			{
+				if(records[k].keyframe)
+				{
+					decodedRecord = static_cast<int64_t>(k) - 1;
+					break;
+				}
+			}
+		}
+		while(decodedRecord < static_cast<int64_t>(index))
+		{
+			if(!decodeRecord(decodedRecord + 1))
+			{
+				decodedRecord = -1;
+				return false;
+			}
+		}
+	}
+
+	// after advance() the decoded frame is history slot 1
+	const std::vector<int32_t>& x = history.x[1];
+	const std::vector<int32_t>& y = history.y[1];
+	const uint32_t count = x.size();
+	const float quantization = fileHeader.quantization;
+	snapshot.x.resize(count);
+	snapshot.y.resize(count);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		snapshot.x[i] = x[i] * quantization;
+		snapshot.y[i] = y[i] * quantization;
+	}
+	snapshot.radius.assign(radius.begin(), radius.begin() + count);
+	snapshot.flags.assign(flags.begin(), flags.begin() + count);
+	snapshot.colors.assign(colors.begin(), colors.begin() + count);
+	snapshot.handles.clear();
+	const uint32_t linkCount = links.size() / 2;
+	snapshot.linkPoints.resize(2 * linkCount);
+	for(uint32_t l = 0; l < linkCount; l++)
+	{
+		snapshot.linkPoints[2 * l] = {snapshot.x[links[2 * l]], snapshot.y[links[2 * l]]};
+		snapshot.linkPoints[2 * l + 1] = {snapshot.x[links[2 * l + 1]], snapshot.y[links[2 * l + 1]]};
+	}
+	snapshot.frame = records[index].frame;
+	return true;
+}
@@ -0,0 +1,228 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "TrajectoryRecorder.hpp"
+#include "Engine.hpp"
+
+// positions outside this range are clamped, far beyond any world the grid can hold
+static const float quantizationLimit = 2.0e9f;
+
+static void quantize(const std::vector<float>& values, float scale, std::vector<int32_t>& out)
+{
+	out.resize(values.size());
+	for(uint32_t i = 0; i < values.size(); i++)
+		out[i] = static_cast<int32_t>(std::lrint(std::min(std::max(values[i] * scale, -quantizationLimit), quantizationLimit)));
+}
+
+template<typename T>
+static void appendBytes(std::vector<uint8_t>& out, const T* values, uint32_t count)
+{
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+	out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	close();
+}
+
+bool TrajectoryRecorder::open(const std::string& path, const TrajectorySettings& settings)
+{
+	close();
+	file = std::fopen(path.c_str(), "wb");
+	if(!file)
+		return false;
+	this->settings = settings;
+	this->settings.keyframeInterval = std::max(this->settings.keyframeInterval, 1u);
+	TrajectoryFileHeader header = {};
+	std::memcpy(header.magic, trajectoryMagic, sizeof(header.magic));
+	header.version = trajectoryVersion;
+	header.quantization = this->settings.quantization;
+	header.keyframeInterval = this->settings.keyframeInterval;
+	if(std::fwrite(&header, sizeof(header), 1, file) != 1)
+	{
+		std::fclose(file);
+		file = nullptr;
+		return false;
+	}
+
+	sentParticles = 0;
+	sentLinks = 0;
+	sentReorderCount = 0;
+	sentRemovalCount = 0;
+	firstFrame = true;
+	history = TrajectoryHistory();
+	recordedFrames = 0;
+	bytesWritten = sizeof(header);
+	rawBytes = 0;
+	stopping = false;
+	writeFailed = false;
+	writer = std::thread(&TrajectoryRecorder::writerLoop, this);
+	return true;
+}
+
+void TrajectoryRecorder::record(const Engine& engine)
+{
+	if(!file)
+		return;
+	int k;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this]{ return frameStates[0] == FRAME_FREE || frameStates[1] == FRAME_FREE; });
+		k = frameStates[0] == FRAME_FREE ? 0 : 1;
+	}
+
+	Frame& frame = frames[k];
+	const ParticleStore& particles = engine.getParticles();
+	const std::vector<Link>& engineLinks = engine.getLinks();
+	const uint32_t count = particles.size();
+	const uint32_t linkCount = engineLinks.size();
+	// reordering renumbers every particle, a removal moves the last particle or link into the hole
+	frame.resync = firstFrame || engine.getReorderCount() != sentReorderCount || engine.getRemovalCount() != sentRemovalCount
+			|| count < sentParticles || linkCount < sentLinks;
+	frame.frame = engine.getFrameCount();
+	const float scale = 1.0f / settings.quantization;
+	quantize(particles.x, scale, frame.x);
+	quantize(particles.y, scale, frame.y);
+
+	frame.staticStart = frame.resync ? 0 : sentParticles;
+	frame.radius.assign(particles.radius.begin() + frame.staticStart, particles.radius.end());
+	frame.colors.assign(particles.colors.begin() + frame.staticStart, particles.colors.end());
+	frame.flags.resize(count - frame.staticStart);
+	// only the fixed flag matters for drawing, sleeping changes too often to count as static data
+	for(uint32_t i = frame.staticStart; i < count; i++)
+		frame.flags[i - frame.staticStart] = particles.flags[i] & PARTICLE_FIXED;
+	frame.linkStart = frame.resync ? 0 : sentLinks;
+	frame.links.resize(2 * (linkCount - frame.linkStart));
+	for(uint32_t l = frame.linkStart; l < linkCount; l++)
+	{
+		frame.links[2 * (l - frame.linkStart)] = engineLinks[l].getFirst();
+		frame.links[2 * (l - frame.linkStart) + 1] = engineLinks[l].getSecond();
+	}
+	sentParticles = count;
+	sentLinks = linkCount;
+	sentReorderCount = engine.getReorderCount();
+	sentRemovalCount = engine.getRemovalCount();
+	firstFrame = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		frameStates[k] = FRAME_QUEUED;
+		queuedFrames.push_back(k);
+	}
+	condition.notify_all();
+}
+
+void TrajectoryRecorder::writerLoop()
+{
+	while(true)
+	{
+		int k;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]{ return stopping || !queuedFrames.empty(); });
+			if(queuedFrames.empty())
+				return;
+			k = queuedFrames.front();
+			queuedFrames.pop_front();
+			frameStates[k] = FRAME_ENCODING;
+		}
+		const bool ok = encode(frames[k]);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			frameStates[k] = FRAME_FREE;
+			writeFailed |= !ok;
+		}
+		condition.notify_all();
+	}
+}
+
+bool TrajectoryRecorder::encode(Frame& frame)
+{
+	const uint32_t count = frame.x.size();
+	if(frame.resync)
+	{
+		radius.swap(frame.radius);
+		colors.swap(frame.colors);
+		flags.swap(frame.flags);
+		links.swap(frame.links);
+	}
+	else
+	{
+		radius.resize(frame.staticStart);
+		radius.insert(radius.end(), frame.radius.begin(), frame.radius.end());
+		colors.resize(frame.staticStart);
+		colors.insert(colors.end(), frame.colors.begin(), frame.colors.end());
+		flags.resize(frame.staticStart);
+		flags.insert(flags.end(), frame.flags.begin(), frame.flags.end());
+		links.resize(2 * frame.linkStart);
+		links.insert(links.end(), frame.links.begin(), frame.links.end());
+	}
+	const bool keyframe = frame.resync || recordedFrames == 0 || history.framesSinceKeyframe >= settings.keyframeInterval;
+
+	TrajectoryRecordHeader header = {};
+	header.type = keyframe ? TRAJECTORY_KEYFRAME : TRAJECTORY_DELTA;
+	header.frame = frame.frame;
+	header.particleCount = count;
+	header.linkCount = links.size() / 2;
+	header.staticStart = keyframe ? 0 : frame.staticStart;
+	header.linkStart = keyframe ? 0 : frame.linkStart;
+
+	payload.clear();
+	appendBytes(payload, radius.data() + header.staticStart, count - header.staticStart);
+	appendBytes(payload, colors.data() + header.staticStart, count - header.staticStart);
+	appendBytes(payload, flags.data() + header.staticStart, count - header.staticStart);
+	appendBytes(payload, links.data() + 2 * header.linkStart, 2 * (header.linkCount - header.linkStart));
+
+	// the frame buffer takes the oldest history arrays back, the next capture overwrites them
+	history.x[0].swap(frame.x);
+	history.y[0].swap(frame.y);
+	packTrajectoryAxis(history.x, keyframe, history.framesSinceKeyframe, payload);
+	packTrajectoryAxis(history.y, keyframe, history.framesSinceKeyframe, payload);
+	history.advance();
+	history.framesSinceKeyframe = keyframe ? 1 : history.framesSinceKeyframe + 1;
+
+	header.payloadSize = payload.size();
+	const bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+			&& (payload.empty() || std::fwrite(payload.data(), payload.size(), 1, file) == 1);
+	recordedFrames++;
+	bytesWritten += sizeof(header) + payload.size();
+	rawBytes += 2ull * sizeof(float) * count;
+	return ok;
+}
+
+bool TrajectoryRecorder::close()
+{
+	if(!file)
+		return true;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	writer.join();
+	const bool ok = !writeFailed && std::fclose(file) == 0;
+	file = nullptr;
+	return ok;
+}
+
+bool TrajectoryRecorder::isOpen() const
+{
+	return file != nullptr;
+}
+
+uint64_t TrajectoryRecorder::getRecordedFrames() const
+{
+	return recordedFrames;
+}
+
+uint64_t TrajectoryRecorder::getBytesWritten() const
+{
+	return bytesWritten;
+}
+
+uint64_t TrajectoryRecorder::getRawBytes() const
+{
+	return rawBytes;
+}
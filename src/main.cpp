@@ -3,20 +3,23 @@
 #include <TGUI/Backend/SFML-Graphics.hpp>
 #include <iostream>
 #include <cmath>
+#include <thread>
 
 #include "VerletObject.hpp"
 #include "Engine.hpp"
 #include "Renderer.hpp"
+#include "SimulationThread.hpp"
+#include "SfmlConversions.hpp"
+#include "Checkpoint.hpp"
+#include "TrajectoryReader.hpp"
 
-int selectObjectAtPosition(Engine& engine, const sf::Vector2f& position)
+int selectObjectAtPosition(const RenderSnapshot& snapshot, const sf::Vector2f& position, float selectionRadius)
 {
-    const float selectionRadius = engine.getGrid().cellSize / 2.0f;
     float minDistSqr = selectionRadius * selectionRadius;
     int selectedObj = -1;
-    for(int i = 0; i < engine.getObjects().size(); ++i)
+    for(int i = 0; i < snapshot.size(); ++i)
     {
-        const auto& obj = engine.getObjects()[i];
-        sf::Vector2f distVec = obj.getPosition() - position;
+        sf::Vector2f distVec = sf::Vector2f(snapshot.x[i], snapshot.y[i]) - position;
         float distSqr = distVec.x * distVec.x + distVec.y * distVec.y;
         if(distSqr < minDistSqr)
         {
@@ -28,29 +31,84 @@ int selectObjectAtPosition(Engine& engine, const sf::Vector2f& position)
     return selectedObj;
 }
 
-void collisionSimulation(Engine& engine, sf::Clock& spawnClock, int& objCount, const float& objRadius, const float& objRigidness)
+void collisionSimulation(SimulationThread& simulation, sf::Clock& spawnClock, int& objCount, const float& objRadius, const float& objRigidness)
 {
 	const int maxObjCount = 10;
 	const float objectSpawnDelay = 0.05f;
 	const float objectSpawnSpeed = 1000.f;
 	const float angle = -M_PI/6.0f;
-	const sf::Vector2f objectSpawnPosition = {100.0f, 100.0f};
+	const Vec2 objectSpawnPosition = {100.0f, 100.0f};
 	if(spawnClock.getElapsedTime().asSeconds() >= objectSpawnDelay)
 	{
 		spawnClock.restart();
 		objCount++;
 		VerletObject obj(objectSpawnPosition, objRadius, objRigidness, false);
-		engine.setObjectVelocity(obj, objectSpawnSpeed * sf::Vector2f{cos(angle), sin(angle)});
-		engine.getObjects().push_back(obj);
+		simulation.post([obj, objectSpawnSpeed, angle](Engine& engine) mutable
+		{
+			engine.setObjectVelocity(obj, objectSpawnSpeed * Vec2{cos(angle), sin(angle)});
+			engine.addObject(obj);
+		});
 	}
 
 }
 
-int main()
+// plays a trajectory recorded by TrajectoryRecorder: space pauses, left/right seek, home restarts
+int replayTrajectory(const char* path, int width, int height, float frameRate)
+{
+	TrajectoryReader reader;
+	if(!reader.open(path) || reader.getRecordCount() == 0)
+	{
+		std::cerr << "cannot replay " << path << std::endl;
+		return 1;
+	}
+	sf::RenderWindow window(sf::VideoMode(width, height), "Physics Simulation Engine - replay");
+	window.setFramerateLimit(frameRate);
+	Renderer renderer(window);
+	RenderSnapshot snapshot;
+	const int64_t seekStep = std::max<int64_t>(reader.getKeyframeInterval(), 1);
+	const int64_t lastRecord = reader.getRecordCount() - 1;
+	int64_t record = 0;
+	bool playing = true;
+	while(window.isOpen())
+	{
+		sf::Event event;
+		while(window.pollEvent(event))
+		{
+			if(event.type == sf::Event::Closed)
+				window.close();
+			if(event.type == sf::Event::KeyPressed)
+			{
+				if(event.key.code == sf::Keyboard::Space)
+					playing = !playing;
+				else if(event.key.code == sf::Keyboard::Right)
+					record = std::min(record + seekStep, lastRecord);
+				else if(event.key.code == sf::Keyboard::Left)
+					record = std::max<int64_t>(record - seekStep, 0);
+				else if(event.key.code == sf::Keyboard::Home)
+					record = 0;
+			}
+		}
+		if(!reader.read(record, snapshot))
+		{
+			std::cerr << "corrupt record " << record << " in " << path << std::endl;
+			return 1;
+		}
+		window.clear(sf::Color::Black);
+		renderer.render(snapshot);
+		window.display();
+		if(playing && record < lastRecord)
+			record++;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
 {
 	const int WIN_WIDTH = 1500;
 	const int WIN_HEIGHT = 1000;
 	const float frameRate = 60.0f;
+	if(argc == 3 && std::string(argv[1]) == "--replay")
+		return replayTrajectory(argv[2], WIN_WIDTH, WIN_HEIGHT, frameRate);
 	const float timeStep = 1.0f / frameRate;
 	const int subSteps = 4;
 	float objRadius = 5.0f;
@@ -62,16 +120,26 @@ int main()
 
 	int objCount = 0;
 	int selectedObj = -1;
-	int firstObj = -1;
-	int secondObj = -1;
+	// the first end is kept as a handle, the particle may move to another index before the link is posted
+	ParticleHandle firstObj;
+	Vec2 firstPos;
 	bool simulationRunning = false, collisionSimSelected = false, addObj = false, addObjFixed = false, addLink = false;
 
+	// the font is optional, try the usual system locations instead of a single hard-coded path
+	const char* fontPaths[] = {"C:/Windows/Fonts/arial.ttf", "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+			"/usr/share/fonts/TTF/DejaVuSans.ttf", "/System/Library/Fonts/Supplemental/Arial.ttf"};
 	sf::Font font;
-	if (!font.loadFromFile("C:/Windows/Fonts/arial.ttf"))
+	bool fontLoaded = false;
+	for(const char* fontPath : fontPaths)
 	{
-		std::cerr << "Failed to load font\n";
-		return -1;
+		if(font.loadFromFile(fontPath))
+		{
+			fontLoaded = true;
+			break;
+		}
 	}
+	if(!fontLoaded)
+		std::cerr << "Failed to load font\n";
 
     sf::RenderWindow window(sf::VideoMode(WIN_WIDTH, WIN_HEIGHT), "Physics Simulation Engine");
     window.setFramerateLimit(frameRate);
@@ -99,18 +167,18 @@ int main()
 //	instructionsText->setHorizontalAlignment(tgui::Label::HorizontalAlignment::Left);
 	panel->add(instructionsText);
 
-//	auto radiusSlider = tgui::Slider::create(5, 15);
-//	radiusSlider->setSize({"80%", "3%"});
-//	radiusSlider->setStep(5);
-//	radiusSlider->setPosition({"10%", "25%"});
-//	radiusSlider->setValue(5); // Default value
-//	panel->add(radiusSlider);
-//
-//	auto radiusText = tgui::Label::create("Object radius: 5");
-//	radiusText->setSize({"80%", "4%"});
-//	radiusText->setPosition({"10%", "30%"});
-//	radiusText->setTextSize(16);
-//	panel->add(radiusText);
+	auto radiusSlider = tgui::Slider::create(5, 15);
+	radiusSlider->setSize({"80%", "3%"});
+	radiusSlider->setStep(5);
+	radiusSlider->setPosition({"10%", "25%"});
+	radiusSlider->setValue(5); // Default value
+	panel->add(radiusSlider);
+
+	auto radiusText = tgui::Label::create("Object radius: 5");
+	radiusText->setSize({"80%", "4%"});
+	radiusText->setPosition({"10%", "30%"});
+	radiusText->setTextSize(16);
+	panel->add(radiusText);
 
 	auto createObjectButton = tgui::Button::create("Create Object");
 	createObjectButton->setSize({"25%", "4%"});
@@ -168,7 +236,7 @@ int main()
 	panel->add(frameRateText);
 
 	createObjectButton->onClick([&](){addObj = !addObj; addLink = false;});
-	createLinkButton->onClick([&](){addObj = false; addLink = !addLink; firstObj = -1; secondObj = -1;});
+	createLinkButton->onClick([&](){addObj = false; addLink = !addLink; firstObj = ParticleHandle();});
 	stiffnessComboBox->onItemSelect([&](const tgui::String& item)
 	{
 		if(item == "Low")
@@ -202,28 +270,29 @@ int main()
 //		{
 //		}
 	});
-	runSimulationButton->onClick([&](){simulationRunning = !simulationRunning;});
 	//END GUI CREATION
 
     sf::Vector2u windowSize = window.getSize();
     sf::FloatRect windowBounds(0, 0, windowSize.x - panel->getFullSize().x, windowSize.y);
-    Engine engine(windowBounds, timeStep, subSteps, 2.0*objRadius);
+    Engine engine(fromSf(windowBounds), timeStep, subSteps, 2.0*objRadius, std::max(std::thread::hardware_concurrency(), 1u));
     Renderer renderer(window);
+    // physics runs on its own thread, the UI thread only posts edits and draws the latest snapshot
+    SimulationThread simulation(engine);
+    simulation.start();
+    runSimulationButton->onClick([&](){simulationRunning = !simulationRunning; simulation.setRunning(simulationRunning);});
 
-//    radiusSlider->onValueChange([&](float value)
-//	{
-//		radiusText->setText("Object radius: " + std::to_string(static_cast<int>(value)));
-//		if(value != objRadius)
-//		{
-//			engine.setGridCellSize(2.0*value);
-//		}
-//		objRadius = value;
-//	});
+    // the hierarchical grid takes any radius, the cell size stays the one of the smallest objects
+    radiusSlider->onValueChange([&](float value)
+	{
+		radiusText->setText("Object radius: " + std::to_string(static_cast<int>(value)));
+		objRadius = value;
+	});
 
     sf::Clock frameClock;
     sf::Clock spawnClock;
     while (window.isOpen())
 	{
+		const RenderSnapshot& snapshot = simulation.acquireSnapshot();
 		sf::Event event;
 		while(window.pollEvent(event))
 		{
@@ -232,6 +301,34 @@ int main()
 			{
 				window.close();
 			}
+			// F5 saves the running scene, F9 brings it back
+			if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F5)
+			{
+				simulation.post([](Engine& engine)
+				{
+					if(!Checkpoint::save(engine, "physeng-checkpoint.bin"))
+						std::cout << "could not write physeng-checkpoint.bin" << std::endl;
+				});
+			}
+			if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F9)
+			{
+				simulation.post([](Engine& engine)
+				{
+					if(!Checkpoint::restore(engine, "physeng-checkpoint.bin"))
+						std::cout << "could not restore physeng-checkpoint.bin" << std::endl;
+				});
+			}
+#ifdef PHYSENG_PROFILING
+			// dump the recent frames between two simulation steps, open the file with Perfetto
+			if(event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::P)
+			{
+				simulation.post([](Engine&)
+				{
+					if(Profiler::get().writeChromeTrace("physeng-trace.json"))
+						std::cout << "trace written to physeng-trace.json" << std::endl;
+				});
+			}
+#endif
 
 			if(event.type == sf::Event::MouseButtonPressed)
 			{
@@ -245,33 +342,38 @@ int main()
 						if(addObj)
 						{
 							bool fixed = createFixedObjectCheckbox->isChecked();
-							VerletObject obj(mousePos, objRadius, objRigidness, fixed);
-							engine.getObjects().push_back(obj);
+							VerletObject obj(fromSf(mousePos), objRadius, objRigidness, fixed);
+							simulation.post([obj](Engine& engine){ engine.addObject(obj); });
 							objCount++;
 						}
 						else if(addLink)
 						{
 							bool isSpring = createSpringLinkCheckbox->isChecked();
-							int selectedObj = selectObjectAtPosition(engine, mousePos);
+							int selectedObj = selectObjectAtPosition(snapshot, mousePos, objRadius);
 							if(selectedObj != -1)
 							{
-								if(firstObj == -1)
+								if(firstObj.isNull())
 								{
-									firstObj = selectedObj;
+									firstObj = snapshot.handles[selectedObj];
+									firstPos = {snapshot.x[selectedObj], snapshot.y[selectedObj]};
 								}
-								else if(secondObj == -1)
+								else
 								{
-									secondObj = selectedObj;
-									sf::Vector2f pos1 = engine.getObjects()[firstObj].getPosition();
-									sf::Vector2f pos2 = engine.getObjects()[secondObj].getPosition();
+									ParticleHandle secondObj = snapshot.handles[selectedObj];
+									Vec2 pos1 = firstPos;
+									Vec2 pos2 = {snapshot.x[selectedObj], snapshot.y[selectedObj]};
 									float restLength = sqrt((pos2.x - pos1.x) * (pos2.x - pos1.x) + (pos2.y - pos1.y) * (pos2.y - pos1.y));
 									//setting rest length to half the initial distance between linked objects to see sprng effect
 									if(isSpring)
 										restLength *= 0.5f;
-									Link link(firstObj, secondObj, restLength, linkStiffness, isSpring);
-									engine.getLinks().push_back(link);
-									firstObj = -1;
-									secondObj = -1;
+									ParticleHandle first = firstObj;
+									simulation.post([first, secondObj, restLength, isSpring, linkStiffness](Engine& engine)
+									{
+										// either end may have been removed since the clicks
+										if(first != secondObj && engine.isValid(first) && engine.isValid(secondObj))
+											engine.addLink(Link(engine.getObjectIndex(first), engine.getObjectIndex(secondObj), restLength, linkStiffness, isSpring));
+									});
+									firstObj = ParticleHandle();
 								}
 							}
 						}
@@ -283,7 +385,7 @@ int main()
 
 		if(simulationRunning && collisionSimSelected)
 		{
-			collisionSimulation(engine, spawnClock, objCount, objRadius, objRigidness);
+			collisionSimulation(simulation, spawnClock, objCount, objRadius, objRigidness);
 		}
 
 
@@ -291,18 +393,19 @@ int main()
 		sf::Time frameTime = frameClock.restart();
 		float frameTimeSeconds = frameTime.asSeconds();
 		float currentFrameRate = 1.0f / frameTimeSeconds;
-		if(currentFrameRate < frameRate-40)
+		// rendering no longer stalls physics, so the guard watches the simulation step rate instead
+		float stepRate = simulation.getStepRate();
+		if(simulationRunning && stepRate > 0.0f && stepRate < frameRate-40)
 		{
 			std::cout << "framerate dropped below 20" << std::endl;
 			std::cout << "max objects: " + std::to_string(objCount) << std::endl;
 			simulationRunning = false;
 			collisionSimSelected = false;
+			simulation.setRunning(false);
 		}
 
-		if(simulationRunning)
-			engine.update();
 		window.clear(sf::Color::Black);
-		renderer.render(engine);
+		renderer.render(snapshot);
 
 		objectCountText->setText("Objects: " + std::to_string(objCount));
 		frameRateText->setText("FPS: " + std::to_string(static_cast<int>(currentFrameRate)));